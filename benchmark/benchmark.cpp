@@ -0,0 +1,417 @@
+/*
+Microbenchmarks of the ingestion and feature hot paths.
+Results can be written as JSON for comparisons across commits with the standard Google Benchmark flags:
+benchmark --benchmark_out=results.json --benchmark_out_format=json
+
+The file-based benchmarks are only registered if a symbol is specified with --symbol=<symbol>.
+They must be run from a directory containing configuration.yaml, like generate.
+The sampler benchmarks compare BatchSampler to naive random access and are registered with --archives=<directory>.
+*/
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <confounding/common.h>
+#include <confounding/globex.h>
+#include <confounding/filter.h>
+#include <confounding/feature.h>
+#include <confounding/parser.h>
+#include <confounding/reader.h>
+#include <confounding/sampler.h>
+#include <confounding/constants.h>
+#include <confounding/configuration/contracts.h>
+#include <confounding/configuration/filters.h>
+
+namespace {
+	constexpr std::size_t sample_count = 4096;
+	constexpr unsigned random_seed = 1;
+	constexpr std::size_t sampler_batch_size = 1024;
+
+	// Replacing the global operator new only affects the allocations of this executable on Windows,
+	// allocations performed by confounding.dll itself are only counted with a shared C++ runtime like on Linux
+	std::atomic<uint64_t> allocation_count = 0;
+	std::atomic<uint64_t> allocation_bytes = 0;
+
+	class AllocationCounter {
+	public:
+		AllocationCounter()
+			: _count(allocation_count.load(std::memory_order_relaxed)),
+			_bytes(allocation_bytes.load(std::memory_order_relaxed)) {
+		}
+
+		void report(benchmark::State& state) const {
+			double count = static_cast<double>(allocation_count.load(std::memory_order_relaxed) - _count);
+			double bytes = static_cast<double>(allocation_bytes.load(std::memory_order_relaxed) - _bytes);
+			state.counters["allocations"] = benchmark::Counter(count, benchmark::Counter::kAvgIterations);
+			state.counters["allocated_bytes"] = benchmark::Counter(bytes, benchmark::Counter::kAvgIterations);
+		}
+
+	private:
+		uint64_t _count;
+		uint64_t _bytes;
+	};
+
+	// Random walk of prices with a tick size of 0.25, formatted like the close column of Barchart CSV files
+	std::vector<std::string> get_price_strings() {
+		std::mt19937 generator(random_seed);
+		std::uniform_int_distribution<int> step(-4, 4);
+		std::vector<std::string> prices;
+		int64_t ticks = 16000;
+		for (std::size_t i = 0; i < sample_count; i++) {
+			ticks += step(generator);
+			prices.push_back(std::format("{}.{:02}", ticks / 4, ticks % 4 * 25));
+		}
+		return prices;
+	}
+
+	std::vector<std::string> get_globex_strings() {
+		constexpr char months[] = {'H', 'M', 'U', 'Z'};
+		std::vector<std::string> codes;
+		for (std::size_t i = 0; i < sample_count; i++)
+			codes.push_back(std::format("ES{}{:02}", months[i % std::size(months)], i / std::size(months) % 100));
+		return codes;
+	}
+
+	std::vector<std::string> get_time_strings(bool include_time) {
+		std::vector<std::string> times;
+		auto time = confounding::get_time(confounding::Date{std::chrono::year{2010}, std::chrono::January, std::chrono::day{4}});
+		for (std::size_t i = 0; i < sample_count; i++) {
+			auto date = confounding::get_date(time);
+			if (include_time)
+				times.push_back(confounding::get_time_string(time));
+			else
+				times.push_back(confounding::get_date_string(date));
+			time += std::chrono::hours{7};
+		}
+		return times;
+	}
+
+	std::deque<double> get_daily_returns(std::size_t count) {
+		std::mt19937 generator(random_seed);
+		std::normal_distribution<double> distribution(0.0, 0.01);
+		std::deque<double> returns;
+		for (std::size_t i = 0; i < count; i++)
+			returns.push_back(distribution(generator));
+		return returns;
+	}
+
+	template<typename Function>
+	void run_samples(benchmark::State& state, const std::vector<std::string>& samples, Function function) {
+		AllocationCounter counter;
+		std::size_t i = 0;
+		for (auto _ : state) {
+			benchmark::DoNotOptimize(function(samples[i]));
+			i = (i + 1) % samples.size();
+		}
+		state.SetItemsProcessed(state.iterations());
+		counter.report(state);
+	}
+
+	void money(benchmark::State& state) {
+		auto prices = get_price_strings();
+		run_samples(state, prices, [](const std::string& price) {
+			return confounding::Money(price);
+		});
+	}
+
+	void globex_code(benchmark::State& state) {
+		auto codes = get_globex_strings();
+		run_samples(state, codes, [](const std::string& code) {
+			return confounding::GlobexCode(code);
+		});
+	}
+
+	void get_date(benchmark::State& state) {
+		auto dates = get_time_strings(false);
+		run_samples(state, dates, [](const std::string& date) {
+			return confounding::get_date(date);
+		});
+	}
+
+	void get_time(benchmark::State& state) {
+		auto times = get_time_strings(true);
+		run_samples(state, times, [](const std::string& time) {
+			return confounding::get_time(time);
+		});
+	}
+
+	void include_record(benchmark::State& state) {
+		confounding::ContractFilter filter{
+			.legacy_cutoff = confounding::GlobexCode("ESU02"),
+			.include_months = std::set<char>{'H', 'M', 'U', 'Z'},
+		};
+		std::vector<confounding::GlobexCode> codes;
+		for (const auto& code : get_globex_strings())
+			codes.emplace_back(code);
+		std::vector<confounding::Date> dates;
+		for (const auto& date : get_time_strings(false))
+			dates.push_back(confounding::get_date(date));
+		AllocationCounter counter;
+		std::size_t i = 0;
+		for (auto _ : state) {
+			benchmark::DoNotOptimize(filter.include_record(dates[i], codes[i]));
+			i = (i + 1) % sample_count;
+		}
+		state.SetItemsProcessed(state.iterations());
+		counter.report(state);
+	}
+
+	void get_volatility(benchmark::State& state) {
+		std::deque<double> closes(confounding::get_feature_closes_window(), 100.0);
+		auto returns = get_daily_returns(confounding::get_feature_returns_window());
+		confounding::FeatureInputs inputs{
+			.close = 100.0,
+			.close_8h = 100.0,
+			.recent_closes = closes,
+			.session_offset = 0,
+			.recent_returns = returns,
+		};
+		std::size_t n = static_cast<std::size_t>(state.range(0));
+		AllocationCounter counter;
+		for (auto _ : state)
+			benchmark::DoNotOptimize(inputs.get_volatility(n));
+		state.SetItemsProcessed(state.iterations());
+		counter.report(state);
+	}
+
+	void evaluate_features(benchmark::State& state) {
+		std::deque<double> closes;
+		for (std::size_t i = 0; i < confounding::get_feature_closes_window(); i++)
+			closes.push_back(100.0 + static_cast<double>(i % 7));
+		auto returns = get_daily_returns(confounding::get_feature_returns_window());
+		confounding::FeatureInputs inputs{
+			.close = 101.5,
+			.close_8h = 100.25,
+			.recent_closes = closes,
+			.session_offset = 1,
+			.recent_returns = returns,
+		};
+		std::array<double, confounding::feature_count> features;
+		AllocationCounter counter;
+		for (auto _ : state) {
+			confounding::evaluate_features(inputs, features);
+			benchmark::DoNotOptimize(features);
+		}
+		state.SetItemsProcessed(state.iterations());
+		counter.report(state);
+	}
+
+	void read_daily_records(benchmark::State& state, const std::string& symbol) {
+		const auto& filter = confounding::ContractFilterConfiguration::get().get_filter(symbol);
+		AllocationCounter counter;
+		std::size_t rows = 0;
+		for (auto _ : state) {
+			auto records = confounding::ArchiveGenerator::read_daily_records(symbol, filter);
+			for (const auto& [date, date_records] : records)
+				rows += date_records.size();
+		}
+		state.SetItemsProcessed(static_cast<int64_t>(rows));
+		counter.report(state);
+	}
+
+	void read_intraday_records(benchmark::State& state, const std::string& symbol) {
+		const auto& filter = confounding::ContractFilterConfiguration::get().get_filter(symbol);
+		AllocationCounter counter;
+		std::size_t rows = 0;
+		for (auto _ : state) {
+			auto records = confounding::ArchiveGenerator::read_intraday_records(symbol, filter);
+			for (const auto& [key, key_records] : records)
+				rows += key_records.size();
+		}
+		state.SetItemsProcessed(static_cast<int64_t>(rows));
+		counter.report(state);
+	}
+
+	// Covers get_features, get_returns and the forward returns of a single F-number series, excluding the CSV parsing
+	void generate_archive(benchmark::State& state, const std::string& symbol) {
+		const auto& filter = confounding::ContractFilterConfiguration::get().get_filter(symbol);
+		const auto& contract = confounding::ContractConfiguration::get().get_contract(symbol);
+		auto daily_records = confounding::ArchiveGenerator::read_daily_records(symbol, filter);
+		auto intraday_records = confounding::ArchiveGenerator::read_intraday_records(symbol, filter);
+		AllocationCounter counter;
+		std::size_t rows = 0;
+		for (auto _ : state) {
+			confounding::ArchiveGenerator generator(1, false, symbol, daily_records, intraday_records, filter, contract);
+			for (const auto& chunk : generator.generate())
+				rows += chunk.intraday_records.size();
+		}
+		state.SetItemsProcessed(static_cast<int64_t>(rows));
+		counter.report(state);
+	}
+
+	// All intraday columns, i.e. the features, their ranks and returns_next_close
+	std::vector<std::string> get_sampler_columns() {
+		std::vector<std::string> columns;
+		for (const auto& column : confounding::intraday_columns)
+			columns.push_back(column.name);
+		return columns;
+	}
+
+	void report_batches(benchmark::State& state, int64_t batches) {
+		state.counters["batches_per_second"] = benchmark::Counter(static_cast<double>(batches), benchmark::Counter::kIsRate);
+	}
+
+	void sample_shuffled_batches(benchmark::State& state, const std::vector<std::string>& paths) {
+		confounding::SamplerOptions options{
+			.archive_paths = paths,
+			.start = confounding::Time::min(),
+			.end = confounding::Time::max(),
+			.columns = get_sampler_columns(),
+			.batch_size = sampler_batch_size,
+			.seed = random_seed,
+		};
+		confounding::BatchSampler sampler(options);
+		int64_t batches = 0;
+		for (auto _ : state) {
+			auto batch = sampler.next();
+			if (batch.rows == 0)
+				batch = sampler.next();
+			benchmark::DoNotOptimize(batch.values);
+			batches++;
+		}
+		report_batches(state, batches);
+	}
+
+	// Draws each record independently and reads it column by column, skipping invalid records like BatchSampler
+	void sample_random_batches(benchmark::State& state, const std::vector<std::string>& paths) {
+		std::vector<std::unique_ptr<confounding::ArchiveReader>> readers;
+		std::vector<std::size_t> record_offsets;
+		std::size_t record_count = 0;
+		for (const auto& path : paths) {
+			readers.push_back(std::make_unique<confounding::ArchiveReader>(path));
+			record_offsets.push_back(record_count);
+			record_count += readers.back()->get_header().intraday_record_count;
+		}
+		auto columns = get_sampler_columns();
+		std::vector<float> values(sampler_batch_size * columns.size());
+		if (record_count == 0) {
+			state.SkipWithError("The archives don't contain any intraday records");
+			return;
+		}
+		std::mt19937_64 generator(random_seed);
+		std::uniform_int_distribution<std::size_t> distribution(0, record_count - 1);
+		int64_t batches = 0;
+		for (auto _ : state) {
+			std::size_t rows = 0;
+			while (rows < sampler_batch_size) {
+				std::size_t index = distribution(generator);
+				auto iterator = std::upper_bound(record_offsets.begin(), record_offsets.end(), index) - 1;
+				const auto& reader = *readers[iterator - record_offsets.begin()];
+				confounding::RecordRange range{.first = index - *iterator, .count = 1};
+				bool valid = true;
+				for (std::size_t i = 0; i < columns.size(); i++) {
+					float value;
+					if (reader.get_column(columns[i]).type == confounding::ColumnType::float32) {
+						value = reader.read_floats(columns[i], range).front();
+						valid = valid && !std::isnan(value);
+					} else {
+						int32_t returns = reader.read_returns(columns[i], range).front();
+						valid = valid && returns != confounding::intraday_invalid_returns;
+						value = static_cast<float>(returns);
+					}
+					values[rows * columns.size() + i] = value;
+				}
+				if (valid)
+					rows++;
+			}
+			benchmark::DoNotOptimize(values.data());
+			batches++;
+		}
+		report_batches(state, batches);
+	}
+
+	bool register_sampler_benchmarks(const std::string& directory) {
+		std::vector<std::string> paths;
+		try {
+			for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+				if (!entry.is_regular_file() || entry.path().extension() != ".archive")
+					continue;
+				// The sampler reads H1 archives, skip the M30, H4 and session archives of the same run
+				confounding::ArchiveReader reader(entry.path().string());
+				if (reader.get_header().bar_minutes == confounding::bar_minutes<confounding::H1>)
+					paths.push_back(entry.path().string());
+			}
+		} catch (const std::exception& exception) {
+			std::cerr << exception.what() << std::endl;
+			return false;
+		}
+		if (paths.empty()) {
+			std::cerr << "No H1 archives in " << directory << std::endl;
+			return false;
+		}
+		std::sort(paths.begin(), paths.end());
+		benchmark::RegisterBenchmark("sample_batches/shuffled", sample_shuffled_batches, paths)
+			->Unit(benchmark::kMillisecond);
+		benchmark::RegisterBenchmark("sample_batches/random", sample_random_batches, paths)
+			->Unit(benchmark::kMillisecond);
+		return true;
+	}
+
+	void register_symbol_benchmarks(const std::string& symbol) {
+		benchmark::RegisterBenchmark(std::format("read_daily_records/{}", symbol).c_str(), read_daily_records, symbol)
+			->Unit(benchmark::kMillisecond);
+		benchmark::RegisterBenchmark(std::format("read_intraday_records/{}", symbol).c_str(), read_intraday_records, symbol)
+			->Unit(benchmark::kMillisecond);
+		benchmark::RegisterBenchmark(std::format("generate_archive/{}", symbol).c_str(), generate_archive, symbol)
+			->Unit(benchmark::kMillisecond);
+	}
+}
+
+BENCHMARK(money);
+BENCHMARK(globex_code);
+BENCHMARK(get_date);
+BENCHMARK(get_time);
+BENCHMARK(include_record);
+BENCHMARK(get_volatility)->Arg(10)->Arg(40);
+BENCHMARK(evaluate_features);
+
+void* operator new(std::size_t size) {
+	allocation_count.fetch_add(1, std::memory_order_relaxed);
+	allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+	void* pointer = std::malloc(size == 0 ? 1 : size);
+	if (pointer == nullptr)
+		throw std::bad_alloc();
+	return pointer;
+}
+
+void operator delete(void* pointer) noexcept {
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+	std::free(pointer);
+}
+
+int main(int argc, char** argv) {
+	benchmark::Initialize(&argc, argv);
+	constexpr std::string_view symbol_argument = "--symbol=";
+	constexpr std::string_view archives_argument = "--archives=";
+	for (int i = 1; i < argc; i++) {
+		std::string_view argument = argv[i];
+		if (argument.starts_with(symbol_argument)) {
+			register_symbol_benchmarks(std::string(argument.substr(symbol_argument.size())));
+		} else if (argument.starts_with(archives_argument)) {
+			if (!register_sampler_benchmarks(std::string(argument.substr(archives_argument.size()))))
+				return 1;
+		} else {
+			std::cerr << "Unknown argument: " << argument << std::endl;
+			return 1;
+		}
+	}
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
\ No newline at end of file
@@ -1,12 +1,20 @@
 #pragma once
 
 #include <string>
+#include <array>
 #include <vector>
 #include <cstdint>
+#include <cstddef>
+#include <iterator>
+#include <limits>
+#include <optional>
 
 #include "confounding/exports.h"
 #include "confounding/common.h"
+#include "confounding/constants.h"
 #include "confounding/types.h"
+#include "confounding/encoding.h"
+#include "confounding/feature.h"
 
 namespace confounding {
 	struct CONFOUNDING_API DailyRecord {
@@ -22,44 +30,162 @@ namespace confounding {
 	template<typename T>
 	requires (std::same_as<T, float> || std::same_as<T, double>)
 	struct CONFOUNDING_API IntradayRecordT {
-		// close(t) / last_session_close(t - 8 h)
-		T momentum_1d;
-		// close(t) / last_session_close(t - 8 h - 1 day)
-		T momentum_2d;
-		// last_session_close(t - 8 h) / last_session_close(t - 8 h - 1 day)
-		T momentum_2d_gap;
-		// close(t) / close(t - 8 h)
-		T momentum_8h;
-		// close(t) / last_session_close(t - 8 h - 9 days)
-		T momentum_10d;
-		// close(t) / last_session_close(t - 8 h - 39 days)
-		T momentum_40d;
-		// daily_volatility(10 days)
-		T volatility_10d;
-		// daily_volatility(40 days)
-		T volatility_40d;
+		// Features in the order of feature_descriptors
+		std::array<T, feature_count> features;
+		// Percentile ranks in [0, 1] of the features above among the values of the trailing 40 days
+		std::array<T, feature_count> ranks;
 		// All returns are stored as ticks rather than relative return or money
 		// Returns do not contain slippage and commission
 		// Returns to next daily close that lies at least 8 hours after the current point in time
 		int32_t returns_next_close;
-		// Returns for fixed holding periods for a certain number of hours
-		int32_t returns_20h;
-		int32_t returns_22h;
-		int32_t returns_24h;
-		int32_t returns_26h;
-		int32_t returns_28h;
-		int32_t returns_48h;
-		int32_t returns_72h;
-		// Missing: TP/SL-based returns
+		// Returns for fixed holding periods and TP/SL-based returns are configurable and stored in Archive::extra_columns
 	};
 
 	typedef IntradayRecordT<double> RawIntradayRecord;
 	typedef IntradayRecordT<float> IntradayRecord;
 
-	struct CONFOUNDING_API Archive {
-		std::string symbol; 
+	template<typename T>
+	constexpr IntradayRecordT<T> get_nan_intraday_record() {
+		constexpr T nan = std::numeric_limits<T>::signaling_NaN();
+		IntradayRecordT<T> intraday_record{};
+		intraday_record.features.fill(nan);
+		intraday_record.ranks.fill(nan);
+		intraday_record.returns_next_close = intraday_invalid_returns;
+		return intraday_record;
+	}
+
+	inline constexpr IntradayRecord nan_intraday_record = get_nan_intraday_record<float>();
+
+	// A stretch of NaN records, one per bar, e.g. a holiday or a warm-up period
+	template<BarDuration Bar>
+	struct CONFOUNDING_API InvalidRunT {
+		BarTime<Bar> start;
+		// Number of bars
+		uint32_t length;
+	};
+
+	typedef InvalidRunT<H1> InvalidRun;
+
+	struct CONFOUNDING_API IntradayColumn {
+		const char* name;
+		ColumnType type;
+		std::size_t offset;
+	};
+
+	consteval auto get_intraday_columns() {
+		std::array<IntradayColumn, 2 * feature_count + 1> columns{};
+		for (std::size_t i = 0; i < feature_count; i++) {
+			const auto& descriptor = feature_descriptors[i];
+			columns[i] = {descriptor.name, ColumnType::float32, offsetof(IntradayRecord, features) + i * sizeof(float)};
+			columns[feature_count + i] = {descriptor.rank_name, ColumnType::float32, offsetof(IntradayRecord, ranks) + i * sizeof(float)};
+		}
+		columns[2 * feature_count] = {"returns_next_close", ColumnType::int32, offsetof(IntradayRecord, returns_next_close)};
+		return columns;
+	}
+
+	// Column layout of IntradayRecord as persisted by ArchiveWriter, in the same order as the fields of the struct
+	inline constexpr auto intraday_columns = get_intraday_columns();
+
+	template<BarDuration Bar>
+	struct CONFOUNDING_API DenseIntradayRecordT {
+		BarTime<Bar> time;
+		// Points to nan_intraday_record for records that are part of an invalid run
+		const IntradayRecord* record;
+	};
+
+	template<BarDuration Bar>
+	struct ArchiveT;
+
+	// Presents the dense view of an archive, one record per bar, with the NaN records of the invalid runs merged back in
+	template<BarDuration Bar>
+	class CONFOUNDING_API DenseIntradayIteratorT {
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef DenseIntradayRecordT<Bar> value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const DenseIntradayRecordT<Bar>* pointer;
+		typedef DenseIntradayRecordT<Bar> reference;
+
+		DenseIntradayIteratorT();
+		DenseIntradayIteratorT(const ArchiveT<Bar>* archive, std::size_t record_index, std::size_t run_index);
+
+		DenseIntradayRecordT<Bar> operator*() const;
+		DenseIntradayIteratorT& operator++();
+		DenseIntradayIteratorT operator++(int);
+		bool operator==(const DenseIntradayIteratorT& other) const;
+
+	private:
+		const ArchiveT<Bar>* _archive;
+		std::size_t _record_index;
+		std::size_t _run_index;
+		uint32_t _run_offset;
+
+		bool in_run() const;
+	};
+
+	// The part of an archive that was generated for a single trading day, see ArchiveGeneratorT::generate
+	template<BarDuration Bar>
+	struct CONFOUNDING_API ArchiveChunkT {
+		Date date;
+		std::optional<DailyRecord> daily_record;
+		std::vector<BarTime<Bar>> intraday_timestamps;
+		std::vector<IntradayRecord> intraday_records;
+		// Same layout as ArchiveT::extra_values
+		std::vector<int32_t> extra_values;
+		std::vector<InvalidRunT<Bar>> invalid_runs;
+
+		bool empty() const;
+		void clear();
+	};
+
+	/*
+	Only valid intraday records are stored explicitly, in intraday_timestamps and intraday_records.
+	NaN records are represented by invalid_runs, ordered by time, which never overlap with valid records.
+	*/
+	template<BarDuration Bar>
+	struct CONFOUNDING_API ArchiveT {
+		std::string symbol;
+		// "F1", "F2", ... or "FY"
+		std::string series;
 		std::vector<DailyRecord> daily_records;
-		std::vector<Time> intraday_timestamps;
+		std::vector<BarTime<Bar>> intraday_timestamps;
 		std::vector<IntradayRecord> intraday_records;
+		// Names of the int32 return columns that depend on the configuration and aren't part of IntradayRecord, e.g. TP/SL returns
+		std::vector<std::string> extra_columns;
+		// extra_columns.size() values per intraday record, stored record by record
+		std::vector<int32_t> extra_values;
+		std::vector<InvalidRunT<Bar>> invalid_runs;
+
+		// Chunks must be appended in chronological order, adjacent invalid runs are merged
+		void append(const ArchiveChunkT<Bar>& chunk);
+		DenseIntradayIteratorT<Bar> dense_begin() const;
+		DenseIntradayIteratorT<Bar> dense_end() const;
+		std::size_t get_dense_size() const;
+		int32_t get_extra_value(std::size_t record_index, std::size_t column_index) const;
 	};
+
+	typedef DenseIntradayRecordT<H1> DenseIntradayRecord;
+	typedef DenseIntradayIteratorT<H1> DenseIntradayIterator;
+	typedef ArchiveChunkT<H1> ArchiveChunk;
+	typedef ArchiveT<H1> Archive;
+
+	// Instantiated in archive.cpp for each resolution
+	extern template class DenseIntradayIteratorT<H1>;
+	extern template class DenseIntradayIteratorT<M30>;
+	extern template class DenseIntradayIteratorT<M15>;
+	extern template class DenseIntradayIteratorT<M5>;
+	extern template class DenseIntradayIteratorT<H4>;
+	extern template class DenseIntradayIteratorT<Session>;
+	extern template struct ArchiveChunkT<H1>;
+	extern template struct ArchiveChunkT<M30>;
+	extern template struct ArchiveChunkT<M15>;
+	extern template struct ArchiveChunkT<M5>;
+	extern template struct ArchiveChunkT<H4>;
+	extern template struct ArchiveChunkT<Session>;
+	extern template struct ArchiveT<H1>;
+	extern template struct ArchiveT<M30>;
+	extern template struct ArchiveT<M15>;
+	extern template struct ArchiveT<M5>;
+	extern template struct ArchiveT<H4>;
+	extern template struct ArchiveT<Session>;
 }
\ No newline at end of file
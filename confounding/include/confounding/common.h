@@ -36,14 +36,44 @@ namespace confounding {
 	void CONFOUNDING_API add_day(Date& date);
 	Time CONFOUNDING_API get_time(const std::string& string);
 	Time CONFOUNDING_API get_time(Date date);
+	MinuteTime CONFOUNDING_API get_minute_time(const std::string& string);
 	TimeOfDay CONFOUNDING_API get_time_of_day(const std::string& string);
 	TimeOfDay CONFOUNDING_API get_time_of_day(Time time);
 	std::string CONFOUNDING_API get_date_string(Date date);
 	std::string CONFOUNDING_API get_time_string(Time time);
+	std::string CONFOUNDING_API get_time_string(MinuteTime time);
+	BarResolution CONFOUNDING_API get_bar_resolution(const std::string& string);
+	std::string CONFOUNDING_API get_bar_resolution_string(BarResolution resolution);
 	double CONFOUNDING_API get_rate_of_change(double a, double b);
 	bool CONFOUNDING_API operator<(Time time, Date date);
 	Money CONFOUNDING_API operator*(unsigned factor, Money money);
 
+	// The overloads for Time above are used for H1 bars, these handle the other resolutions
+
+	template<BarDuration Bar>
+	BarTime<Bar> get_time(Date date) {
+		return std::chrono::local_days{date};
+	}
+
+	template<BarDuration Bar>
+	BarTime<Bar> get_time(const std::string& string) {
+		MinuteTime time = get_minute_time(string);
+		BarTime<Bar> output = std::chrono::floor<Bar>(time);
+		if (output != time)
+			throw Exception("Time {} is not aligned to {} bars", string, get_bar_name<Bar>());
+		return output;
+	}
+
+	template<BarDuration Bar>
+	Date get_date(BarTime<Bar> time) {
+		return Date{std::chrono::floor<std::chrono::days>(time)};
+	}
+
+	template<BarDuration Bar>
+	std::string get_time_string(BarTime<Bar> time) {
+		return get_time_string(MinuteTime{time});
+	}
+
 	template<typename T>
 	T get_number(const std::string& string) {
 		T result;
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "confounding/exports.h"
+#include "confounding/encoding.h"
+
+namespace confounding {
+	/*
+	Block codecs used by the block-compressed archive layout.
+	The input and output of the codecs are always the encoded bytes of a column, i.e. after applying its ColumnEncoding.
+	The entropy stage is zlib, preceded by a type-specific transform:
+	- int64 timestamps: delta encoding followed by frame-of-reference bit-packing of the deltas
+	- raw int32 returns: frame-of-reference bit-packing with a reserved code for intraday_invalid_returns
+	- everything else: byte shuffling, which groups the exponent bytes of floats together
+	*/
+	std::vector<char> CONFOUNDING_API compress_block(
+		ColumnType type,
+		ColumnEncoding encoding,
+		const char* data,
+		std::size_t count,
+		int level
+	);
+	void CONFOUNDING_API decompress_block(
+		ColumnType type,
+		ColumnEncoding encoding,
+		const char* compressed_data,
+		std::size_t compressed_size,
+		std::size_t payload_size,
+		std::size_t count,
+		char* output
+	);
+}
\ No newline at end of file
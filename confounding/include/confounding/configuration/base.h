@@ -1,14 +1,54 @@
 #pragma once
 
 #include <string>
+#include <map>
+#include <vector>
+#include <optional>
 
 #include "confounding/types.h"
+#include "confounding/format.h"
 
 namespace confounding {
+	// Take profit and stop loss distances in ticks, relative to the close of an intraday record
+	struct Barrier {
+		unsigned take_profit;
+		unsigned stop_loss;
+	};
+
 	class Configuration {
 	public:
 		std::string barchart_directory;
 		Date reference_date;
+		std::string archive_directory;
+		ArchiveOptions archive_options;
+		unsigned archive_writer_threads;
+		std::size_t archive_writer_memory;
+		// JSON report of the time, rows, allocations and memory per stage of parse_futures
+		std::string metrics_path;
+		// Optional Chrome trace event file with the spans of the stages of parse_futures
+		std::optional<std::string> trace_path;
+		// Annotate the spans with hardware counters, Linux only
+		bool trace_counters;
+		// Only reads the rows from reference_date minus the warm-up of the features, for partial and incremental runs
+		// Seeks to them with byte offset indexes that are stored next to the Barchart files and built on the first run
+		bool date_index;
+		// Unix domain socket of the resident archive service
+		std::string service_socket_path;
+		// Duration of the intraday bars of the Barchart files that parse_futures generates archives from
+		BarResolution bar_resolution;
+		// H4 and session bars that are aggregated from the bars of bar_resolution while reading them, each one adds an archive per series
+		std::vector<BarResolution> derived_bars;
+		// Features that are replaced with their Z-scores relative to a trailing window of the specified length
+		std::map<std::string, std::chrono::days> normalization_windows;
+		// Number of trading days after the current one that are available to the returns
+		unsigned max_holding_days;
+		// Holding periods of the fixed horizon returns, one column each
+		// They are counted in trading sessions of 24 hours each, e.g. returns_48h exits at the time of day of the record on the second session after it
+		std::vector<std::chrono::hours> return_horizons;
+		// Each barrier adds a returns and an exit time column to the archives, the exit time is a number of bars
+		std::vector<Barrier> barriers;
+		// Maximum holding period for barrier returns, in trading sessions of 24 hours each for session bars like return_horizons
+		std::chrono::hours barrier_horizon;
 
 		Configuration();
 
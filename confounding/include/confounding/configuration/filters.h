@@ -15,6 +15,8 @@ namespace confounding {
 		static const ContractFilterConfiguration& get();
 
 		const ContractFilter& get_filter(const std::string& symbol) const;
+		std::vector<ContractFilter>::const_iterator begin() const;
+		std::vector<ContractFilter>::const_iterator end() const;
 
 	private:
 		bool _initialized;
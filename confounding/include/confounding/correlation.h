@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include <cstddef>
+
+#include "confounding/exports.h"
+#include "confounding/types.h"
+#include "confounding/format.h"
+
+namespace confounding {
+	/*
+	Correlation file layout:
+	CorrelationHeader
+	char[symbol_count][archive_symbol_size]
+	ColumnHeader[column_count]
+	Column data sections aligned to archive_alignment:
+	- correlation_date: int32[date_count], days since the epoch
+	- correlation_{n}d and beta_{n}d for each window: float32[date_count][symbol_count][symbol_count]
+	beta_{n}d[t][i][j] is the beta of symbol i relative to symbol j, i.e. cov(i, j) / var(j).
+	*/
+	inline constexpr uint32_t correlation_magic = 0x52524f43;
+	inline constexpr uint32_t correlation_version = 1;
+	inline constexpr const char* correlation_date_column = "correlation_date";
+
+	// Close-to-close returns of a symbol by date, NaN for dates without a return, e.g. the first one
+	typedef std::map<Date, double> DailyReturns;
+
+	struct CONFOUNDING_API CorrelationHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t symbol_count;
+		uint32_t column_count;
+		uint64_t date_count;
+	};
+
+	// Rolling [date][symbol][symbol] matrices for a single window, NaN where there were too few joint observations
+	struct CONFOUNDING_API CorrelationMatrices {
+		std::size_t window;
+		std::vector<float> correlation;
+		std::vector<float> beta;
+	};
+
+	class CONFOUNDING_API CorrelationEngine {
+	public:
+		// Daily returns are laid out as [date][symbol], NaN where a symbol lacks a return for that date
+		CorrelationEngine(
+			const std::vector<std::string>& symbols,
+			const std::vector<Date>& dates,
+			std::vector<double>&& returns
+		);
+
+		// The matrices of a date are based on the returns of the window ending with that date
+		CorrelationMatrices compute(std::size_t window) const;
+		void write(const std::string& path, const std::vector<CorrelationMatrices>& matrices) const;
+
+	private:
+		std::vector<std::string> _symbols;
+		std::vector<Date> _dates;
+		std::vector<double> _returns;
+
+		void compute_block(std::size_t first_i, std::size_t first_j, CorrelationMatrices& matrices) const;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+#include "confounding/exports.h"
+
+namespace confounding {
+	inline constexpr std::size_t hardware_counter_count = 4;
+	inline constexpr const char* hardware_counter_names[hardware_counter_count] = {
+		"cycles",
+		"instructions",
+		"cache_misses",
+		"branch_misses",
+	};
+
+	typedef std::array<uint64_t, hardware_counter_count> HardwareCounterValues;
+
+	/*
+	User space hardware performance counters of the calling thread, in the order of hardware_counter_names.
+	They're based on perf_event_open and only available on Linux.
+	Even there they can be unavailable due to kernel.perf_event_paranoid or virtualization, read returns false in that case.
+	*/
+	class CONFOUNDING_API HardwareCounters {
+	public:
+		HardwareCounters();
+		HardwareCounters(const HardwareCounters&) = delete;
+		~HardwareCounters();
+
+		HardwareCounters& operator=(const HardwareCounters&) = delete;
+
+		bool read(HardwareCounterValues& values) const;
+
+	private:
+		// Group leader followed by the other counters, -1 if they couldn't be opened
+		std::array<int, hardware_counter_count> _files;
+	};
+}
\ No newline at end of file
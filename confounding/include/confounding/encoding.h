@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <span>
+#include <vector>
+#include <map>
+
+#include "confounding/exports.h"
+
+namespace confounding {
+	// Native type of a column prior to encoding
+	enum class ColumnType : uint8_t {
+		float32,
+		int32,
+		int64
+	};
+
+	/*
+	Storage encoding of an archive column.
+	float16 and bfloat16 are only valid for float32 columns, int16 and int8 are only valid for int32 returns.
+	Quantized returns map intraday_invalid_returns to the maximum value of the narrower type, all other values saturate.
+	*/
+	enum class ColumnEncoding : uint8_t {
+		raw,
+		float16,
+		bfloat16,
+		int16,
+		int8
+	};
+
+	typedef std::map<std::string, ColumnEncoding> ColumnEncodingMap;
+
+	ColumnEncoding CONFOUNDING_API get_column_encoding(const std::string& string);
+	std::string CONFOUNDING_API get_encoding_string(ColumnEncoding encoding);
+	std::size_t CONFOUNDING_API get_type_size(ColumnType type);
+	std::size_t CONFOUNDING_API get_encoded_size(ColumnType type, ColumnEncoding encoding);
+	bool CONFOUNDING_API is_valid_encoding(ColumnType type, ColumnEncoding encoding);
+
+	uint16_t CONFOUNDING_API float_to_half(float value);
+	float CONFOUNDING_API half_to_float(uint16_t value);
+	uint16_t CONFOUNDING_API float_to_bfloat16(float value);
+	float CONFOUNDING_API bfloat16_to_float(uint16_t value);
+
+	// The encoding functions append to the output buffer and return the maximum absolute error introduced by the encoding
+	double CONFOUNDING_API encode_floats(std::span<const float> input, ColumnEncoding encoding, std::vector<char>& output);
+	double CONFOUNDING_API encode_returns(std::span<const int32_t> input, ColumnEncoding encoding, std::vector<char>& output);
+	// The decoding functions use SSE2/F16C where available, input does not need to be aligned
+	void CONFOUNDING_API decode_floats(const void* input, ColumnEncoding encoding, std::span<float> output);
+	void CONFOUNDING_API decode_returns(const void* input, ColumnEncoding encoding, std::span<int32_t> output);
+}
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+#include <span>
+#include <cstdint>
+#include <cstddef>
+
+#include "confounding/exports.h"
+
+namespace confounding {
+	/*
+	Sparse tables over a static series for O(1) range minimum/maximum queries.
+	First-passage searches descend the levels of the tables and take O(log n) rather than scanning the range.
+	*/
+	class CONFOUNDING_API RangeExtrema {
+	public:
+		RangeExtrema();
+
+		void build(std::span<const int64_t> values);
+		// Ranges are [first, last) and must not be empty
+		int64_t get_min(std::size_t first, std::size_t last) const;
+		int64_t get_max(std::size_t first, std::size_t last) const;
+		// Index of the first element in [first, last) that is >= threshold, or last if there is none
+		std::size_t find_first_at_least(std::size_t first, std::size_t last, int64_t threshold) const;
+		// Index of the first element in [first, last) that is <= threshold, or last if there is none
+		std::size_t find_first_at_most(std::size_t first, std::size_t last, int64_t threshold) const;
+
+	private:
+		std::size_t _size;
+		// Level k contains the extrema of the ranges [i, i + 2^k), stored at k * _size + i
+		std::vector<int64_t> _min;
+		std::vector<int64_t> _max;
+		std::size_t _levels;
+	};
+}
\ No newline at end of file
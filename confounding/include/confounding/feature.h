@@ -0,0 +1,196 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "confounding/exports.h"
+#include "confounding/common.h"
+
+namespace confounding {
+	// Inputs of the features of a single intraday record, gathered once and shared by all features
+	struct CONFOUNDING_API FeatureInputs {
+		// close(t)
+		double close;
+		// close(t - 8 h)
+		double close_8h;
+		// Most recent daily closes, starting with today's
+		const std::deque<double>& recent_closes;
+		// 1 if the session of today hasn't ended at least 8 hours ago
+		std::size_t session_offset;
+		// Most recent daily returns, starting with today's
+		const std::deque<double>& recent_returns;
+
+		// last_session_close(t - 8 h - i days)
+		double get_session_close(std::size_t i) const {
+			return recent_closes[session_offset + i];
+		}
+
+		// daily_volatility(n days)
+		double get_volatility(std::size_t n) const;
+	};
+
+	/*
+	Declarative description of a feature of IntradayRecordT.
+	The record layout, the NaN record, the archive columns and the evaluation loop are all derived from feature_descriptors.
+	Adding a feature only requires a new entry, the inputs it declares are validated by ArchiveGenerator before evaluating it.
+	*/
+	struct CONFOUNDING_API FeatureDescriptor {
+		const char* name;
+		const char* rank_name;
+		// Bit i is set if the feature depends on last_session_close(t - 8 h - i days)
+		uint64_t session_closes;
+		// Number of daily returns the feature depends on
+		std::size_t returns_window;
+		double (*evaluate)(const FeatureInputs& inputs);
+	};
+
+	consteval uint64_t session_close(std::size_t days) {
+		return 1ull << days;
+	}
+
+	inline constexpr FeatureDescriptor feature_descriptors[] = {
+		{
+			// close(t) / last_session_close(t - 8 h)
+			.name = "momentum_1d",
+			.rank_name = "momentum_1d_rank",
+			.session_closes = session_close(0),
+			.returns_window = 0,
+			.evaluate = [](const FeatureInputs& inputs) {
+				return get_rate_of_change(inputs.close, inputs.get_session_close(0));
+			}
+		},
+		{
+			// close(t) / last_session_close(t - 8 h - 1 day)
+			.name = "momentum_2d",
+			.rank_name = "momentum_2d_rank",
+			.session_closes = session_close(1),
+			.returns_window = 0,
+			.evaluate = [](const FeatureInputs& inputs) {
+				return get_rate_of_change(inputs.close, inputs.get_session_close(1));
+			}
+		},
+		{
+			// last_session_close(t - 8 h) / last_session_close(t - 8 h - 1 day)
+			.name = "momentum_2d_gap",
+			.rank_name = "momentum_2d_gap_rank",
+			.session_closes = session_close(0) | session_close(1),
+			.returns_window = 0,
+			.evaluate = [](const FeatureInputs& inputs) {
+				return get_rate_of_change(inputs.get_session_close(0), inputs.get_session_close(1));
+			}
+		},
+		{
+			// close(t) / close(t - 8 h)
+			.name = "momentum_8h",
+			.rank_name = "momentum_8h_rank",
+			.session_closes = 0,
+			.returns_window = 0,
+			.evaluate = [](const FeatureInputs& inputs) {
+				return get_rate_of_change(inputs.close, inputs.close_8h);
+			}
+		},
+		{
+			// close(t) / last_session_close(t - 8 h - 9 days)
+			.name = "momentum_10d",
+			.rank_name = "momentum_10d_rank",
+			.session_closes = session_close(9),
+			.returns_window = 0,
+			.evaluate = [](const FeatureInputs& inputs) {
+				return get_rate_of_change(inputs.close, inputs.get_session_close(9));
+			}
+		},
+		{
+			// close(t) / last_session_close(t - 8 h - 39 days)
+			.name = "momentum_40d",
+			.rank_name = "momentum_40d_rank",
+			.session_closes = session_close(39),
+			.returns_window = 0,
+			.evaluate = [](const FeatureInputs& inputs) {
+				return get_rate_of_change(inputs.close, inputs.get_session_close(39));
+			}
+		},
+		{
+			// daily_volatility(10 days)
+			.name = "volatility_10d",
+			.rank_name = "volatility_10d_rank",
+			.session_closes = 0,
+			.returns_window = 10,
+			.evaluate = [](const FeatureInputs& inputs) {
+				return inputs.get_volatility(10);
+			}
+		},
+		{
+			// daily_volatility(40 days)
+			.name = "volatility_40d",
+			.rank_name = "volatility_40d_rank",
+			.session_closes = 0,
+			.returns_window = 40,
+			.evaluate = [](const FeatureInputs& inputs) {
+				return inputs.get_volatility(40);
+			}
+		},
+	};
+
+	inline constexpr std::size_t feature_count = std::size(feature_descriptors);
+
+	// Union of the session closes of all features
+	consteval uint64_t get_feature_session_closes() {
+		uint64_t session_closes = 0;
+		for (const auto& descriptor : feature_descriptors)
+			session_closes |= descriptor.session_closes;
+		return session_closes;
+	}
+
+	// Offsets i of all last_session_close(t - 8 h - i days) values required by the features, in ascending order
+	consteval auto get_feature_session_lags() {
+		constexpr uint64_t session_closes = get_feature_session_closes();
+		std::array<std::size_t, std::popcount(session_closes)> lags{};
+		std::size_t j = 0;
+		for (std::size_t i = 0; i < 64; i++) {
+			if (session_closes & (1ull << i))
+				lags[j++] = i;
+		}
+		return lags;
+	}
+
+	// Number of daily closes that need to be kept, including the one skipped by FeatureInputs::session_offset
+	consteval std::size_t get_feature_closes_window() {
+		uint64_t session_closes = get_feature_session_closes();
+		return static_cast<std::size_t>(std::bit_width(session_closes)) + 1;
+	}
+
+	consteval std::size_t get_feature_returns_window() {
+		std::size_t window = 0;
+		for (const auto& descriptor : feature_descriptors)
+			window = std::max(window, descriptor.returns_window);
+		return window;
+	}
+
+	// Returns feature_count for unknown features
+	constexpr std::size_t get_feature_index(std::string_view name) {
+		for (std::size_t i = 0; i < feature_count; i++) {
+			if (name == feature_descriptors[i].name)
+				return i;
+		}
+		return feature_count;
+	}
+
+	template<typename T, std::size_t... I>
+	void evaluate_features(const FeatureInputs& inputs, std::array<T, feature_count>& features, std::index_sequence<I...>) {
+		// The formulas are constant expressions, so this expands into one direct call per feature rather than an indirect one
+		((features[I] = static_cast<T>(std::integral_constant<decltype(feature_descriptors[I].evaluate), feature_descriptors[I].evaluate>::value(inputs))), ...);
+	}
+
+	// Evaluates all features in a single fused pass over the shared inputs
+	template<typename T>
+	void evaluate_features(const FeatureInputs& inputs, std::array<T, feature_count>& features) {
+		evaluate_features(inputs, features, std::make_index_sequence<feature_count>{});
+	}
+}
\ No newline at end of file
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <optional>
+#include <set>
+
+#include "confounding/encoding.h"
+#include "confounding/exception.h"
+
+namespace confounding {
+	/*
+	Binary archive layout, all values are little endian:
+	ArchiveHeader
+	ColumnHeader[column_count]
+	ArchiveBlock[block_count] (block-compressed layout only)
+	Column data sections, each one aligned to archive_alignment so that mmapped columns can be used with SIMD loads
+
+	In the block-compressed layout the intraday columns are split into blocks of block_size records.
+	The data section of such a column starts with BlockEntry[block_count], followed by the compressed blocks.
+	*/
+	inline constexpr uint32_t archive_magic = 0x52414643;
+	inline constexpr uint32_t archive_version = 11;
+	inline constexpr std::size_t archive_alignment = 64;
+	inline constexpr std::size_t archive_symbol_size = 16;
+	inline constexpr std::size_t archive_series_size = 8;
+	inline constexpr std::size_t archive_column_name_size = 32;
+	inline constexpr int default_compression_level = 6;
+
+	// ArchiveHeader::flags
+	inline constexpr uint32_t archive_flag_blocked = 1;
+	// ColumnHeader::flags
+	inline constexpr uint8_t column_flag_blocked = 1;
+	// int32 return columns from Archive::extra_columns
+	inline constexpr uint8_t column_flag_extra = 2;
+
+	// Names of the columns that aren't part of IntradayRecord
+	inline constexpr const char* daily_date_column = "daily_date";
+	inline constexpr const char* daily_close_column = "daily_close";
+	// Bars since the epoch, see ArchiveHeader::bar_minutes
+	inline constexpr const char* intraday_time_column = "intraday_time";
+	// Intraday columns only contain valid records, NaN records are stored as runs of consecutive bars
+	inline constexpr const char* invalid_run_start_column = "invalid_run_start";
+	inline constexpr const char* invalid_run_length_column = "invalid_run_length";
+	// Element i is the index of the first intraday record at or after day_index_start + i days, with one extra element at the end
+	inline constexpr const char* day_index_column = "day_index";
+
+	struct CONFOUNDING_API ArchiveHeader {
+		uint32_t magic;
+		uint32_t version;
+		char symbol[archive_symbol_size];
+		char series[archive_series_size];
+		uint64_t daily_record_count;
+		uint64_t intraday_record_count;
+		uint32_t column_count;
+		uint32_t flags;
+		uint32_t block_size;
+		uint32_t block_count;
+		uint64_t block_index_offset;
+		// Days since the epoch of the first entry of the day index
+		int64_t day_index_start;
+		// Duration of the intraday bars, the unit of the intraday times and of the invalid runs
+		uint32_t bar_minutes;
+		uint32_t reserved;
+	};
+
+	struct CONFOUNDING_API ColumnHeader {
+		char name[archive_column_name_size];
+		ColumnType type;
+		ColumnEncoding encoding;
+		uint8_t flags;
+		uint8_t reserved[5];
+		uint64_t count;
+		uint64_t offset;
+		uint64_t size;
+		// Maximum absolute error introduced by the encoding, NaN mismatches and overflows are reported as infinity
+		double max_error;
+	};
+
+	// Time range of a block in the block-compressed layout, used to decompress only the blocks covering a range
+	struct CONFOUNDING_API ArchiveBlock {
+		int64_t first_time;
+		int64_t last_time;
+		uint64_t first_record;
+		uint64_t record_count;
+	};
+
+	struct CONFOUNDING_API BlockEntry {
+		// Relative to the offset of the column
+		uint64_t offset;
+		uint32_t compressed_size;
+		// Size of the block after decompression, i.e. the size of the column encoding of its records
+		uint32_t payload_size;
+	};
+
+	struct CONFOUNDING_API ArchiveOptions {
+		ColumnEncodingMap column_encodings;
+		// Enables the block-compressed layout for intraday columns, e.g. 65536 records per block
+		std::optional<uint32_t> block_size;
+		int compression_level;
+		// Restricts the intraday and extra columns that are written, all of them are written if empty
+		std::set<std::string> columns;
+
+		bool include_column(const std::string& name) const {
+			return columns.empty() || columns.contains(name);
+		}
+	};
+
+	inline std::size_t get_aligned_offset(std::size_t offset) {
+		return (offset + archive_alignment - 1) / archive_alignment * archive_alignment;
+	}
+
+	template<std::size_t N>
+	void copy_string(char (&destination)[N], const std::string& source) {
+		if (source.size() >= N)
+			throw Exception("String too long for archive header: {}", source);
+		std::memset(destination, 0, N);
+		std::memcpy(destination, source.data(), source.size());
+	}
+}
\ No newline at end of file
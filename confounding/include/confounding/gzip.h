@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <cstddef>
+#include <cstdint>
+
+#include "confounding/exports.h"
+
+namespace confounding {
+	/*
+	Sequential reader for gzip-compressed files.
+	Decompression runs on a separate thread which stays a bounded number of chunks ahead of the consumer.
+	The optional skip range is decompressed but omitted from the output, e.g. to jump to an indexed row.
+	*/
+	class CONFOUNDING_API GzipStream {
+	public:
+		GzipStream(const std::string& path, uint64_t skip_offset = 0, uint64_t skip_size = 0);
+		GzipStream(const GzipStream&) = delete;
+		~GzipStream();
+
+		GzipStream& operator=(const GzipStream&) = delete;
+
+		// Returns the number of bytes copied to the buffer, 0 at the end of the stream
+		int read(char* buffer, int size);
+
+	private:
+		std::string _path;
+		void* _file;
+		uint64_t _skip_offset;
+		uint64_t _skip_size;
+		std::deque<std::vector<char>> _chunks;
+		std::vector<char> _current_chunk;
+		std::size_t _current_offset;
+		bool _finished;
+		bool _stop;
+		std::exception_ptr _error;
+		std::mutex _mutex;
+		std::condition_variable _chunk_available;
+		std::condition_variable _chunk_consumed;
+		std::thread _thread;
+
+		void decompress();
+	};
+}
\ No newline at end of file
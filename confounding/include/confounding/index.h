@@ -0,0 +1,95 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <cstdint>
+#include <cstddef>
+
+#include "confounding/exports.h"
+#include "confounding/types.h"
+
+namespace confounding {
+	inline constexpr uint32_t date_index_magic = 0x58444944;
+	inline constexpr uint32_t date_index_version = 1;
+	inline constexpr const char* date_index_extension = ".index";
+
+	// Identifies the exact version of a CSV file that an index was built from
+	struct CONFOUNDING_API FileFingerprint {
+		uint64_t size;
+		int64_t last_write_time;
+
+		bool operator==(const FileFingerprint& other) const = default;
+	};
+
+	struct CONFOUNDING_API DateIndexHeader {
+		uint32_t magic;
+		uint32_t version;
+		FileFingerprint fingerprint;
+		// Size of the CSV header line, including the line break
+		uint64_t header_size;
+		uint32_t entry_count;
+		uint32_t reserved;
+	};
+
+	struct CONFOUNDING_API DateIndexEntry {
+		// Days since the epoch
+		int32_t date;
+		uint32_t reserved;
+		// Offset of the first row with that date, relative to the start of the decompressed file
+		uint64_t offset;
+	};
+
+	FileFingerprint CONFOUNDING_API get_file_fingerprint(const std::string& path);
+
+	/*
+	Sidecar index mapping sampled dates to byte offsets of the rows of a CSV file sorted by date.
+	It is stored next to the CSV file as <path>.index and becomes invalid as soon as the fingerprint changes.
+	*/
+	class CONFOUNDING_API DateIndex {
+	public:
+		DateIndex(FileFingerprint fingerprint, uint64_t header_size, std::vector<DateIndexEntry>&& entries);
+
+		// Returns nullopt if there is no index for the file or if it's outdated
+		static std::optional<DateIndex> load(const std::string& csv_path);
+		static std::string get_path(const std::string& csv_path);
+
+		void save(const std::string& csv_path) const;
+		uint64_t get_header_size() const;
+		// Offset of the first row that may be dated on or after the date, all rows before it are dated earlier
+		uint64_t get_offset(Date date) const;
+
+	private:
+		FileFingerprint _fingerprint;
+		uint64_t _header_size;
+		std::vector<DateIndexEntry> _entries;
+	};
+
+	// Builds a DateIndex from the raw bytes of a CSV file while they are being passed to the parser
+	class CONFOUNDING_API DateIndexBuilder {
+	public:
+		DateIndexBuilder(const std::string& date_column, uint64_t sample_interval);
+
+		void update(const char* data, std::size_t size);
+		// Returns nullopt if the rows weren't sorted by date, since such files can't be indexed
+		std::optional<DateIndex> finish(FileFingerprint fingerprint);
+
+	private:
+		std::string _date_column;
+		uint64_t _sample_interval;
+		uint64_t _offset;
+		uint64_t _header_size;
+		std::optional<std::size_t> _date_column_index;
+		uint64_t _line_offset;
+		std::size_t _column_index;
+		std::string _field;
+		bool _line_processed;
+		bool _sorted;
+		std::optional<int32_t> _last_date;
+		std::vector<DateIndexEntry> _entries;
+
+		void process_header();
+		void process_date();
+		void end_line();
+	};
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+#include "confounding/exports.h"
+
+namespace confounding {
+#ifdef _WIN32
+	// File mapping handle on Windows, file descriptor elsewhere
+	typedef void* SharedMemoryHandle;
+#else
+	typedef int SharedMemoryHandle;
+#endif
+
+	// Read-only memory mapping of an entire file
+	class CONFOUNDING_API MappedFile {
+	public:
+		MappedFile(const std::string& path);
+		MappedFile(const MappedFile&) = delete;
+		MappedFile(MappedFile&& other) noexcept;
+		~MappedFile();
+
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		// Maps a shared memory segment received from another process and takes ownership of the handle
+		static MappedFile from_shared_memory(SharedMemoryHandle handle, std::size_t size);
+
+		const char* get_data() const;
+		std::size_t get_size() const;
+
+	private:
+		const char* _data;
+		std::size_t _size;
+#ifdef _WIN32
+		void* _file;
+		void* _mapping;
+#else
+		int _file;
+#endif
+
+		MappedFile();
+
+		void close();
+	};
+}
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <cstdint>
+
+#include "confounding/exports.h"
+#include "confounding/counters.h"
+
+namespace confounding {
+	enum class PipelineStage {
+		read_daily_records,
+		read_intraday_records,
+		generate,
+		encode,
+		// Time spent blocked in AsyncFileWriter::submit because too many archives were pending
+		output_wait,
+		output,
+		build_panels,
+		build_correlations,
+	};
+
+	// Ingestion stages only have a symbol, panels and correlations have neither
+	struct CONFOUNDING_API MetricsKey {
+		std::string symbol;
+		std::string series;
+	};
+
+	/*
+	Measures one execution of a pipeline stage on the current thread, from construction to destruction.
+	Wall time, thread CPU time and the allocations performed by the thread are recorded automatically.
+	Allocations are only counted in builds with CONFOUNDING_COUNT_ALLOCATIONS, see metrics.cpp.
+	Samples are appended to a buffer owned by the thread so that workers never contend for a lock.
+	They are only merged by write_metrics and write_trace, once all workers are done.
+	*/
+	class CONFOUNDING_API StageTimer {
+	public:
+		StageTimer(PipelineStage stage, const MetricsKey& key);
+		StageTimer(const StageTimer&) = delete;
+		~StageTimer();
+
+		StageTimer& operator=(const StageTimer&) = delete;
+
+		void add_rows(uint64_t rows);
+		void add_nan_records(uint64_t nan_records);
+		void add_bytes(uint64_t bytes);
+
+	private:
+		PipelineStage _stage;
+		MetricsKey _key;
+		std::chrono::steady_clock::time_point _start;
+		int64_t _cpu_start;
+		uint64_t _allocations_start;
+		uint64_t _allocated_bytes_start;
+		uint64_t _rows;
+		uint64_t _nan_records;
+		uint64_t _bytes;
+		bool _has_counters;
+		HardwareCounterValues _counters_start;
+	};
+
+	// Discards the samples of previous runs, must not be called while stages are being measured
+	void CONFOUNDING_API reset_metrics();
+	// Aggregates the samples per stage, symbol and series and writes them to a JSON report
+	void CONFOUNDING_API write_metrics(const std::string& path, std::chrono::steady_clock::duration wall_time);
+	// Each sample is a span of a Chrome trace event file with one track per thread, for chrome://tracing or Perfetto
+	void CONFOUNDING_API write_trace(const std::string& path);
+	// Annotates the spans with the hardware counters of the thread, at the cost of two extra system calls per span
+	void CONFOUNDING_API set_trace_counters(bool enabled);
+	// High-water mark of the resident memory of the process, in bytes
+	uint64_t CONFOUNDING_API get_peak_memory();
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <deque>
+#include <utility>
+#include <optional>
+#include <cstddef>
+
+#include "confounding/exports.h"
+#include "confounding/types.h"
+
+namespace confounding {
+	/*
+	Z-score of each new value relative to the mean and standard deviation of the values of a trailing time window.
+	The window only contains values prior to the current one so that the normalization is free of look-ahead bias.
+	The moments are updated incrementally using Welford's algorithm and periodically recalculated to limit the drift caused by removals.
+	*/
+	class CONFOUNDING_API RollingZScore {
+	public:
+		RollingZScore(std::chrono::hours window);
+
+		// Returns NaN if the values don't span the entire window yet or if they're constant
+		double update(MinuteTime time, double value);
+
+	private:
+		std::chrono::hours _window;
+		std::deque<std::pair<MinuteTime, double>> _values;
+		std::optional<MinuteTime> _first_time;
+		double _mean;
+		double _m2;
+		std::size_t _updates;
+
+		void add(double value);
+		void remove(double value);
+		void recalculate();
+	};
+}
\ No newline at end of file
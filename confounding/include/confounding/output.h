@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <cstddef>
+
+#include "confounding/exports.h"
+#include "confounding/metrics.h"
+
+namespace confounding {
+	// Writes the data to a temporary file in large chunks, flushes it to disk and then atomically renames it to path
+	void CONFOUNDING_API write_file(const std::string& path, const char* data, std::size_t size);
+
+	/*
+	Background output stage for finished archives.
+	Workers hand over their buffers and move on to the next archive while a pool of threads performs the writes.
+	The amount of memory held by pending buffers is limited, submit blocks until enough of them have been written.
+	*/
+	class CONFOUNDING_API AsyncFileWriter {
+	public:
+		AsyncFileWriter(unsigned thread_count, std::size_t max_pending_bytes);
+		AsyncFileWriter(const AsyncFileWriter&) = delete;
+		~AsyncFileWriter();
+
+		AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+		// The write is recorded as the output stage of key
+		void submit(const std::string& path, std::vector<char>&& data, const MetricsKey& key = {});
+		// Waits for all pending writes and rethrows the first error that occurred, if any
+		void flush();
+
+	private:
+		struct Job {
+			std::string path;
+			std::vector<char> data;
+			MetricsKey key;
+		};
+
+		std::size_t _max_pending_bytes;
+		std::size_t _pending_bytes;
+		std::size_t _pending_jobs;
+		bool _stop;
+		std::exception_ptr _error;
+		std::deque<Job> _jobs;
+		std::mutex _mutex;
+		std::condition_variable _job_available;
+		std::condition_variable _job_done;
+		std::vector<std::thread> _threads;
+
+		void run_worker();
+	};
+}
\ No newline at end of file
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <span>
+#include <cstdint>
+#include <cstddef>
+
+#include "confounding/exports.h"
+#include "confounding/format.h"
+#include "confounding/mapping.h"
+#include "confounding/reader.h"
+
+namespace confounding {
+	/*
+	Panel layout, combining the archives of one series of all symbols on a shared time axis:
+	PanelHeader
+	char[symbol_count][archive_symbol_size] with the symbols in the order of the panel columns
+	ColumnHeader[column_count]
+	Column data sections, aligned to archive_alignment like in archives:
+	- panel_time: int64[time_count], every hour for which at least one symbol has a valid intraday record
+	- panel_presence: int64[time_count][presence_words], bit s of a row is set if symbol s has a valid record at that time
+	- One column per IntradayRecord field and per extra return column with [time_count][symbol_count] raw values
+	Missing values are NaN for features and intraday_invalid_returns for returns.
+	*/
+	inline constexpr uint32_t panel_magic = 0x4c4e4150;
+	inline constexpr uint32_t panel_version = 1;
+	inline constexpr const char* panel_time_column = "panel_time";
+	inline constexpr const char* panel_presence_column = "panel_presence";
+
+	struct CONFOUNDING_API PanelHeader {
+		uint32_t magic;
+		uint32_t version;
+		char series[archive_series_size];
+		uint32_t symbol_count;
+		uint32_t column_count;
+		uint64_t time_count;
+		uint32_t presence_words;
+		uint32_t reserved;
+	};
+
+	class CONFOUNDING_API PanelWriter {
+	public:
+		// The archives must all be of the same series
+		PanelWriter(const std::string& series, const std::vector<std::string>& archive_paths);
+
+		const std::vector<char>& encode();
+		void write(const std::string& path);
+
+	private:
+		std::string _series;
+		std::vector<std::string> _symbols;
+		std::vector<ArchiveReader> _readers;
+		std::vector<int64_t> _timestamps;
+		// Maps the records of each symbol to rows of the panel
+		std::vector<std::vector<uint32_t>> _rows;
+		std::vector<ColumnHeader> _columns;
+		std::vector<std::vector<char>> _column_data;
+		std::vector<char> _buffer;
+
+		void build_time_axis();
+		void build_presence_mask();
+		void build_intraday_columns();
+		void add_column(const std::string& name, ColumnType type, std::size_t count, std::vector<char>&& data);
+		void serialize();
+	};
+
+	class CONFOUNDING_API PanelReader {
+	public:
+		PanelReader(const std::string& path);
+
+		const PanelHeader& get_header() const;
+		std::vector<std::string> get_symbols() const;
+		std::size_t get_symbol_index(const std::string& symbol) const;
+		std::span<const int64_t> get_timestamps() const;
+		// Index of the first row at or after the time
+		std::size_t get_row(Time time) const;
+		bool is_present(std::size_t row, std::size_t symbol_index) const;
+		// Zero-copy [time][symbol] views of the mmapped panel
+		std::span<const float> get_floats(const std::string& name) const;
+		std::span<const int32_t> get_returns(const std::string& name) const;
+
+	private:
+		MappedFile _file;
+		const PanelHeader* _header;
+		const char* _symbols;
+		std::span<const ColumnHeader> _columns;
+		std::span<const int64_t> _timestamps;
+		std::span<const int64_t> _presence;
+
+		const ColumnHeader& get_column(const std::string& name, ColumnType type) const;
+		const char* get_column_data(const ColumnHeader& column) const;
+	};
+}
\ No newline at end of file
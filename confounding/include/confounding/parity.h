@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstddef>
+
+#include "confounding/exports.h"
+#include "confounding/archive.h"
+#include "confounding/types.h"
+
+namespace confounding {
+	struct CONFOUNDING_API ParityOptions {
+		// Maximum absolute difference of float and returns values that is still considered equal
+		// NaN features and intraday_invalid_returns only ever match themselves
+		double tolerance;
+		// Overrides tolerance for individual columns, e.g. ones with a reduced-precision encoding
+		std::map<std::string, double> column_tolerances;
+
+		double get_tolerance(const std::string& column) const;
+	};
+
+	struct CONFOUNDING_API ColumnDivergence {
+		std::string column;
+		// Number of records with different values, or records present on one side only in the case of intraday_time
+		std::size_t mismatches;
+		Time first_time;
+		std::string reference_value;
+		std::string candidate_value;
+	};
+
+	/*
+	Compares two archives record by record on their dense hourly view, so NaN records in invalid runs are compared, too.
+	Times that are only part of one of the archives are reported for intraday_time and compared against NaN records.
+	Columns that only exist in one of the archives are reported with a mismatch for each record.
+	Returns the columns that differ, in the order of intraday_columns, followed by the extra columns.
+	*/
+	std::vector<ColumnDivergence> CONFOUNDING_API compare_archives(
+		const Archive& reference,
+		const Archive& candidate,
+		const ParityOptions& options
+	);
+}
\ No newline at end of file
@@ -3,6 +3,9 @@
 #include <string>
 #include <map>
 #include <deque>
+#include <vector>
+#include <optional>
+#include <generator>
 
 #include "confounding/exports.h"
 #include "confounding/common.h"
@@ -11,6 +14,13 @@
 #include "confounding/types.h"
 #include "confounding/globex.h"
 #include "confounding/archive.h"
+#include "confounding/output.h"
+#include "confounding/rank.h"
+#include "confounding/normalization.h"
+#include "confounding/extrema.h"
+#include "confounding/shard.h"
+#include "confounding/correlation.h"
+#include "confounding/configuration/base.h"
 
 namespace confounding {
 	struct CONFOUNDING_API GlobexRecord {
@@ -29,51 +39,153 @@ namespace confounding {
 		bool operator<(const IntradayRecordsKey& key) const;
 	};
 
-	struct CONFOUNDING_API IntradayClose {
-		Time time;
+	template<BarDuration Bar>
+	struct CONFOUNDING_API IntradayCloseT {
+		BarTime<Bar> time;
 		Money close;
 	};
 
+	typedef IntradayCloseT<H1> IntradayClose;
+
+	struct CONFOUNDING_API FeatureNormalization {
+		// Index in feature_descriptors
+		std::size_t feature;
+		RollingZScore z_score;
+	};
+
 	typedef std::map<Date, std::vector<GlobexRecord>> GlobexRecordMap;
-	typedef std::map<IntradayRecordsKey, std::vector<IntradayClose>> IntradayRecordMap;
+	template<BarDuration Bar>
+	using IntradayRecordMapT = std::map<IntradayRecordsKey, std::vector<IntradayCloseT<Bar>>>;
+
+	typedef IntradayRecordMapT<H1> IntradayRecordMap;
+
+	/*
+	Coarser bars that read_intraday_records aggregates from the intraday records in the same pass, see derived_bars.
+	Only the engaged maps are populated, the close of a derived bar is the close of the last intraday bar within it.
+	*/
+	struct CONFOUNDING_API DerivedIntradayRecords {
+		std::optional<IntradayRecordMapT<H4>> h4;
+		std::optional<IntradayRecordMapT<Session>> session;
+	};
 
-	class CONFOUNDING_API ArchiveGenerator {
+	// The parts of the pipeline that don't depend on the duration of the intraday bars
+	class CONFOUNDING_API ArchiveGeneratorBase {
 	public:
-		ArchiveGenerator(
+		/*
+		Generates the archives of all contracts with the bar_resolution of the configuration.
+		With a shard only the contracts assigned to it are processed and the archives are written to its shard directory.
+		The panels and correlations depend on all contracts, so in that case they are built by merge_shards instead.
+		*/
+		static void parse_futures(std::optional<ShardSpecification> shard = std::nullopt);
+		// Validates the manifests of all shards, moves their archives into the archive directory and builds the panels and correlations
+		static void merge_shards(unsigned shard_count);
+		// Public so that the ingestion can be benchmarked on its own
+		static GlobexRecordMap read_daily_records(const std::string& symbol, const ContractFilter& filter);
+		// Path of the Barchart CSV file with the suffix "D1", "H1", "M30" etc., or of its gzip-compressed version
+		static std::string get_symbol_path(const std::string& symbol, const std::string& suffix);
+		// Maps "F1", "F2", ... to the F-number and "FY" to nullopt
+		static std::optional<unsigned> get_f_number(const std::string& series);
+
+	protected:
+		static void build_panels();
+		// The daily returns are in the order of the symbols
+		static void build_correlations(const std::vector<std::string>& symbols, const std::vector<DailyReturns>& daily_returns);
+		// Compares the close of the front contract to the close of the same contract on the previous day rather than the previous front contract,
+		// otherwise rolls would show up as returns
+		static DailyReturns get_daily_returns(const GlobexRecordMap& daily_records);
+		static IntradayRecord get_intraday_record(const RawIntradayRecord& raw_intraday_record);
+		// "F1", "F2", ... followed by "FY", if enabled
+		static std::vector<std::string> get_series(const ContractFilter& filter);
+		// Name of bar_resolution followed by those of the derived_bars
+		static std::vector<std::string> get_bar_names();
+		/*
+		Assigns the contracts to shards by their estimated cost, i.e. the size of their input files times the number of series.
+		Each contract is assigned to the shard with the lowest total so far, starting with the most expensive one.
+		The assignment is deterministic, so the processes of the shards agree on it without communicating.
+		*/
+		static std::vector<std::string> get_shard_symbols(ShardSpecification shard, const std::string& bar_name);
+		// The archives of H1 bars lack the resolution in their file names
+		static std::string get_archive_file(const std::string& symbol, const std::string& series, const std::string& bar_name);
+		static std::string get_archive_path(const std::string& symbol, const std::string& series, const std::string& bar_name);
+		static std::string get_panel_path(const std::string& series);
+	};
+
+	/*
+	Generates the archives of a single series with a fixed bar duration.
+	Each resolution is a separate instantiation so that the dense slot arrays have a fixed stride and the slot counts are constants.
+	*/
+	template<BarDuration Bar>
+	class CONFOUNDING_API ArchiveGeneratorT : public ArchiveGeneratorBase {
+	public:
+		ArchiveGeneratorT(
 			std::optional<unsigned> f_number,
 			bool fy_record,
 			const std::string& symbol,
 			const GlobexRecordMap& daily_records,
-			const IntradayRecordMap& intraday_records,
+			const IntradayRecordMapT<Bar>& intraday_records,
 			const ContractFilter& filter,
 			const Contract& contract
 		);
 
-		static void parse_futures();
+		// See parse_futures
+		static void run_pipeline(std::optional<ShardSpecification> shard);
+		static IntradayRecordMapT<Bar> read_intraday_records(
+			const std::string& symbol,
+			const ContractFilter& filter,
+			DerivedIntradayRecords* derived_records = nullptr
+		);
 
-		void run();
+		// Writes the archive to the directory and returns its entry for the manifest
+		ManifestArchive run(const std::string& directory, AsyncFileWriter& output);
+		// Generates the entire archive in memory without writing it, e.g. as a reference for parity checks
+		const ArchiveT<Bar>& build_archive();
+		// Yields the records of one trading day at a time, as soon as all of their returns have been resolved
+		// The chunk is only valid until the generator is resumed
+		std::generator<const ArchiveChunkT<Bar>&> generate();
 
 	private:
 		std::optional<unsigned> _f_number;
 		bool _fy_record;
 		const std::string& _symbol;
 		const GlobexRecordMap& _daily_records;
-		const IntradayRecordMap& _intraday_records;
+		const IntradayRecordMapT<Bar>& _intraday_records;
 		const ContractFilter& _filter;
 		const Contract& _contract;
-		Archive _archive;
-		std::vector<RawIntradayRecord> _raw_intraday_records;
+		ArchiveT<Bar> _archive;
+		ArchiveChunkT<Bar> _chunk;
+		std::size_t _record_count;
 		std::deque<double> _recent_closes;
 		std::deque<double> _recent_returns;
-		std::vector<IntradayClose> _today_closes;
-		std::vector<IntradayClose> _intraday_closes;
+		std::vector<IntradayCloseT<Bar>> _today_closes;
+		std::vector<IntradayCloseT<Bar>> _intraday_closes;
+		// Closes in ticks with one slot per bar starting at _bars_start, with intraday_invalid_returns for missing bars
+		std::vector<int32_t> _bar_ticks;
+		BarTime<Bar> _bars_start;
+		// Closes of the records of the current day in the order of _chunk.intraday_records, the entries of the forward returns
+		std::vector<int64_t> _entry_closes;
+		// Trading dates of the up to max_holding_days sessions following the current one, see get_forward_returns
+		std::vector<Date> _session_dates;
+		// Extrema of the amounts of _intraday_closes for the first-passage searches of the barrier returns
+		RangeExtrema _close_extrema;
 		GlobexRecord _globex_today;
 		GlobexRecord _globex_tomorrow;
+		std::optional<BarTime<Bar>> _last_time;
+		std::vector<RollingRank> _feature_ranks;
+		std::vector<FeatureNormalization> _normalizations;
+		// Copies of the settings of the returns since Configuration::get locks a mutex shared by all workers
+		unsigned _max_holding_days;
+		std::vector<std::chrono::hours> _return_horizons;
+		std::vector<Barrier> _barriers;
+		std::chrono::hours _barrier_horizon;
 
-		static void parse_single_contract(const Contract& contract);
-		static GlobexRecordMap read_daily_records(const std::string& symbol, const ContractFilter& filter);
-		static IntradayRecordMap read_intraday_records(const std::string& symbol, const ContractFilter& filter);
-		static std::string get_symbol_path(const std::string& symbol, const std::string& suffix);
+		static std::vector<ManifestArchive> parse_single_contract(
+			const Contract& contract,
+			const std::string& directory,
+			AsyncFileWriter& output,
+			DailyReturns& daily_returns
+		);
+
+		void process_day(Date reference_date);
 
 		bool get_globex_records(Date reference_date);
 		GlobexRecord get_daily_globex_record(
@@ -82,18 +194,35 @@ namespace confounding {
 		);
 		bool get_intraday_closes();
 		void update_recent_closes(const GlobexRecord& daily_globex_record);
-		void generate_intraday_record(const IntradayClose& record);
+		void generate_intraday_record(const IntradayCloseT<Bar>& record);
 		bool get_features(
-			const IntradayClose& record,
+			const IntradayCloseT<Bar>& record,
 			bool use_today,
 			RawIntradayRecord& raw_intraday_record
 		);
 		void get_returns(
-			const IntradayClose& record,
+			const IntradayCloseT<Bar>& record,
 			bool use_today,
 			RawIntradayRecord& raw_intraday_record
 		);
-		double get_volatility(std::size_t n);
-		void add_nan_record(Time time);
+		void get_bar_ticks();
+		void get_forward_returns();
+		void get_barrier_returns(BarTime<Bar> time, int64_t entry, int32_t* values);
+		void get_ranks(BarTime<Bar> time, RawIntradayRecord& raw_intraday_record);
+		void normalize_features(BarTime<Bar> time, RawIntradayRecord& raw_intraday_record);
+		void add_nan_record(BarTime<Bar> time);
+		void add_nan_run(BarTime<Bar> start, uint32_t length);
+		void add_timestamp(BarTime<Bar> time);
+		void check_time(BarTime<Bar> time) const;
 	};
+
+	typedef ArchiveGeneratorT<H1> ArchiveGenerator;
+
+	// Instantiated in parser.cpp for each resolution
+	extern template class ArchiveGeneratorT<H1>;
+	extern template class ArchiveGeneratorT<M30>;
+	extern template class ArchiveGeneratorT<M15>;
+	extern template class ArchiveGeneratorT<M5>;
+	extern template class ArchiveGeneratorT<H4>;
+	extern template class ArchiveGeneratorT<Session>;
 }
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <utility>
+#include <optional>
+#include <cstdint>
+#include <cstddef>
+
+#include "confounding/exports.h"
+#include "confounding/types.h"
+
+namespace confounding {
+	// Multiset of doubles with O(log n) insertion, removal and rank queries, implemented as a treap with subtree sizes
+	class CONFOUNDING_API OrderStatistics {
+	public:
+		OrderStatistics();
+
+		void insert(double value);
+		// Removes a single instance of the value, if present
+		void erase(double value);
+		std::size_t count_less(double value) const;
+		std::size_t count_less_equal(double value) const;
+		std::size_t size() const;
+
+	private:
+		struct Node {
+			double value;
+			uint32_t priority;
+			uint32_t size;
+			int32_t left;
+			int32_t right;
+		};
+
+		std::vector<Node> _nodes;
+		std::vector<int32_t> _free_nodes;
+		int32_t _root;
+		uint32_t _random_state;
+
+		int32_t allocate(double value);
+		uint32_t get_size(int32_t node) const;
+		void update_size(int32_t node);
+		// Splits the tree into values < value (or <= value if inclusive) and the rest
+		void split(int32_t node, double value, bool inclusive, int32_t& left, int32_t& right);
+		int32_t merge(int32_t left, int32_t right);
+		uint32_t get_random();
+	};
+
+	// Percentile rank of each new value among the values of a trailing time window, including the value itself
+	class CONFOUNDING_API RollingRank {
+	public:
+		RollingRank(std::chrono::hours window);
+
+		// Returns a rank in [0, 1] or NaN if the values don't span the entire window yet
+		double update(MinuteTime time, double value);
+
+	private:
+		std::chrono::hours _window;
+		std::deque<std::pair<MinuteTime, double>> _values;
+		OrderStatistics _statistics;
+		std::optional<MinuteTime> _first_time;
+	};
+}
\ No newline at end of file
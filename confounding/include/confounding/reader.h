@@ -0,0 +1,78 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <span>
+
+#include "confounding/exports.h"
+#include "confounding/archive.h"
+#include "confounding/format.h"
+#include "confounding/mapping.h"
+
+namespace confounding {
+	struct CONFOUNDING_API RecordRange {
+		std::size_t first;
+		std::size_t count;
+	};
+
+	class CONFOUNDING_API ArchiveReader {
+	public:
+		ArchiveReader(const std::string& path);
+		// Archives in memory, e.g. shared memory segments of ArchiveService
+		ArchiveReader(MappedFile&& file);
+
+		const ArchiveHeader& get_header() const;
+		std::span<const ColumnHeader> get_columns() const;
+		std::span<const ArchiveBlock> get_blocks() const;
+		const ColumnHeader& get_column(const std::string& name) const;
+		// Returns nullptr if the column is missing because it was excluded by ArchiveOptions::columns
+		const ColumnHeader* find_column(const std::string& name) const;
+		bool is_blocked() const;
+		// The methods that take or return intraday times throw if Bar doesn't match the bars of the archive
+		// Intraday records in [start, end), uses the day index and scans at most one day of timestamps per boundary
+		template<BarDuration Bar>
+		RecordRange get_record_range(BarTime<Bar> start, BarTime<Bar> end) const;
+		RecordRange get_record_range(Date start, Date end) const;
+		// Zero-copy views of the mmapped archive, only available for raw columns in the plain layout
+		std::span<const int64_t> get_time_span(RecordRange range) const;
+		std::span<const float> get_float_span(const std::string& name, RecordRange range) const;
+		std::span<const int32_t> get_returns_span(const std::string& name, RecordRange range) const;
+		std::vector<float> read_floats(const std::string& name) const;
+		std::vector<float> read_floats(const std::string& name, RecordRange range) const;
+		std::vector<int32_t> read_returns(const std::string& name) const;
+		std::vector<int32_t> read_returns(const std::string& name, RecordRange range) const;
+		template<BarDuration Bar = H1>
+		std::vector<BarTime<Bar>> read_timestamps() const;
+		template<BarDuration Bar = H1>
+		std::vector<BarTime<Bar>> read_timestamps(RecordRange range) const;
+		std::vector<DailyRecord> read_daily_records() const;
+		// Runs overlapping [start, end) are clipped to the range
+		template<BarDuration Bar>
+		std::vector<InvalidRunT<Bar>> read_invalid_runs(BarTime<Bar> start, BarTime<Bar> end) const;
+		// Intraday columns that are missing from the archive are filled in with the values of NaN records
+		template<BarDuration Bar = H1>
+		ArchiveT<Bar> read_archive() const;
+		// Only decompresses the blocks covering [start, end) in the block-compressed layout
+		template<BarDuration Bar>
+		ArchiveT<Bar> read_archive(BarTime<Bar> start, BarTime<Bar> end) const;
+
+	private:
+		MappedFile _file;
+		const ArchiveHeader* _header;
+		std::span<const ColumnHeader> _columns;
+		std::span<const ArchiveBlock> _blocks;
+		const ColumnHeader* _time_column;
+		std::span<const int64_t> _day_index;
+		int64_t _bars_per_day;
+
+		void load(const std::string& path);
+		template<BarDuration Bar>
+		void check_resolution() const;
+		const char* get_column_data(const ColumnHeader& column) const;
+		const char* get_encoded_records(const ColumnHeader& column, RecordRange range, std::vector<char>& buffer) const;
+		RecordRange get_full_range() const;
+		std::size_t get_record_index(int64_t time) const;
+		std::size_t get_day_record_index(int64_t day) const;
+		const char* get_raw_records(const ColumnHeader& column, ColumnType type, RecordRange range) const;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <cstdint>
+#include <cstddef>
+
+#include "confounding/exports.h"
+#include "confounding/types.h"
+#include "confounding/reader.h"
+
+namespace confounding {
+	struct CONFOUNDING_API SamplerOptions {
+		std::vector<std::string> archive_paths;
+		// Only records in [start, end) are sampled
+		Time start;
+		Time end;
+		// Float and returns columns, intraday or extra, in the order of the values of a row
+		std::vector<std::string> columns;
+		std::size_t batch_size;
+		// Number of consecutive records that are always read together, rounded up to the block size of blocked archives
+		std::size_t chunk_size = 4096;
+		// Number of randomly selected chunks whose records are shuffled together
+		std::size_t shuffle_chunks = 16;
+		// Number of batches the background thread may prepare in advance
+		std::size_t prefetch_batches = 4;
+		uint64_t seed = 0;
+		// Discard the last batch of an epoch if it has fewer than batch_size rows
+		bool drop_last = true;
+	};
+
+	struct CONFOUNDING_API SampleBatch {
+		// Row-major values of SamplerOptions::columns, returns are converted from ticks to floats
+		const float* values;
+		std::size_t rows;
+		std::size_t columns;
+	};
+
+	/*
+	Produces shuffled mini-batches of the valid records of a set of archives for training.
+	Records are read in chunks of consecutive records, so the mmapped archives are read sequentially rather than page by page.
+	Each epoch visits the chunks in a new random order and shuffles the records of a window of shuffle_chunks chunks.
+	Records with a NaN feature or invalid returns in any of the selected columns are skipped using a validity bitmap.
+	A background thread fills a fixed set of page-locked buffers so that batches can be copied to a GPU without staging.
+	*/
+	class CONFOUNDING_API BatchSampler {
+	public:
+		BatchSampler(const SamplerOptions& options);
+		BatchSampler(const BatchSampler&) = delete;
+		~BatchSampler();
+
+		BatchSampler& operator=(const BatchSampler&) = delete;
+
+		// Returns a batch with 0 rows at the end of an epoch, the next call starts another one
+		// The values remain valid until the next call
+		SampleBatch next();
+		// Number of valid records per epoch
+		std::size_t get_record_count() const;
+
+	private:
+		struct Chunk {
+			std::size_t archive;
+			RecordRange range;
+		};
+
+		class Buffer;
+
+		struct Entry {
+			Buffer* buffer;
+			std::size_t rows;
+		};
+
+		SamplerOptions _options;
+		std::vector<std::unique_ptr<ArchiveReader>> _readers;
+		// One bit per record of each archive, the first bit of an archive corresponds to the first record of its range
+		std::vector<std::vector<uint64_t>> _validity;
+		std::vector<RecordRange> _ranges;
+		std::vector<Chunk> _chunks;
+		std::size_t _record_count;
+		std::vector<std::unique_ptr<Buffer>> _buffers;
+		std::vector<Buffer*> _free_buffers;
+		std::deque<Entry> _entries;
+		Buffer* _current_buffer;
+		bool _stop;
+		std::exception_ptr _error;
+		std::mutex _mutex;
+		std::condition_variable _buffer_available;
+		std::condition_variable _entry_available;
+		std::thread _thread;
+
+		void build_validity(std::size_t archive);
+		void read_chunk(const Chunk& chunk, std::vector<float>& values) const;
+		void run_producer();
+		bool produce_epoch(uint64_t epoch);
+		Buffer* acquire_buffer();
+		void push_entry(Entry entry);
+	};
+}
\ No newline at end of file
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <filesystem>
+#include <cstdint>
+
+#include "confounding/exports.h"
+#include "confounding/types.h"
+#include "confounding/format.h"
+#include "confounding/archive.h"
+#include "confounding/reader.h"
+#include "confounding/parser.h"
+
+namespace confounding {
+	/*
+	Protocol of ArchiveService, each message is a single fixed size struct.
+	A client sends ServiceRequest and receives ServiceResponse.
+	On success the response is accompanied by a read-only shared memory segment with an archive in the plain layout.
+	On Linux the memfd is passed along with the response as SCM_RIGHTS ancillary data.
+	On Windows the service duplicates the file mapping handle into the client process and sends its value instead.
+	*/
+	inline constexpr uint32_t service_magic = 0x53524643;
+	inline constexpr std::size_t service_max_columns = 64;
+	inline constexpr std::size_t service_message_size = 256;
+
+	struct CONFOUNDING_API ServiceRequest {
+		uint32_t magic;
+		uint32_t process_id;
+		char symbol[archive_symbol_size];
+		char series[archive_series_size];
+		// Hours since the epoch, the range [start, end) is clipped to the archive
+		int64_t start;
+		int64_t end;
+		// All columns are included if column_count is 0
+		uint32_t column_count;
+		char columns[service_max_columns][archive_column_name_size];
+	};
+
+	struct CONFOUNDING_API ServiceResponse {
+		uint32_t magic;
+		uint32_t success;
+		uint64_t size;
+		// Handle of the file mapping in the client process, Windows only
+		uint64_t handle;
+		// Error message if success is 0
+		char message[service_message_size];
+	};
+
+	struct CONFOUNDING_API ServiceQuery {
+		std::string symbol;
+		// "F1", "F2", ... or "FY"
+		std::string series;
+		// The entire archive is returned by default
+		std::optional<Time> start;
+		std::optional<Time> end;
+		// Intraday and extra columns, all of them if empty
+		std::vector<std::string> columns;
+	};
+
+	/*
+	Long-running local service that keeps the ingested Barchart data and the generated archives of all symbols in memory.
+	Requests are answered with shared memory segments so that any number of processes can map the same warm copy.
+	The archive of a series is only generated on the first request for it.
+	The CSV files are checked on each request and everything that depends on them is regenerated once they change.
+	Requests for entire archives share one cached segment, those for time ranges or columns get a new one.
+	*/
+	class CONFOUNDING_API ArchiveService {
+	public:
+		ArchiveService(const std::string& socket_path);
+		ArchiveService(const ArchiveService&) = delete;
+		~ArchiveService();
+
+		ArchiveService& operator=(const ArchiveService&) = delete;
+
+		// Serves clients until the process is terminated, each connection is handled by a thread of its own
+		void run();
+
+	private:
+		class SharedMemory;
+
+		struct SymbolCache {
+			// Held while ingesting, generating and encoding entire archives so that other symbols can be served in the meantime
+			std::mutex mutex;
+			std::filesystem::file_time_type daily_time;
+			std::filesystem::file_time_type intraday_time;
+			bool loaded = false;
+			GlobexRecordMap daily_records;
+			IntradayRecordMap intraday_records;
+			// Shared with requests for subsets that are still being encoded when the CSV files change
+			std::map<std::string, std::shared_ptr<const Archive>> archives;
+			std::map<std::string, std::shared_ptr<SharedMemory>> segments;
+		};
+
+		std::string _socket_path;
+		std::intptr_t _socket;
+		std::mutex _mutex;
+		std::map<std::string, std::unique_ptr<SymbolCache>> _symbols;
+
+		void handle_client(std::intptr_t client);
+		std::shared_ptr<SharedMemory> get_segment(const ServiceRequest& request);
+		SymbolCache& get_symbol_cache(const std::string& symbol);
+		void update_symbol_cache(const std::string& symbol, SymbolCache& cache);
+		std::shared_ptr<const Archive> get_archive(const std::string& symbol, const std::string& series, SymbolCache& cache);
+	};
+
+	// Connection to the ArchiveService of the local machine
+	class CONFOUNDING_API ArchiveClient {
+	public:
+		ArchiveClient(const std::string& socket_path);
+		ArchiveClient(const ArchiveClient&) = delete;
+		~ArchiveClient();
+
+		ArchiveClient& operator=(const ArchiveClient&) = delete;
+
+		// The reader maps the segment of the service and remains valid after the client has been destroyed
+		ArchiveReader request(const ServiceQuery& query);
+
+	private:
+		std::intptr_t _socket;
+	};
+}
\ No newline at end of file
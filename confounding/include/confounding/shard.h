@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+
+#include "confounding/exports.h"
+#include "confounding/types.h"
+#include "confounding/correlation.h"
+
+namespace confounding {
+	inline constexpr const char* manifest_file = "manifest.yaml";
+	inline constexpr const char* daily_returns_file = "daily_returns.bin";
+
+	// Shard index out of count, the index ranges from 1 to count
+	struct CONFOUNDING_API ShardSpecification {
+		unsigned index;
+		unsigned count;
+	};
+
+	struct CONFOUNDING_API ManifestArchive {
+		std::string symbol;
+		std::string series;
+		// File name relative to the directory of the manifest
+		std::string file;
+		uint64_t size;
+	};
+
+	/*
+	Lists the archives generated by a run of parse_futures, either by a single shard or by all of them.
+	The manifest is only written once all of the archives are on disk, so its presence marks the run as finished.
+	The settings allow the merge to reject shards that were generated with a different configuration.
+	*/
+	struct CONFOUNDING_API ArchiveManifest {
+		ShardSpecification shard;
+		BarResolution bar_resolution;
+		Date reference_date;
+		// Symbols of all contracts that were assigned to the shard
+		std::vector<std::string> symbols;
+		std::vector<ManifestArchive> archives;
+
+		static ArchiveManifest load(const std::string& path);
+
+		void save(const std::string& path) const;
+	};
+
+	// Parses "<index>/<count>", e.g. "3/8"
+	ShardSpecification CONFOUNDING_API get_shard_specification(const std::string& string);
+	// Directory within the archive directory that the archives, the manifest and the metrics of a shard are written to
+	std::string CONFOUNDING_API get_shard_directory(ShardSpecification shard);
+	/*
+	The daily returns of the symbols of a shard, so that merge_shards can build the correlations without reading the daily records again.
+	Layout: uint32 symbol count, then for each symbol char[archive_symbol_size], uint64 date count,
+	int32[date count] days since the epoch and double[date count] returns.
+	*/
+	void CONFOUNDING_API write_daily_returns(const std::string& path, const std::vector<std::string>& symbols, const std::vector<DailyReturns>& daily_returns);
+	std::map<std::string, DailyReturns> CONFOUNDING_API read_daily_returns(const std::string& path);
+}
\ No newline at end of file
@@ -2,11 +2,75 @@
 
 #include <chrono>
 #include <filesystem>
+#include <concepts>
+#include <cstdint>
+#include <cstddef>
 
 namespace confounding {
 	typedef std::chrono::year_month_day Date;
-	// Warning: This only work for H1 bars and will have to be modified to std::chrono::minutes with M30 bars
-	typedef std::chrono::local_time<std::chrono::hours> Time;
+
+	// Durations of the supported intraday bars
+	typedef std::chrono::hours H1;
+	typedef std::chrono::duration<int64_t, std::ratio<1800>> M30;
+	typedef std::chrono::duration<int64_t, std::ratio<900>> M15;
+	typedef std::chrono::duration<int64_t, std::ratio<300>> M5;
+	typedef std::chrono::duration<int64_t, std::ratio<14400>> H4;
+	// Daily bars that end at the session end of the contract rather than at midnight, the time of a bar is the date of its session
+	typedef std::chrono::days Session;
+
+	template<typename Bar>
+	concept BarDuration =
+		std::same_as<Bar, H1> ||
+		std::same_as<Bar, M30> ||
+		std::same_as<Bar, M15> ||
+		std::same_as<Bar, M5> ||
+		std::same_as<Bar, H4> ||
+		std::same_as<Bar, Session>;
+
+	enum class BarResolution {
+		h1,
+		m30,
+		m15,
+		m5,
+		// Only derived from the other resolutions, see derived_bars
+		h4,
+		session
+	};
+
+	/*
+	Intraday times are counts of bars so that consecutive bars are always exactly one tick apart.
+	This keeps the dense slot arrays of the generator and the invalid runs of the archives at a fixed stride for each resolution.
+	*/
+	template<BarDuration Bar>
+	using BarTime = std::chrono::local_time<Bar>;
+
+	typedef BarTime<H1> Time;
+	// Finest common representation of the times of all resolutions, e.g. for the rolling windows
+	typedef std::chrono::local_time<std::chrono::minutes> MinuteTime;
+
+	template<BarDuration Bar>
+	inline constexpr std::size_t bars_per_day = std::chrono::days{1} / Bar{1};
+
+	template<BarDuration Bar>
+	inline constexpr uint32_t bar_minutes = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::minutes>(Bar{1}).count());
+
+	// Suffix of the Barchart CSV files and the archives of the resolution, e.g. "ES.M30.csv"
+	template<BarDuration Bar>
+	consteval const char* get_bar_name() {
+		if constexpr (std::same_as<Bar, H1>)
+			return "H1";
+		else if constexpr (std::same_as<Bar, M30>)
+			return "M30";
+		else if constexpr (std::same_as<Bar, M15>)
+			return "M15";
+		else if constexpr (std::same_as<Bar, M5>)
+			return "M5";
+		else if constexpr (std::same_as<Bar, H4>)
+			return "H4";
+		else
+			return "Session";
+	}
+
 	// Can't use std::chrono::hours in this case because several assets have session closes at 12:30 PM/1:30 PM
 	typedef std::chrono::hh_mm_ss<std::chrono::minutes> TimeOfDay;
 	typedef std::filesystem::path Path;
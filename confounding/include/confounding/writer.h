@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "confounding/exports.h"
+#include "confounding/archive.h"
+#include "confounding/encoding.h"
+#include "confounding/format.h"
+
+namespace confounding {
+	struct CONFOUNDING_API ColumnStatistics {
+		std::string name;
+		ColumnEncoding encoding;
+		std::size_t size;
+		double max_error;
+	};
+
+	template<BarDuration Bar>
+	class CONFOUNDING_API ArchiveWriterT {
+	public:
+		// Columns that lack an entry in the column encodings are stored without any loss of precision
+		ArchiveWriterT(const ArchiveT<Bar>& archive, const ArchiveOptions& options);
+
+		const std::vector<char>& encode();
+		std::vector<ColumnStatistics> write(const std::string& path);
+		// Transfers ownership of the encoded archive, e.g. to an AsyncFileWriter
+		std::vector<char> release();
+		std::vector<ColumnStatistics> get_statistics() const;
+
+	private:
+		const ArchiveT<Bar>& _archive;
+		const ArchiveOptions& _options;
+		std::vector<ColumnHeader> _columns;
+		std::vector<std::vector<char>> _column_data;
+		std::vector<ArchiveBlock> _blocks;
+		int64_t _day_index_start;
+		std::vector<char> _buffer;
+
+		void encode_daily_records();
+		void encode_intraday_records();
+		void encode_invalid_runs();
+		void encode_day_index();
+		void add_column(
+			const std::string& name,
+			ColumnType type,
+			ColumnEncoding encoding,
+			std::size_t count,
+			std::vector<char>&& data,
+			double max_error,
+			uint8_t flags
+		);
+		ColumnEncoding get_encoding(const std::string& name, ColumnType type) const;
+		void compress_blocks();
+		std::vector<char> compress_column(const ColumnHeader& column, const std::vector<char>& data) const;
+		void serialize();
+	};
+
+	typedef ArchiveWriterT<H1> ArchiveWriter;
+
+	// Instantiated in writer.cpp for each resolution
+	extern template class ArchiveWriterT<H1>;
+	extern template class ArchiveWriterT<M30>;
+	extern template class ArchiveWriterT<M15>;
+	extern template class ArchiveWriterT<M5>;
+	extern template class ArchiveWriterT<H4>;
+	extern template class ArchiveWriterT<Session>;
+}
\ No newline at end of file
@@ -1,8 +1,178 @@
-#include "archive.h"
+#include "confounding/archive.h"
+#include "confounding/exception.h"
 
 namespace confounding {
-	DailyRecord::DailyRecord(Date date, Money close)
-		: date(date),
-		close(close) {
+	template<BarDuration Bar>
+	DenseIntradayIteratorT<Bar>::DenseIntradayIteratorT()
+		: _archive(nullptr),
+		_record_index(0),
+		_run_index(0),
+		_run_offset(0) {
 	}
+
+	template<BarDuration Bar>
+	DenseIntradayIteratorT<Bar>::DenseIntradayIteratorT(const ArchiveT<Bar>* archive, std::size_t record_index, std::size_t run_index)
+		: _archive(archive),
+		_record_index(record_index),
+		_run_index(run_index),
+		_run_offset(0) {
+	}
+
+	template<BarDuration Bar>
+	DenseIntradayRecordT<Bar> DenseIntradayIteratorT<Bar>::operator*() const {
+		if (in_run()) {
+			const auto& run = _archive->invalid_runs[_run_index];
+			DenseIntradayRecordT<Bar> record{
+				.time = run.start + Bar{_run_offset},
+				.record = &nan_intraday_record
+			};
+			return record;
+		} else {
+			DenseIntradayRecordT<Bar> record{
+				.time = _archive->intraday_timestamps[_record_index],
+				.record = &_archive->intraday_records[_record_index]
+			};
+			return record;
+		}
+	}
+
+	template<BarDuration Bar>
+	DenseIntradayIteratorT<Bar>& DenseIntradayIteratorT<Bar>::operator++() {
+		if (in_run()) {
+			_run_offset++;
+			if (_run_offset == _archive->invalid_runs[_run_index].length) {
+				_run_index++;
+				_run_offset = 0;
+			}
+		} else {
+			_record_index++;
+		}
+		return *this;
+	}
+
+	template<BarDuration Bar>
+	DenseIntradayIteratorT<Bar> DenseIntradayIteratorT<Bar>::operator++(int) {
+		DenseIntradayIteratorT output = *this;
+		++*this;
+		return output;
+	}
+
+	template<BarDuration Bar>
+	bool DenseIntradayIteratorT<Bar>::operator==(const DenseIntradayIteratorT& other) const {
+		return
+			_archive == other._archive &&
+			_record_index == other._record_index &&
+			_run_index == other._run_index &&
+			_run_offset == other._run_offset;
+	}
+
+	template<BarDuration Bar>
+	bool DenseIntradayIteratorT<Bar>::in_run() const {
+		const auto& runs = _archive->invalid_runs;
+		if (_run_index >= runs.size())
+			return false;
+		if (_record_index >= _archive->intraday_timestamps.size())
+			return true;
+		return runs[_run_index].start < _archive->intraday_timestamps[_record_index];
+	}
+
+	template<BarDuration Bar>
+	bool ArchiveChunkT<Bar>::empty() const {
+		return
+			!daily_record &&
+			intraday_timestamps.empty() &&
+			invalid_runs.empty();
+	}
+
+	template<BarDuration Bar>
+	void ArchiveChunkT<Bar>::clear() {
+		daily_record.reset();
+		intraday_timestamps.clear();
+		intraday_records.clear();
+		extra_values.clear();
+		invalid_runs.clear();
+	}
+
+	template<BarDuration Bar>
+	void ArchiveT<Bar>::append(const ArchiveChunkT<Bar>& chunk) {
+		if (chunk.intraday_timestamps.size() != chunk.intraday_records.size()) {
+			throw Exception(
+				"Number of intraday timestamps ({}) doesn't match number of intraday records ({})",
+				chunk.intraday_timestamps.size(),
+				chunk.intraday_records.size()
+			);
+		}
+		if (chunk.extra_values.size() != chunk.intraday_records.size() * extra_columns.size()) {
+			throw Exception(
+				"Number of extra values ({}) doesn't match number of intraday records ({}) and extra columns ({})",
+				chunk.extra_values.size(),
+				chunk.intraday_records.size(),
+				extra_columns.size()
+			);
+		}
+		if (
+			!chunk.intraday_timestamps.empty() &&
+			!intraday_timestamps.empty() &&
+			chunk.intraday_timestamps.front() <= intraday_timestamps.back()
+		) {
+			throw Exception("Archive chunks of symbol {} are not in chronological order", symbol);
+		}
+		if (chunk.daily_record)
+			daily_records.push_back(*chunk.daily_record);
+		intraday_timestamps.insert(intraday_timestamps.end(), chunk.intraday_timestamps.begin(), chunk.intraday_timestamps.end());
+		intraday_records.insert(intraday_records.end(), chunk.intraday_records.begin(), chunk.intraday_records.end());
+		extra_values.insert(extra_values.end(), chunk.extra_values.begin(), chunk.extra_values.end());
+		for (const auto& run : chunk.invalid_runs) {
+			if (!invalid_runs.empty()) {
+				auto& last_run = invalid_runs.back();
+				if (last_run.start + Bar{last_run.length} == run.start) {
+					last_run.length += run.length;
+					continue;
+				}
+			}
+			invalid_runs.push_back(run);
+		}
+	}
+
+	template<BarDuration Bar>
+	DenseIntradayIteratorT<Bar> ArchiveT<Bar>::dense_begin() const {
+		return DenseIntradayIteratorT<Bar>(this, 0, 0);
+	}
+
+	template<BarDuration Bar>
+	DenseIntradayIteratorT<Bar> ArchiveT<Bar>::dense_end() const {
+		return DenseIntradayIteratorT<Bar>(this, intraday_records.size(), invalid_runs.size());
+	}
+
+	template<BarDuration Bar>
+	std::size_t ArchiveT<Bar>::get_dense_size() const {
+		std::size_t size = intraday_records.size();
+		for (const auto& run : invalid_runs)
+			size += run.length;
+		return size;
+	}
+
+	template<BarDuration Bar>
+	int32_t ArchiveT<Bar>::get_extra_value(std::size_t record_index, std::size_t column_index) const {
+		return extra_values[record_index * extra_columns.size() + column_index];
+	}
+
+	template class DenseIntradayIteratorT<H1>;
+	template class DenseIntradayIteratorT<M30>;
+	template class DenseIntradayIteratorT<M15>;
+	template class DenseIntradayIteratorT<M5>;
+	template class DenseIntradayIteratorT<H4>;
+	template class DenseIntradayIteratorT<Session>;
+	template struct ArchiveChunkT<H1>;
+	template struct ArchiveChunkT<M30>;
+	template struct ArchiveChunkT<M15>;
+	template struct ArchiveChunkT<M5>;
+	template struct ArchiveChunkT<H4>;
+	template struct ArchiveChunkT<Session>;
+	template struct ArchiveT<H1>;
+	template struct ArchiveT<M30>;
+	template struct ArchiveT<M15>;
+	template struct ArchiveT<M5>;
+	template struct ArchiveT<H4>;
+	template struct ArchiveT<Session>;
 }
\ No newline at end of file
@@ -29,10 +29,12 @@ namespace confounding {
 			std::string fractional_string = match[3];
 			if (fractional_string.size() > money_precision)
 				throw Exception("Fractional part of money string too long: {}", amount_string);
-			int64_t fractional_part = get_number<int64_t>(fractional_string);
+			int64_t fractional_part = fractional_string.empty() ? 0 : get_number<int64_t>(fractional_string);
 			int delta = money_precision - static_cast<int>(fractional_string.size());
 			int64_t fractional_factor = get_base_10_factor(delta);
-			_amount = integer_factor * integer_part + fractional_factor + fractional_part;
+			_amount = integer_factor * integer_part + fractional_factor * fractional_part;
+			if (amount_string.starts_with('-'))
+				_amount = -_amount;
 		} else {
 			throw Exception("Unable to parse money string: {}", amount_string);
 		}
@@ -43,7 +45,7 @@ namespace confounding {
 	}
 
 	double Money::to_double() const {
-		return static_cast<double>(_amount) * std::pow(1.0, -money_precision);
+		return static_cast<double>(_amount) * std::pow(10.0, -money_precision);
 	}
 
 	int32_t Money::operator-(Money other) const {
@@ -98,6 +100,15 @@ namespace confounding {
 		return output;
 	}
 
+	MinuteTime get_minute_time(const std::string& string) {
+		std::istringstream stream(string);
+		MinuteTime time;
+		stream >> std::chrono::parse("%F %R", time);
+		if (stream.fail())
+			throw Exception("Failed to parse time: {}", string);
+		return time;
+	}
+
 	TimeOfDay get_time_of_day(const std::string& string) {
 		static std::regex pattern(R"(^(\d{2}):(\d{2})$)");
 		std::smatch match;
@@ -129,8 +140,13 @@ namespace confounding {
 	}
 
 	std::string get_time_string(Time time) {
-		Date date = get_date(time);
-		TimeOfDay time_of_day = get_time_of_day(time);
+		return get_time_string(MinuteTime{time});
+	}
+
+	std::string get_time_string(MinuteTime time) {
+		std::chrono::local_days local_days = std::chrono::floor<std::chrono::days>(time);
+		Date date = Date{local_days};
+		TimeOfDay time_of_day{time - local_days};
 		std::string output = std::format(
 			"{:04}-{:02}-{:02} {:02}:{:02}",
 			static_cast<int>(date.year()),
@@ -142,6 +158,40 @@ namespace confounding {
 		return output;
 	}
 
+	BarResolution get_bar_resolution(const std::string& string) {
+		if (string == get_bar_name<H1>())
+			return BarResolution::h1;
+		else if (string == get_bar_name<M30>())
+			return BarResolution::m30;
+		else if (string == get_bar_name<M15>())
+			return BarResolution::m15;
+		else if (string == get_bar_name<M5>())
+			return BarResolution::m5;
+		else if (string == get_bar_name<H4>())
+			return BarResolution::h4;
+		else if (string == get_bar_name<Session>())
+			return BarResolution::session;
+		throw Exception("Invalid bar resolution: {}", string);
+	}
+
+	std::string get_bar_resolution_string(BarResolution resolution) {
+		switch (resolution) {
+			case BarResolution::h1:
+				return get_bar_name<H1>();
+			case BarResolution::m30:
+				return get_bar_name<M30>();
+			case BarResolution::m15:
+				return get_bar_name<M15>();
+			case BarResolution::m5:
+				return get_bar_name<M5>();
+			case BarResolution::h4:
+				return get_bar_name<H4>();
+			case BarResolution::session:
+				return get_bar_name<Session>();
+		}
+		throw Exception("Invalid bar resolution: {}", static_cast<int>(resolution));
+	}
+
 	double get_rate_of_change(double a, double b) {
 		if (a < 0 || b <= 0)
 			throw Exception("Invalid parameters for get_rate_of_change");
@@ -0,0 +1,286 @@
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <bit>
+
+#include <zlib.h>
+
+#include "confounding/compression.h"
+#include "confounding/exception.h"
+#include "confounding/constants.h"
+
+namespace confounding {
+	namespace {
+		constexpr unsigned max_bit_width = 56;
+
+		uint64_t get_mask(unsigned width) {
+			return width == 0 ? 0 : (~0ull >> (64 - width));
+		}
+
+		template<typename T>
+		void append(std::vector<char>& output, T value) {
+			const char* pointer = reinterpret_cast<const char*>(&value);
+			output.insert(output.end(), pointer, pointer + sizeof(T));
+		}
+
+		class BitWriter {
+		public:
+			BitWriter(std::vector<char>& output)
+				: _output(output),
+				_buffer(0),
+				_bits(0) {
+			}
+
+			void write(uint64_t value, unsigned width) {
+				_buffer |= (value & get_mask(width)) << _bits;
+				_bits += width;
+				while (_bits >= 8) {
+					_output.push_back(static_cast<char>(_buffer & 0xff));
+					_buffer >>= 8;
+					_bits -= 8;
+				}
+			}
+
+			void flush() {
+				if (_bits > 0)
+					_output.push_back(static_cast<char>(_buffer & 0xff));
+				_buffer = 0;
+				_bits = 0;
+			}
+
+		private:
+			std::vector<char>& _output;
+			uint64_t _buffer;
+			unsigned _bits;
+		};
+
+		class BitReader {
+		public:
+			BitReader(const char* data, std::size_t size)
+				: _data(data),
+				_size(size),
+				_position(0),
+				_buffer(0),
+				_bits(0) {
+			}
+
+			template<typename T>
+			T read_value() {
+				if (_position + sizeof(T) > _size)
+					throw Exception("Unexpected end of compressed block");
+				T value;
+				std::memcpy(&value, _data + _position, sizeof(T));
+				_position += sizeof(T);
+				return value;
+			}
+
+			uint64_t read(unsigned width) {
+				while (_bits < width) {
+					if (_position >= _size)
+						throw Exception("Unexpected end of bit-packed data");
+					_buffer |= static_cast<uint64_t>(static_cast<uint8_t>(_data[_position])) << _bits;
+					_position++;
+					_bits += 8;
+				}
+				uint64_t value = _buffer & get_mask(width);
+				_buffer >>= width;
+				_bits -= width;
+				return value;
+			}
+
+		private:
+			const char* _data;
+			std::size_t _size;
+			std::size_t _position;
+			uint64_t _buffer;
+			unsigned _bits;
+		};
+
+		unsigned get_bit_width(uint64_t range) {
+			unsigned width = static_cast<unsigned>(std::bit_width(range));
+			if (width > max_bit_width)
+				throw Exception("Range of values is too large for bit-packing: {}", range);
+			return width;
+		}
+
+		void pack_timestamps(const char* data, std::size_t count, std::vector<char>& output) {
+			std::vector<int64_t> timestamps(count);
+			std::memcpy(timestamps.data(), data, count * sizeof(int64_t));
+			int64_t first = count > 0 ? timestamps[0] : 0;
+			int64_t reference = std::numeric_limits<int64_t>::max();
+			int64_t maximum = std::numeric_limits<int64_t>::min();
+			for (std::size_t i = 1; i < count; i++) {
+				int64_t delta = timestamps[i] - timestamps[i - 1];
+				reference = std::min(reference, delta);
+				maximum = std::max(maximum, delta);
+			}
+			if (count < 2) {
+				reference = 0;
+				maximum = 0;
+			}
+			unsigned width = get_bit_width(static_cast<uint64_t>(maximum - reference));
+			append(output, first);
+			append(output, reference);
+			append(output, static_cast<uint8_t>(width));
+			BitWriter writer(output);
+			for (std::size_t i = 1; i < count; i++) {
+				int64_t delta = timestamps[i] - timestamps[i - 1];
+				writer.write(static_cast<uint64_t>(delta - reference), width);
+			}
+			writer.flush();
+		}
+
+		void unpack_timestamps(const char* payload, std::size_t payload_size, std::size_t count, char* output) {
+			BitReader reader(payload, payload_size);
+			int64_t value = reader.read_value<int64_t>();
+			int64_t reference = reader.read_value<int64_t>();
+			unsigned width = reader.read_value<uint8_t>();
+			if (width > max_bit_width)
+				throw Exception("Invalid bit width in compressed timestamps: {}", width);
+			auto timestamps = reinterpret_cast<int64_t*>(output);
+			for (std::size_t i = 0; i < count; i++) {
+				if (i > 0)
+					value += reference + static_cast<int64_t>(reader.read(width));
+				std::memcpy(timestamps + i, &value, sizeof(value));
+			}
+		}
+
+		void pack_returns(const char* data, std::size_t count, std::vector<char>& output) {
+			std::vector<int32_t> returns(count);
+			std::memcpy(returns.data(), data, count * sizeof(int32_t));
+			int64_t reference = 0;
+			int64_t maximum = 0;
+			bool first = true;
+			for (int32_t value : returns) {
+				if (value == intraday_invalid_returns)
+					continue;
+				if (first) {
+					reference = value;
+					maximum = value;
+					first = false;
+				}
+				reference = std::min<int64_t>(reference, value);
+				maximum = std::max<int64_t>(maximum, value);
+			}
+			// The all-ones code of the chosen width is always greater than maximum - reference and represents invalid returns
+			unsigned width = get_bit_width(static_cast<uint64_t>(maximum - reference + 1));
+			uint64_t invalid_code = get_mask(width);
+			append(output, static_cast<int32_t>(reference));
+			append(output, static_cast<uint8_t>(width));
+			BitWriter writer(output);
+			for (int32_t value : returns) {
+				uint64_t code = value == intraday_invalid_returns ? invalid_code : static_cast<uint64_t>(value - reference);
+				writer.write(code, width);
+			}
+			writer.flush();
+		}
+
+		void unpack_returns(const char* payload, std::size_t payload_size, std::size_t count, char* output) {
+			BitReader reader(payload, payload_size);
+			int64_t reference = reader.read_value<int32_t>();
+			unsigned width = reader.read_value<uint8_t>();
+			if (width == 0 || width > max_bit_width)
+				throw Exception("Invalid bit width in compressed returns: {}", width);
+			uint64_t invalid_code = get_mask(width);
+			auto returns = reinterpret_cast<int32_t*>(output);
+			for (std::size_t i = 0; i < count; i++) {
+				uint64_t code = reader.read(width);
+				int32_t value = code == invalid_code ? intraday_invalid_returns : static_cast<int32_t>(reference + static_cast<int64_t>(code));
+				std::memcpy(returns + i, &value, sizeof(value));
+			}
+		}
+
+		void shuffle_bytes(const char* data, std::size_t count, std::size_t element_size, std::vector<char>& output) {
+			std::size_t offset = output.size();
+			output.resize(offset + count * element_size);
+			char* shuffled = output.data() + offset;
+			for (std::size_t i = 0; i < count; i++) {
+				for (std::size_t j = 0; j < element_size; j++)
+					shuffled[j * count + i] = data[i * element_size + j];
+			}
+		}
+
+		void unshuffle_bytes(const char* payload, std::size_t count, std::size_t element_size, char* output) {
+			for (std::size_t i = 0; i < count; i++) {
+				for (std::size_t j = 0; j < element_size; j++)
+					output[i * element_size + j] = payload[j * count + i];
+			}
+		}
+
+		bool is_timestamp_column(ColumnType type, ColumnEncoding encoding) {
+			return type == ColumnType::int64 && encoding == ColumnEncoding::raw;
+		}
+
+		bool is_returns_column(ColumnType type, ColumnEncoding encoding) {
+			return type == ColumnType::int32 && encoding == ColumnEncoding::raw;
+		}
+	}
+
+	std::vector<char> compress_block(
+		ColumnType type,
+		ColumnEncoding encoding,
+		const char* data,
+		std::size_t count,
+		int level
+	) {
+		std::vector<char> payload;
+		if (is_timestamp_column(type, encoding))
+			pack_timestamps(data, count, payload);
+		else if (is_returns_column(type, encoding))
+			pack_returns(data, count, payload);
+		else
+			shuffle_bytes(data, count, get_encoded_size(type, encoding), payload);
+		uLongf compressed_size = compressBound(static_cast<uLong>(payload.size()));
+		// Prefix the zlib stream with the size of the transformed payload so that it can be allocated upfront
+		std::vector<char> output(sizeof(uint32_t) + compressed_size);
+		uint32_t payload_size = static_cast<uint32_t>(payload.size());
+		std::memcpy(output.data(), &payload_size, sizeof(payload_size));
+		int result = compress2(
+			reinterpret_cast<Bytef*>(output.data() + sizeof(uint32_t)),
+			&compressed_size,
+			reinterpret_cast<const Bytef*>(payload.data()),
+			static_cast<uLong>(payload.size()),
+			level
+		);
+		if (result != Z_OK)
+			throw Exception("zlib failed to compress block ({})", result);
+		output.resize(sizeof(uint32_t) + compressed_size);
+		return output;
+	}
+
+	void decompress_block(
+		ColumnType type,
+		ColumnEncoding encoding,
+		const char* compressed_data,
+		std::size_t compressed_size,
+		std::size_t payload_size,
+		std::size_t count,
+		char* output
+	) {
+		if (compressed_size < sizeof(uint32_t))
+			throw Exception("Compressed block is too small");
+		uint32_t transformed_size;
+		std::memcpy(&transformed_size, compressed_data, sizeof(transformed_size));
+		std::vector<char> payload(transformed_size);
+		uLongf decompressed_size = transformed_size;
+		int result = uncompress(
+			reinterpret_cast<Bytef*>(payload.data()),
+			&decompressed_size,
+			reinterpret_cast<const Bytef*>(compressed_data + sizeof(uint32_t)),
+			static_cast<uLong>(compressed_size - sizeof(uint32_t))
+		);
+		if (result != Z_OK || decompressed_size != transformed_size)
+			throw Exception("zlib failed to decompress block ({})", result);
+		std::size_t element_size = get_encoded_size(type, encoding);
+		if (payload_size != count * element_size)
+			throw Exception("Invalid decoded size of compressed block: {}", payload_size);
+		if (is_timestamp_column(type, encoding))
+			unpack_timestamps(payload.data(), payload.size(), count, output);
+		else if (is_returns_column(type, encoding))
+			unpack_returns(payload.data(), payload.size(), count, output);
+		else if (payload.size() == payload_size)
+			unshuffle_bytes(payload.data(), count, element_size, output);
+		else
+			throw Exception("Invalid size of shuffled block: {}", payload.size());
+	}
+}
\ No newline at end of file
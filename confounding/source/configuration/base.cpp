@@ -1,4 +1,5 @@
 #include <mutex>
+#include <algorithm>
 
 #include "confounding/yaml.h"
 #include "confounding/configuration/base.h"
@@ -6,13 +7,30 @@
 
 namespace {
 	constexpr const char* configuration_file = "configuration.yaml";
+	constexpr unsigned default_archive_writer_threads = 2;
+	// Maximum size of the archives waiting to be written to disk, in MiB
+	constexpr std::size_t default_archive_writer_memory = 4096;
+	// Relative to the archive directory
+	constexpr const char* default_metrics_file = "metrics.json";
+	// Relative to the working directory
+	constexpr const char* default_service_socket_path = "confounding.sock";
+	constexpr unsigned default_max_holding_days = 3;
+	constexpr unsigned default_return_horizons[] = {20, 22, 24, 26, 28, 48, 72};
+	constexpr unsigned default_barrier_horizon = 72;
 
 	std::mutex mutex;
 }
 
 namespace confounding {
 	Configuration::Configuration()
-		: _initialized(false) {
+		: archive_writer_threads(default_archive_writer_threads),
+		archive_writer_memory(default_archive_writer_memory),
+		trace_counters(false),
+		date_index(false),
+		bar_resolution(BarResolution::h1),
+		max_holding_days(default_max_holding_days),
+		barrier_horizon(default_barrier_horizon),
+		_initialized(false) {
 	}
 
 	const Configuration& Configuration::get() {
@@ -29,6 +47,80 @@ namespace confounding {
 		barchart_directory = doc["barchart_directory"].as<std::string>();
 		std::string reference_date_string = doc["reference_date"].as<std::string>();
 		reference_date = get_date(reference_date_string);
+		archive_directory = doc["archive_directory"].as<std::string>();
+		auto column_encodings_node = doc["column_encodings"];
+		if (column_encodings_node) {
+			for (const auto& entry : column_encodings_node) {
+				std::string column = entry.first.as<std::string>();
+				std::string encoding_string = entry.second.as<std::string>();
+				archive_options.column_encodings[column] = get_column_encoding(encoding_string);
+			}
+		}
+		archive_options.block_size = doc["archive_block_size"].as<std::optional<uint32_t>>();
+		auto compression_level = doc["archive_compression_level"].as<std::optional<int>>();
+		archive_options.compression_level = compression_level.value_or(default_compression_level);
+		auto writer_threads = doc["archive_writer_threads"].as<std::optional<unsigned>>();
+		archive_writer_threads = writer_threads.value_or(default_archive_writer_threads);
+		auto writer_memory = doc["archive_writer_memory"].as<std::optional<std::size_t>>();
+		archive_writer_memory = writer_memory.value_or(default_archive_writer_memory);
+		auto metrics_path_value = doc["metrics_path"].as<std::optional<std::string>>();
+		Path default_metrics_path = Path(archive_directory) / default_metrics_file;
+		metrics_path = metrics_path_value.value_or(default_metrics_path.string());
+		trace_path = doc["trace_path"].as<std::optional<std::string>>();
+		trace_counters = doc["trace_counters"].as<std::optional<bool>>().value_or(false);
+		date_index = doc["date_index"].as<std::optional<bool>>().value_or(false);
+		auto service_socket_path_value = doc["service_socket_path"].as<std::optional<std::string>>();
+		service_socket_path = service_socket_path_value.value_or(default_service_socket_path);
+		auto bar_resolution_string = doc["bar_resolution"].as<std::optional<std::string>>();
+		if (bar_resolution_string)
+			bar_resolution = get_bar_resolution(*bar_resolution_string);
+		if (bar_resolution == BarResolution::h4 || bar_resolution == BarResolution::session)
+			throw Exception("Bars with a resolution of {} can only be derived", *bar_resolution_string);
+		auto derived_bars_strings = doc["derived_bars"].as<std::optional<std::vector<std::string>>>();
+		for (const auto& string : derived_bars_strings.value_or(std::vector<std::string>())) {
+			BarResolution resolution = get_bar_resolution(string);
+			if (resolution != BarResolution::h4 && resolution != BarResolution::session)
+				throw Exception("Unable to derive bars with a resolution of {}", string);
+			if (std::ranges::find(derived_bars, resolution) != derived_bars.end())
+				throw Exception("Duplicate derived bars: {}", string);
+			derived_bars.push_back(resolution);
+		}
+		auto normalization_node = doc["normalization_windows"];
+		if (normalization_node) {
+			for (const auto& entry : normalization_node) {
+				std::string column = entry.first.as<std::string>();
+				unsigned days = entry.second.as<unsigned>();
+				if (days == 0)
+					throw Exception("Invalid normalization window for column {}", column);
+				normalization_windows[column] = std::chrono::days(days);
+			}
+		}
+		auto holding_days = doc["max_holding_days"].as<std::optional<unsigned>>();
+		max_holding_days = holding_days.value_or(default_max_holding_days);
+		std::chrono::hours max_horizon(max_holding_days * 24);
+		auto horizons = doc["return_horizons"].as<std::optional<std::vector<unsigned>>>();
+		for (unsigned hours : horizons.value_or(std::vector<unsigned>(std::begin(default_return_horizons), std::end(default_return_horizons)))) {
+			std::chrono::hours horizon(hours);
+			if (horizon.count() == 0 || horizon > max_horizon)
+				throw Exception("Invalid return horizon: {}", hours);
+			return_horizons.push_back(horizon);
+		}
+		auto barriers_node = doc["barriers"];
+		if (barriers_node) {
+			for (const auto& entry : barriers_node) {
+				Barrier barrier{
+					.take_profit = entry["take_profit"].as<unsigned>(),
+					.stop_loss = entry["stop_loss"].as<unsigned>(),
+				};
+				if (barrier.take_profit == 0 || barrier.stop_loss == 0)
+					throw Exception("Invalid barrier with take profit {} and stop loss {}", barrier.take_profit, barrier.stop_loss);
+				barriers.push_back(barrier);
+			}
+		}
+		auto horizon = doc["barrier_horizon"].as<std::optional<unsigned>>();
+		barrier_horizon = std::chrono::hours(horizon.value_or(default_barrier_horizon));
+		if (barrier_horizon.count() == 0 || barrier_horizon > max_horizon)
+			throw Exception("Invalid barrier horizon: {}", barrier_horizon.count());
 		_initialized = true;
 	}
 }
\ No newline at end of file
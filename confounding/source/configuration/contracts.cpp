@@ -66,6 +66,7 @@ namespace confounding {
 				.exchange_fee = get_money("exchange_fee"),
 				.spread = entry["spread"].as<unsigned>(),
 			};
+			_contracts.push_back(contract);
 		}
 		_initialized = true;
 	}
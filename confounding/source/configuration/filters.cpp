@@ -35,6 +35,14 @@ namespace confounding {
 		return *iterator;
 	}
 
+	std::vector<ContractFilter>::const_iterator ContractFilterConfiguration::begin() const {
+		return _filters.cbegin();
+	}
+
+	std::vector<ContractFilter>::const_iterator ContractFilterConfiguration::end() const {
+		return _filters.cend();
+	}
+
 	void ContractFilterConfiguration::load() {
 		using namespace YAML;
 		if (_initialized)
@@ -43,7 +51,8 @@ namespace confounding {
 		if (!doc.IsSequence())
 			throw Exception("The contract filter configuration file must consist of a sequence at the top level");
 		for (const auto& entry : doc) {
-			auto barchart_symbol = entry.as<std::string>();
+			// The symbol is the first key of the entry, followed by the settings
+			auto barchart_symbol = entry.begin()->first.as<std::string>();
 			auto exchange_symbol = entry["exchange_symbol"].as<std::optional<std::string>>();
 			if (!exchange_symbol)
 				exchange_symbol = barchart_symbol;
@@ -93,6 +102,7 @@ namespace confounding {
 			};
 			_filters.push_back(std::move(filter));
 		}
+		_initialized = true;
 	}
 
 	FilterMonths ContractFilterConfiguration::get_filter_months(const std::string& name, const YAML::Node& entry) {
@@ -0,0 +1,186 @@
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <execution>
+#include <format>
+#include <limits>
+
+#include "confounding/correlation.h"
+#include "confounding/exception.h"
+#include "confounding/output.h"
+
+namespace confounding {
+	namespace {
+		// Pairs are processed in blocks of symbols so that the returns of a date touched by a block stay in cache
+		constexpr std::size_t correlation_block_size = 8;
+		// Fraction of the window for which both symbols must have returns, holidays differ between exchanges
+		constexpr double min_window_coverage = 0.75;
+
+		// Running sums over the joint observations of a pair in the current window
+		struct CoMoments {
+			std::size_t n = 0;
+			double sum_x = 0.0;
+			double sum_y = 0.0;
+			double sum_xx = 0.0;
+			double sum_yy = 0.0;
+			double sum_xy = 0.0;
+
+			void add(double x, double y, double sign) {
+				n = sign > 0 ? n + 1 : n - 1;
+				sum_x += sign * x;
+				sum_y += sign * y;
+				sum_xx += sign * x * x;
+				sum_yy += sign * y * y;
+				sum_xy += sign * x * y;
+			}
+		};
+
+		struct BlockPair {
+			std::size_t first_i;
+			std::size_t first_j;
+		};
+	}
+
+	CorrelationEngine::CorrelationEngine(
+		const std::vector<std::string>& symbols,
+		const std::vector<Date>& dates,
+		std::vector<double>&& returns
+	)
+		: _symbols(symbols),
+		_dates(dates),
+		_returns(std::move(returns)) {
+		if (_returns.size() != _symbols.size() * _dates.size())
+			throw Exception("Invalid size of return matrix: {}", _returns.size());
+	}
+
+	CorrelationMatrices CorrelationEngine::compute(std::size_t window) const {
+		if (window < 2)
+			throw Exception("Invalid correlation window: {}", window);
+		std::size_t symbol_count = _symbols.size();
+		std::size_t matrix_size = _dates.size() * symbol_count * symbol_count;
+		CorrelationMatrices matrices{
+			.window = window,
+			.correlation = std::vector<float>(matrix_size, std::numeric_limits<float>::quiet_NaN()),
+			.beta = std::vector<float>(matrix_size, std::numeric_limits<float>::quiet_NaN()),
+		};
+		// Each pair only depends on its own history, so blocks of pairs run through all dates independently
+		std::vector<BlockPair> blocks;
+		for (std::size_t first_i = 0; first_i < symbol_count; first_i += correlation_block_size) {
+			for (std::size_t first_j = first_i; first_j < symbol_count; first_j += correlation_block_size) {
+				BlockPair block{
+					.first_i = first_i,
+					.first_j = first_j
+				};
+				blocks.push_back(block);
+			}
+		}
+		std::for_each(
+			std::execution::par,
+			blocks.begin(),
+			blocks.end(),
+			[&](const BlockPair& block) {
+				compute_block(block.first_i, block.first_j, matrices);
+			}
+		);
+		return matrices;
+	}
+
+	void CorrelationEngine::compute_block(std::size_t first_i, std::size_t first_j, CorrelationMatrices& matrices) const {
+		std::size_t symbol_count = _symbols.size();
+		std::size_t last_i = std::min(first_i + correlation_block_size, symbol_count);
+		std::size_t last_j = std::min(first_j + correlation_block_size, symbol_count);
+		std::size_t window = matrices.window;
+		auto min_observations = static_cast<std::size_t>(std::ceil(min_window_coverage * window));
+		CoMoments moments[correlation_block_size][correlation_block_size];
+		auto update = [&](std::size_t date_index, double sign) {
+			const double* returns = _returns.data() + date_index * symbol_count;
+			for (std::size_t i = first_i; i < last_i; i++) {
+				double x = returns[i];
+				if (std::isnan(x))
+					continue;
+				for (std::size_t j = std::max(i, first_j); j < last_j; j++) {
+					double y = returns[j];
+					if (!std::isnan(y))
+						moments[i - first_i][j - first_j].add(x, y, sign);
+				}
+			}
+		};
+		for (std::size_t t = 0; t < _dates.size(); t++) {
+			update(t, 1.0);
+			if (t >= window)
+				update(t - window, -1.0);
+			std::size_t matrix_offset = t * symbol_count * symbol_count;
+			for (std::size_t i = first_i; i < last_i; i++) {
+				for (std::size_t j = std::max(i, first_j); j < last_j; j++) {
+					const auto& m = moments[i - first_i][j - first_j];
+					if (m.n < min_observations)
+						continue;
+					double n = static_cast<double>(m.n);
+					double covariance = m.sum_xy - m.sum_x * m.sum_y / n;
+					double variance_x = m.sum_xx - m.sum_x * m.sum_x / n;
+					double variance_y = m.sum_yy - m.sum_y * m.sum_y / n;
+					if (variance_x <= 0.0 || variance_y <= 0.0)
+						continue;
+					double correlation = covariance / std::sqrt(variance_x * variance_y);
+					std::size_t ij = matrix_offset + i * symbol_count + j;
+					std::size_t ji = matrix_offset + j * symbol_count + i;
+					matrices.correlation[ij] = static_cast<float>(correlation);
+					matrices.correlation[ji] = static_cast<float>(correlation);
+					matrices.beta[ij] = static_cast<float>(covariance / variance_y);
+					matrices.beta[ji] = static_cast<float>(covariance / variance_x);
+				}
+			}
+		}
+	}
+
+	void CorrelationEngine::write(const std::string& path, const std::vector<CorrelationMatrices>& matrices) const {
+		std::vector<ColumnHeader> columns;
+		std::vector<const char*> column_data;
+		auto add_column = [&](const std::string& name, ColumnType type, std::size_t count, const void* data) {
+			ColumnHeader column;
+			std::memset(&column, 0, sizeof(column));
+			copy_string(column.name, name);
+			column.type = type;
+			column.encoding = ColumnEncoding::raw;
+			column.count = count;
+			column.size = count * get_type_size(type);
+			columns.push_back(column);
+			column_data.push_back(static_cast<const char*>(data));
+		};
+		std::vector<int32_t> dates;
+		for (Date date : _dates)
+			dates.push_back(static_cast<int32_t>(std::chrono::sys_days{date}.time_since_epoch().count()));
+		add_column(correlation_date_column, ColumnType::int32, dates.size(), dates.data());
+		for (const auto& window_matrices : matrices) {
+			std::size_t count = window_matrices.correlation.size();
+			add_column(std::format("correlation_{}d", window_matrices.window), ColumnType::float32, count, window_matrices.correlation.data());
+			add_column(std::format("beta_{}d", window_matrices.window), ColumnType::float32, count, window_matrices.beta.data());
+		}
+		CorrelationHeader header;
+		std::memset(&header, 0, sizeof(header));
+		header.magic = correlation_magic;
+		header.version = correlation_version;
+		header.symbol_count = static_cast<uint32_t>(_symbols.size());
+		header.column_count = static_cast<uint32_t>(columns.size());
+		header.date_count = _dates.size();
+		std::size_t symbols_offset = sizeof(CorrelationHeader);
+		std::size_t columns_offset = symbols_offset + _symbols.size() * archive_symbol_size;
+		std::size_t offset = columns_offset + columns.size() * sizeof(ColumnHeader);
+		for (auto& column : columns) {
+			offset = get_aligned_offset(offset);
+			column.offset = offset;
+			offset += column.size;
+		}
+		std::vector<char> buffer(offset, 0);
+		std::memcpy(buffer.data(), &header, sizeof(header));
+		for (std::size_t i = 0; i < _symbols.size(); i++) {
+			char symbol[archive_symbol_size];
+			copy_string(symbol, _symbols[i]);
+			std::memcpy(buffer.data() + symbols_offset + i * archive_symbol_size, symbol, archive_symbol_size);
+		}
+		std::memcpy(buffer.data() + columns_offset, columns.data(), columns.size() * sizeof(ColumnHeader));
+		for (std::size_t i = 0; i < columns.size(); i++)
+			std::memcpy(buffer.data() + columns[i].offset, column_data[i], columns[i].size);
+		write_file(path, buffer.data(), buffer.size());
+	}
+}
\ No newline at end of file
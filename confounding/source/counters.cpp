@@ -0,0 +1,82 @@
+#ifdef __linux__
+#include <cstring>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "confounding/counters.h"
+
+namespace confounding {
+#ifdef __linux__
+	namespace {
+		constexpr uint64_t counter_configs[hardware_counter_count] = {
+			PERF_COUNT_HW_CPU_CYCLES,
+			PERF_COUNT_HW_INSTRUCTIONS,
+			PERF_COUNT_HW_CACHE_MISSES,
+			PERF_COUNT_HW_BRANCH_MISSES,
+		};
+
+		int open_counter(uint64_t config, int group_file) {
+			perf_event_attr attributes;
+			std::memset(&attributes, 0, sizeof(attributes));
+			attributes.size = sizeof(attributes);
+			attributes.type = PERF_TYPE_HARDWARE;
+			attributes.config = config;
+			attributes.read_format = PERF_FORMAT_GROUP;
+			attributes.exclude_kernel = 1;
+			attributes.exclude_hv = 1;
+			// Only the calling thread, on any CPU
+			long file = syscall(SYS_perf_event_open, &attributes, 0, -1, group_file, PERF_FLAG_FD_CLOEXEC);
+			return static_cast<int>(file);
+		}
+	}
+
+	HardwareCounters::HardwareCounters() {
+		_files.fill(-1);
+		for (std::size_t i = 0; i < hardware_counter_count; i++) {
+			// All counters are scheduled together as one group so that their ratios are meaningful
+			int file = open_counter(counter_configs[i], i == 0 ? -1 : _files[0]);
+			if (file == -1) {
+				for (int& open_file : _files) {
+					if (open_file != -1)
+						::close(open_file);
+					open_file = -1;
+				}
+				return;
+			}
+			_files[i] = file;
+		}
+	}
+
+	HardwareCounters::~HardwareCounters() {
+		for (int file : _files) {
+			if (file != -1)
+				::close(file);
+		}
+	}
+
+	bool HardwareCounters::read(HardwareCounterValues& values) const {
+		if (_files[0] == -1)
+			return false;
+		// PERF_FORMAT_GROUP layout: number of counters followed by their values
+		uint64_t buffer[1 + hardware_counter_count];
+		ssize_t bytes_read = ::read(_files[0], buffer, sizeof(buffer));
+		if (bytes_read != sizeof(buffer) || buffer[0] != hardware_counter_count)
+			return false;
+		std::memcpy(values.data(), buffer + 1, sizeof(values));
+		return true;
+	}
+#else
+	HardwareCounters::HardwareCounters() {
+		_files.fill(-1);
+	}
+
+	HardwareCounters::~HardwareCounters() {
+	}
+
+	bool HardwareCounters::read(HardwareCounterValues& values) const {
+		return false;
+	}
+#endif
+}
\ No newline at end of file
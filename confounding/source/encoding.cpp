@@ -0,0 +1,340 @@
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+#include "confounding/encoding.h"
+#include "confounding/exception.h"
+#include "confounding/constants.h"
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define CONFOUNDING_SSE2
+#include <immintrin.h>
+#endif
+
+// MSVC doesn't define __F16C__, but all AVX2 targets support F16C
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define CONFOUNDING_F16C
+#endif
+
+namespace confounding {
+	namespace {
+		template<typename T>
+		void append(std::vector<char>& output, T value) {
+			const char* pointer = reinterpret_cast<const char*>(&value);
+			output.insert(output.end(), pointer, pointer + sizeof(T));
+		}
+
+		template<typename T>
+		double encode_quantized_returns(std::span<const int32_t> input, std::vector<char>& output) {
+			// The maximum value is reserved for intraday_invalid_returns
+			constexpr int32_t sentinel = std::numeric_limits<T>::max();
+			constexpr int32_t minimum = std::numeric_limits<T>::min();
+			constexpr int32_t maximum = sentinel - 1;
+			double max_error = 0.0;
+			output.reserve(output.size() + input.size() * sizeof(T));
+			for (int32_t returns : input) {
+				if (returns == intraday_invalid_returns) {
+					append(output, static_cast<T>(sentinel));
+					continue;
+				}
+				int32_t clamped = std::clamp(returns, minimum, maximum);
+				double error = std::abs(static_cast<double>(returns) - static_cast<double>(clamped));
+				max_error = std::max(max_error, error);
+				append(output, static_cast<T>(clamped));
+			}
+			return max_error;
+		}
+
+		template<typename T, typename Decode>
+		double encode_half_floats(std::span<const float> input, std::vector<char>& output, T encode(float), Decode decode) {
+			double max_error = 0.0;
+			output.reserve(output.size() + input.size() * sizeof(T));
+			for (float value : input) {
+				T encoded = encode(value);
+				float decoded = decode(encoded);
+				if (std::isnan(value) != std::isnan(decoded)) {
+					max_error = std::numeric_limits<double>::infinity();
+				} else if (!std::isnan(value)) {
+					double error = std::abs(static_cast<double>(value) - static_cast<double>(decoded));
+					max_error = std::max(max_error, error);
+				}
+				append(output, encoded);
+			}
+			return max_error;
+		}
+	}
+
+	ColumnEncoding get_column_encoding(const std::string& string) {
+		if (string == "raw")
+			return ColumnEncoding::raw;
+		else if (string == "float16")
+			return ColumnEncoding::float16;
+		else if (string == "bfloat16")
+			return ColumnEncoding::bfloat16;
+		else if (string == "int16")
+			return ColumnEncoding::int16;
+		else if (string == "int8")
+			return ColumnEncoding::int8;
+		throw Exception("Unknown column encoding: {}", string);
+	}
+
+	std::string get_encoding_string(ColumnEncoding encoding) {
+		switch (encoding) {
+		case ColumnEncoding::raw:
+			return "raw";
+		case ColumnEncoding::float16:
+			return "float16";
+		case ColumnEncoding::bfloat16:
+			return "bfloat16";
+		case ColumnEncoding::int16:
+			return "int16";
+		case ColumnEncoding::int8:
+			return "int8";
+		}
+		throw Exception("Invalid column encoding: {}", static_cast<int>(encoding));
+	}
+
+	std::size_t get_type_size(ColumnType type) {
+		switch (type) {
+		case ColumnType::float32:
+		case ColumnType::int32:
+			return 4;
+		case ColumnType::int64:
+			return 8;
+		}
+		throw Exception("Invalid column type: {}", static_cast<int>(type));
+	}
+
+	std::size_t get_encoded_size(ColumnType type, ColumnEncoding encoding) {
+		switch (encoding) {
+		case ColumnEncoding::raw:
+			return get_type_size(type);
+		case ColumnEncoding::float16:
+		case ColumnEncoding::bfloat16:
+		case ColumnEncoding::int16:
+			return 2;
+		case ColumnEncoding::int8:
+			return 1;
+		}
+		throw Exception("Invalid column encoding: {}", static_cast<int>(encoding));
+	}
+
+	bool is_valid_encoding(ColumnType type, ColumnEncoding encoding) {
+		switch (encoding) {
+		case ColumnEncoding::raw:
+			return true;
+		case ColumnEncoding::float16:
+		case ColumnEncoding::bfloat16:
+			return type == ColumnType::float32;
+		case ColumnEncoding::int16:
+		case ColumnEncoding::int8:
+			return type == ColumnType::int32;
+		}
+		return false;
+	}
+
+	uint16_t float_to_half(float value) {
+		uint32_t bits = std::bit_cast<uint32_t>(value);
+		uint32_t sign = (bits >> 16) & 0x8000;
+		uint32_t exponent = (bits >> 23) & 0xff;
+		uint32_t mantissa = bits & 0x7fffff;
+		if (exponent == 0xff) {
+			// Infinity or NaN, make sure that NaN payloads don't turn into infinity
+			uint32_t nan_bit = mantissa != 0 ? 0x200 : 0;
+			return static_cast<uint16_t>(sign | 0x7c00 | nan_bit | (mantissa >> 13));
+		}
+		int32_t half_exponent = static_cast<int32_t>(exponent) - 127 + 15;
+		if (half_exponent >= 0x1f)
+			return static_cast<uint16_t>(sign | 0x7c00);
+		if (half_exponent <= 0) {
+			// Subnormal or zero, round to nearest even
+			if (half_exponent < -10)
+				return static_cast<uint16_t>(sign);
+			mantissa |= 0x800000;
+			uint32_t shift = static_cast<uint32_t>(14 - half_exponent);
+			uint32_t half_mantissa = mantissa >> shift;
+			uint32_t remainder = mantissa & ((1u << shift) - 1);
+			uint32_t halfway = 1u << (shift - 1);
+			if (remainder > halfway || (remainder == halfway && (half_mantissa & 1)))
+				half_mantissa++;
+			return static_cast<uint16_t>(sign | half_mantissa);
+		}
+		uint32_t half = sign | (static_cast<uint32_t>(half_exponent) << 10) | (mantissa >> 13);
+		uint32_t remainder = mantissa & 0x1fff;
+		// A carry out of the mantissa correctly increments the exponent, up to infinity
+		if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+			half++;
+		return static_cast<uint16_t>(half);
+	}
+
+	float half_to_float(uint16_t value) {
+		uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+		uint32_t exponent = (value >> 10) & 0x1f;
+		uint32_t mantissa = value & 0x3ff;
+		uint32_t bits;
+		if (exponent == 0x1f) {
+			bits = sign | 0x7f800000 | (mantissa << 13);
+		} else if (exponent != 0) {
+			bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+		} else if (mantissa == 0) {
+			bits = sign;
+		} else {
+			// Normalize subnormal values
+			exponent = 113;
+			while ((mantissa & 0x400) == 0) {
+				mantissa <<= 1;
+				exponent--;
+			}
+			mantissa &= 0x3ff;
+			bits = sign | (exponent << 23) | (mantissa << 13);
+		}
+		return std::bit_cast<float>(bits);
+	}
+
+	uint16_t float_to_bfloat16(float value) {
+		uint32_t bits = std::bit_cast<uint32_t>(value);
+		if (std::isnan(value))
+			return static_cast<uint16_t>((bits >> 16) | 0x40);
+		uint32_t rounding = 0x7fff + ((bits >> 16) & 1);
+		return static_cast<uint16_t>((bits + rounding) >> 16);
+	}
+
+	float bfloat16_to_float(uint16_t value) {
+		uint32_t bits = static_cast<uint32_t>(value) << 16;
+		return std::bit_cast<float>(bits);
+	}
+
+	double encode_floats(std::span<const float> input, ColumnEncoding encoding, std::vector<char>& output) {
+		switch (encoding) {
+		case ColumnEncoding::raw: {
+			const char* pointer = reinterpret_cast<const char*>(input.data());
+			output.insert(output.end(), pointer, pointer + input.size_bytes());
+			return 0.0;
+		}
+		case ColumnEncoding::float16:
+			return encode_half_floats<uint16_t>(input, output, float_to_half, half_to_float);
+		case ColumnEncoding::bfloat16:
+			return encode_half_floats<uint16_t>(input, output, float_to_bfloat16, bfloat16_to_float);
+		default:
+			throw Exception("Encoding {} is not supported for float columns", get_encoding_string(encoding));
+		}
+	}
+
+	double encode_returns(std::span<const int32_t> input, ColumnEncoding encoding, std::vector<char>& output) {
+		switch (encoding) {
+		case ColumnEncoding::raw: {
+			const char* pointer = reinterpret_cast<const char*>(input.data());
+			output.insert(output.end(), pointer, pointer + input.size_bytes());
+			return 0.0;
+		}
+		case ColumnEncoding::int16:
+			return encode_quantized_returns<int16_t>(input, output);
+		case ColumnEncoding::int8:
+			return encode_quantized_returns<int8_t>(input, output);
+		default:
+			throw Exception("Encoding {} is not supported for returns", get_encoding_string(encoding));
+		}
+	}
+
+	void decode_floats(const void* input, ColumnEncoding encoding, std::span<float> output) {
+		std::size_t count = output.size();
+		float* destination = output.data();
+		std::size_t i = 0;
+		switch (encoding) {
+		case ColumnEncoding::raw:
+			std::memcpy(destination, input, count * sizeof(float));
+			break;
+		case ColumnEncoding::float16: {
+			auto source = static_cast<const uint16_t*>(input);
+#ifdef CONFOUNDING_F16C
+			for (; i + 8 <= count; i += 8) {
+				__m128i halves = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+				_mm256_storeu_ps(destination + i, _mm256_cvtph_ps(halves));
+			}
+#endif
+			for (; i < count; i++)
+				destination[i] = half_to_float(source[i]);
+			break;
+		}
+		case ColumnEncoding::bfloat16: {
+			auto source = static_cast<const uint16_t*>(input);
+#ifdef CONFOUNDING_SSE2
+			// Interleaving with zeroes shifts each bfloat16 into the upper half of a float
+			__m128i zero = _mm_setzero_si128();
+			for (; i + 8 <= count; i += 8) {
+				__m128i halves = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+				__m128i low = _mm_unpacklo_epi16(zero, halves);
+				__m128i high = _mm_unpackhi_epi16(zero, halves);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i), low);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i + 4), high);
+			}
+#endif
+			for (; i < count; i++)
+				destination[i] = bfloat16_to_float(source[i]);
+			break;
+		}
+		default:
+			throw Exception("Encoding {} is not supported for float columns", get_encoding_string(encoding));
+		}
+	}
+
+	void decode_returns(const void* input, ColumnEncoding encoding, std::span<int32_t> output) {
+		std::size_t count = output.size();
+		int32_t* destination = output.data();
+		std::size_t i = 0;
+#ifdef CONFOUNDING_SSE2
+		__m128i invalid = _mm_set1_epi32(intraday_invalid_returns);
+		auto store = [&](std::size_t offset, __m128i values, __m128i sentinel) {
+			__m128i mask = _mm_cmpeq_epi32(values, sentinel);
+			__m128i output_values = _mm_or_si128(_mm_and_si128(mask, invalid), _mm_andnot_si128(mask, values));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(destination + offset), output_values);
+		};
+#endif
+		switch (encoding) {
+		case ColumnEncoding::raw:
+			std::memcpy(destination, input, count * sizeof(int32_t));
+			break;
+		case ColumnEncoding::int16: {
+			auto source = static_cast<const int16_t*>(input);
+			constexpr int16_t sentinel = std::numeric_limits<int16_t>::max();
+#ifdef CONFOUNDING_SSE2
+			__m128i sentinel_vector = _mm_set1_epi32(sentinel);
+			for (; i + 8 <= count; i += 8) {
+				// Duplicate each 16-bit value and use an arithmetic shift to sign-extend it
+				__m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+				__m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(values, values), 16);
+				__m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(values, values), 16);
+				store(i, low, sentinel_vector);
+				store(i + 4, high, sentinel_vector);
+			}
+#endif
+			for (; i < count; i++)
+				destination[i] = source[i] == sentinel ? intraday_invalid_returns : source[i];
+			break;
+		}
+		case ColumnEncoding::int8: {
+			auto source = static_cast<const int8_t*>(input);
+			constexpr int8_t sentinel = std::numeric_limits<int8_t>::max();
+#ifdef CONFOUNDING_SSE2
+			__m128i sentinel_vector = _mm_set1_epi32(sentinel);
+			for (; i + 16 <= count; i += 16) {
+				__m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+				__m128i low = _mm_unpacklo_epi8(values, values);
+				__m128i high = _mm_unpackhi_epi8(values, values);
+				store(i, _mm_srai_epi32(_mm_unpacklo_epi16(low, low), 24), sentinel_vector);
+				store(i + 4, _mm_srai_epi32(_mm_unpackhi_epi16(low, low), 24), sentinel_vector);
+				store(i + 8, _mm_srai_epi32(_mm_unpacklo_epi16(high, high), 24), sentinel_vector);
+				store(i + 12, _mm_srai_epi32(_mm_unpackhi_epi16(high, high), 24), sentinel_vector);
+			}
+#endif
+			for (; i < count; i++)
+				destination[i] = source[i] == sentinel ? intraday_invalid_returns : source[i];
+			break;
+		}
+		default:
+			throw Exception("Encoding {} is not supported for returns", get_encoding_string(encoding));
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,67 @@
+#include <algorithm>
+#include <bit>
+
+#include "confounding/extrema.h"
+#include "confounding/exception.h"
+
+namespace confounding {
+	RangeExtrema::RangeExtrema()
+		: _size(0),
+		_levels(0) {
+	}
+
+	void RangeExtrema::build(std::span<const int64_t> values) {
+		_size = values.size();
+		_levels = _size == 0 ? 0 : static_cast<std::size_t>(std::bit_width(_size));
+		_min.resize(_levels * _size);
+		_max.resize(_levels * _size);
+		std::ranges::copy(values, _min.begin());
+		std::ranges::copy(values, _max.begin());
+		for (std::size_t k = 1; k < _levels; k++) {
+			std::size_t half = std::size_t{1} << (k - 1);
+			std::size_t offset = k * _size;
+			std::size_t previous_offset = (k - 1) * _size;
+			for (std::size_t i = 0; i + 2 * half <= _size; i++) {
+				_min[offset + i] = std::min(_min[previous_offset + i], _min[previous_offset + i + half]);
+				_max[offset + i] = std::max(_max[previous_offset + i], _max[previous_offset + i + half]);
+			}
+		}
+	}
+
+	int64_t RangeExtrema::get_min(std::size_t first, std::size_t last) const {
+		if (first >= last || last > _size)
+			throw Exception("Invalid range for minimum query: [{}, {})", first, last);
+		std::size_t k = static_cast<std::size_t>(std::bit_width(last - first)) - 1;
+		std::size_t offset = k * _size;
+		return std::min(_min[offset + first], _min[offset + last - (std::size_t{1} << k)]);
+	}
+
+	int64_t RangeExtrema::get_max(std::size_t first, std::size_t last) const {
+		if (first >= last || last > _size)
+			throw Exception("Invalid range for maximum query: [{}, {})", first, last);
+		std::size_t k = static_cast<std::size_t>(std::bit_width(last - first)) - 1;
+		std::size_t offset = k * _size;
+		return std::max(_max[offset + first], _max[offset + last - (std::size_t{1} << k)]);
+	}
+
+	std::size_t RangeExtrema::find_first_at_least(std::size_t first, std::size_t last, int64_t threshold) const {
+		// Skip the largest blocks that lie entirely below the threshold
+		std::size_t position = first;
+		for (std::size_t k = _levels; k-- > 0;) {
+			std::size_t length = std::size_t{1} << k;
+			if (position + length <= last && _max[k * _size + position] < threshold)
+				position += length;
+		}
+		return position;
+	}
+
+	std::size_t RangeExtrema::find_first_at_most(std::size_t first, std::size_t last, int64_t threshold) const {
+		std::size_t position = first;
+		for (std::size_t k = _levels; k-- > 0;) {
+			std::size_t length = std::size_t{1} << k;
+			if (position + length <= last && _min[k * _size + position] > threshold)
+				position += length;
+		}
+		return position;
+	}
+}
\ No newline at end of file
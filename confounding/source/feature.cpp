@@ -0,0 +1,22 @@
+#include <cmath>
+#include <ranges>
+
+#include "confounding/feature.h"
+
+namespace confounding {
+	double FeatureInputs::get_volatility(std::size_t n) const {
+		double mean_sum = 0.0;
+		auto returns_view = recent_returns | std::views::take(n);
+		for (double x : returns_view)
+			mean_sum += x;
+		double mean = mean_sum / n;
+		double delta_sum = 0.0;
+		for (double x : returns_view) {
+			double delta = x - mean;
+			delta_sum += delta * delta;
+		}
+		double standard_deviation = delta_sum / (n - 1);
+		double volatility = std::sqrt(static_cast<double>(n)) * standard_deviation;
+		return volatility;
+	}
+}
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include <regex>
 #include <format>
+#include <tuple>
 
 #include "confounding/globex.h"
 #include "confounding/exception.h"
@@ -41,10 +42,8 @@ namespace confounding {
 	}
 
 	bool GlobexCode::operator<(const GlobexCode& other) const {
-		return
-			root < other.root ||
-			year < other.year ||
-			month < other.month;
+		// Month codes are in chronological order alphabetically
+		return std::tie(root, year, month) < std::tie(other.root, other.year, other.month);
 	}
 
 	bool GlobexCode::operator>(const GlobexCode& other) const {
@@ -52,11 +51,11 @@ namespace confounding {
 	}
 
 	bool GlobexCode::operator<=(const GlobexCode& other) const {
-		return operator<(other) && operator==(other);
+		return operator<(other) || operator==(other);
 	}
 
 	bool GlobexCode::operator>=(const GlobexCode& other) const {
-		return operator>(other) && operator==(other);
+		return operator>(other) || operator==(other);
 	}
 
 	bool GlobexCode::is_globex_code(const std::string& symbol) const {
@@ -0,0 +1,114 @@
+#include <cstring>
+#include <algorithm>
+
+#include <zlib.h>
+
+#include "confounding/gzip.h"
+#include "confounding/exception.h"
+
+namespace confounding {
+	namespace {
+		constexpr std::size_t chunk_size = 1024 * 1024;
+		constexpr std::size_t max_queued_chunks = 8;
+		constexpr unsigned gzip_buffer_size = 256 * 1024;
+	}
+
+	GzipStream::GzipStream(const std::string& path, uint64_t skip_offset, uint64_t skip_size)
+		: _path(path),
+		_file(nullptr),
+		_skip_offset(skip_offset),
+		_skip_size(skip_size),
+		_current_offset(0),
+		_finished(false),
+		_stop(false) {
+		gzFile file = gzopen(path.c_str(), "rb");
+		if (file == nullptr)
+			throw Exception("Failed to open gzip file {}", path);
+		gzbuffer(file, gzip_buffer_size);
+		_file = file;
+		_thread = std::thread(&GzipStream::decompress, this);
+	}
+
+	GzipStream::~GzipStream() {
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stop = true;
+		}
+		_chunk_consumed.notify_all();
+		_thread.join();
+		gzclose(static_cast<gzFile>(_file));
+	}
+
+	int GzipStream::read(char* buffer, int size) {
+		if (_current_offset >= _current_chunk.size()) {
+			std::unique_lock<std::mutex> lock(_mutex);
+			_chunk_available.wait(lock, [&]() { return !_chunks.empty() || _finished; });
+			if (_chunks.empty()) {
+				if (_error)
+					std::rethrow_exception(_error);
+				return 0;
+			}
+			_current_chunk = std::move(_chunks.front());
+			_chunks.pop_front();
+			_current_offset = 0;
+			lock.unlock();
+			_chunk_consumed.notify_one();
+		}
+		std::size_t bytes = std::min(static_cast<std::size_t>(size), _current_chunk.size() - _current_offset);
+		std::memcpy(buffer, _current_chunk.data() + _current_offset, bytes);
+		_current_offset += bytes;
+		return static_cast<int>(bytes);
+	}
+
+	void GzipStream::decompress() {
+		auto file = static_cast<gzFile>(_file);
+		uint64_t position = 0;
+		auto read_chunk = [&](std::vector<char>& chunk, std::size_t size) {
+			chunk.resize(size);
+			int bytes = gzread(file, chunk.data(), static_cast<unsigned>(size));
+			if (bytes < 0) {
+				int error;
+				const char* message = gzerror(file, &error);
+				throw Exception("Failed to decompress {} ({})", _path, message);
+			}
+			chunk.resize(bytes);
+			position += bytes;
+		};
+		try {
+			while (true) {
+				std::vector<char> chunk;
+				if (_skip_size > 0 && position == _skip_offset) {
+					// gzseek would have to decompress the skipped data, too, and z_off_t is 32 bits wide on Windows
+					uint64_t skip_end = _skip_offset + _skip_size;
+					while (position < skip_end) {
+						read_chunk(chunk, static_cast<std::size_t>(std::min<uint64_t>(chunk_size, skip_end - position)));
+						if (chunk.empty())
+							break;
+					}
+					_skip_size = 0;
+				}
+				std::size_t read_size = chunk_size;
+				if (_skip_size > 0 && position < _skip_offset)
+					read_size = static_cast<std::size_t>(std::min<uint64_t>(chunk_size, _skip_offset - position));
+				read_chunk(chunk, read_size);
+				if (chunk.empty())
+					break;
+				std::unique_lock<std::mutex> lock(_mutex);
+				_chunk_consumed.wait(lock, [&]() { return _stop || _chunks.size() < max_queued_chunks; });
+				if (_stop)
+					return;
+				_chunks.push_back(std::move(chunk));
+				lock.unlock();
+				_chunk_available.notify_one();
+			}
+		} catch (...) {
+			std::lock_guard<std::mutex> lock(_mutex);
+			_error = std::current_exception();
+		}
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_finished = true;
+		}
+		_chunk_available.notify_one();
+	}
+}
\ No newline at end of file
@@ -0,0 +1,202 @@
+#include <cstring>
+#include <charconv>
+#include <filesystem>
+#include <algorithm>
+
+#include "confounding/index.h"
+#include "confounding/mapping.h"
+#include "confounding/output.h"
+#include "confounding/exception.h"
+
+namespace confounding {
+	namespace {
+		constexpr std::size_t date_string_size = 10;
+
+		std::optional<int32_t> parse_date(const std::string& string) {
+			// Only the YYYY-MM-DD prefix is relevant, the time of intraday records is ignored
+			const char* data = string.data();
+			std::size_t size = string.size();
+			if (size > 0 && data[0] == '"') {
+				data++;
+				size--;
+			}
+			if (size < date_string_size || data[4] != '-' || data[7] != '-')
+				return std::nullopt;
+			int year;
+			unsigned month;
+			unsigned day;
+			if (
+				std::from_chars(data, data + 4, year).ec != std::errc() ||
+				std::from_chars(data + 5, data + 7, month).ec != std::errc() ||
+				std::from_chars(data + 8, data + 10, day).ec != std::errc()
+			) {
+				return std::nullopt;
+			}
+			Date date{std::chrono::year{year}, std::chrono::month{month}, std::chrono::day{day}};
+			if (!date.ok())
+				return std::nullopt;
+			return static_cast<int32_t>(std::chrono::sys_days{date}.time_since_epoch().count());
+		}
+	}
+
+	FileFingerprint get_file_fingerprint(const std::string& path) {
+		std::error_code error;
+		auto size = std::filesystem::file_size(path, error);
+		if (error)
+			throw Exception("Failed to determine size of file {} ({})", path, error.message());
+		auto last_write_time = std::filesystem::last_write_time(path, error);
+		if (error)
+			throw Exception("Failed to determine modification time of file {} ({})", path, error.message());
+		FileFingerprint fingerprint{
+			.size = static_cast<uint64_t>(size),
+			.last_write_time = static_cast<int64_t>(last_write_time.time_since_epoch().count())
+		};
+		return fingerprint;
+	}
+
+	DateIndex::DateIndex(FileFingerprint fingerprint, uint64_t header_size, std::vector<DateIndexEntry>&& entries)
+		: _fingerprint(fingerprint),
+		_header_size(header_size),
+		_entries(std::move(entries)) {
+	}
+
+	std::optional<DateIndex> DateIndex::load(const std::string& csv_path) {
+		std::string path = get_path(csv_path);
+		if (!std::filesystem::exists(path))
+			return std::nullopt;
+		MappedFile file(path);
+		if (file.get_size() < sizeof(DateIndexHeader))
+			return std::nullopt;
+		DateIndexHeader header;
+		std::memcpy(&header, file.get_data(), sizeof(header));
+		if (
+			header.magic != date_index_magic ||
+			header.version != date_index_version ||
+			file.get_size() != sizeof(DateIndexHeader) + header.entry_count * sizeof(DateIndexEntry) ||
+			header.fingerprint != get_file_fingerprint(csv_path)
+		) {
+			return std::nullopt;
+		}
+		std::vector<DateIndexEntry> entries(header.entry_count);
+		std::memcpy(entries.data(), file.get_data() + sizeof(DateIndexHeader), entries.size() * sizeof(DateIndexEntry));
+		return DateIndex(header.fingerprint, header.header_size, std::move(entries));
+	}
+
+	std::string DateIndex::get_path(const std::string& csv_path) {
+		return csv_path + date_index_extension;
+	}
+
+	void DateIndex::save(const std::string& csv_path) const {
+		DateIndexHeader header;
+		std::memset(&header, 0, sizeof(header));
+		header.magic = date_index_magic;
+		header.version = date_index_version;
+		header.fingerprint = _fingerprint;
+		header.header_size = _header_size;
+		header.entry_count = static_cast<uint32_t>(_entries.size());
+		std::vector<char> buffer(sizeof(header) + _entries.size() * sizeof(DateIndexEntry));
+		std::memcpy(buffer.data(), &header, sizeof(header));
+		std::memcpy(buffer.data() + sizeof(header), _entries.data(), _entries.size() * sizeof(DateIndexEntry));
+		write_file(get_path(csv_path), buffer.data(), buffer.size());
+	}
+
+	uint64_t DateIndex::get_header_size() const {
+		return _header_size;
+	}
+
+	uint64_t DateIndex::get_offset(Date date) const {
+		auto days = static_cast<int32_t>(std::chrono::sys_days{date}.time_since_epoch().count());
+		// Find the last sample dated on or before the date
+		auto iterator = std::ranges::upper_bound(_entries, days, {}, &DateIndexEntry::date);
+		if (iterator == _entries.begin())
+			return _header_size;
+		iterator--;
+		return iterator->offset;
+	}
+
+	DateIndexBuilder::DateIndexBuilder(const std::string& date_column, uint64_t sample_interval)
+		: _date_column(date_column),
+		_sample_interval(sample_interval),
+		_offset(0),
+		_header_size(0),
+		_line_offset(0),
+		_column_index(0),
+		_line_processed(false),
+		_sorted(true) {
+	}
+
+	void DateIndexBuilder::update(const char* data, std::size_t size) {
+		for (std::size_t i = 0; i < size; i++) {
+			char c = data[i];
+			_offset++;
+			if (c == '\n') {
+				end_line();
+				_line_offset = _offset;
+				continue;
+			}
+			if (_line_processed || c == '\r')
+				continue;
+			if (c == ',') {
+				if (_date_column_index && _column_index == *_date_column_index)
+					process_date();
+				else if (!_date_column_index)
+					process_header();
+				_column_index++;
+				_field.clear();
+			} else if (!_date_column_index || _column_index == *_date_column_index) {
+				_field.push_back(c);
+			}
+		}
+	}
+
+	std::optional<DateIndex> DateIndexBuilder::finish(FileFingerprint fingerprint) {
+		end_line();
+		if (!_sorted || !_date_column_index)
+			return std::nullopt;
+		return DateIndex(fingerprint, _header_size, std::move(_entries));
+	}
+
+	void DateIndexBuilder::process_header() {
+		std::string name = _field;
+		if (name.size() >= 2 && name.front() == '"' && name.back() == '"')
+			name = name.substr(1, name.size() - 2);
+		if (name == _date_column)
+			_date_column_index = _column_index;
+	}
+
+	void DateIndexBuilder::process_date() {
+		_line_processed = true;
+		auto date = parse_date(_field);
+		if (!date) {
+			_sorted = false;
+			return;
+		}
+		if (_last_date && *date < *_last_date)
+			_sorted = false;
+		bool new_date = !_last_date || *date != *_last_date;
+		// Only sample rows at which the date changes so that all preceding rows are dated earlier
+		if (new_date && (_entries.empty() || _line_offset - _entries.back().offset >= _sample_interval)) {
+			DateIndexEntry entry{
+				.date = *date,
+				.reserved = 0,
+				.offset = _line_offset
+			};
+			_entries.push_back(entry);
+		}
+		_last_date = date;
+	}
+
+	void DateIndexBuilder::end_line() {
+		if (_line_offset == 0 && _header_size == 0) {
+			// First line
+			if (!_date_column_index)
+				process_header();
+			_header_size = _offset;
+		} else if (!_line_processed && _date_column_index && _column_index == *_date_column_index && !_field.empty()) {
+			process_date();
+		}
+		_column_index = 0;
+		_field.clear();
+		_line_processed = false;
+	}
+}
\ No newline at end of file
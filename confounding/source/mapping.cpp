@@ -0,0 +1,160 @@
+#include <cstring>
+#include <cerrno>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "confounding/mapping.h"
+#include "confounding/exception.h"
+
+namespace confounding {
+#ifdef _WIN32
+	MappedFile::MappedFile(const std::string& path)
+		: _data(nullptr),
+		_size(0),
+		_file(INVALID_HANDLE_VALUE),
+		_mapping(nullptr) {
+		_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (_file == INVALID_HANDLE_VALUE)
+			throw Exception("Failed to open file {} (error {})", path, GetLastError());
+		LARGE_INTEGER file_size;
+		if (!GetFileSizeEx(_file, &file_size)) {
+			close();
+			throw Exception("Failed to determine size of file {} (error {})", path, GetLastError());
+		}
+		_size = static_cast<std::size_t>(file_size.QuadPart);
+		if (_size == 0)
+			return;
+		_mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (_mapping == nullptr) {
+			close();
+			throw Exception("Failed to create file mapping for {} (error {})", path, GetLastError());
+		}
+		_data = static_cast<const char*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+		if (_data == nullptr) {
+			close();
+			throw Exception("Failed to map file {} (error {})", path, GetLastError());
+		}
+	}
+
+	MappedFile::MappedFile()
+		: _data(nullptr),
+		_size(0),
+		_file(INVALID_HANDLE_VALUE),
+		_mapping(nullptr) {
+	}
+
+	MappedFile::MappedFile(MappedFile&& other) noexcept
+		: _data(other._data),
+		_size(other._size),
+		_file(other._file),
+		_mapping(other._mapping) {
+		other._data = nullptr;
+		other._size = 0;
+		other._file = INVALID_HANDLE_VALUE;
+		other._mapping = nullptr;
+	}
+
+	MappedFile MappedFile::from_shared_memory(SharedMemoryHandle handle, std::size_t size) {
+		MappedFile file;
+		file._mapping = handle;
+		file._size = size;
+		if (size == 0)
+			return file;
+		file._data = static_cast<const char*>(MapViewOfFile(handle, FILE_MAP_READ, 0, 0, size));
+		if (file._data == nullptr)
+			throw Exception("Failed to map shared memory (error {})", GetLastError());
+		return file;
+	}
+
+	void MappedFile::close() {
+		if (_data != nullptr)
+			UnmapViewOfFile(_data);
+		if (_mapping != nullptr)
+			CloseHandle(_mapping);
+		if (_file != INVALID_HANDLE_VALUE)
+			CloseHandle(_file);
+		_data = nullptr;
+		_mapping = nullptr;
+		_file = INVALID_HANDLE_VALUE;
+	}
+#else
+	MappedFile::MappedFile(const std::string& path)
+		: _data(nullptr),
+		_size(0),
+		_file(-1) {
+		_file = ::open(path.c_str(), O_RDONLY);
+		if (_file == -1)
+			throw Exception("Failed to open file {} ({})", path, std::strerror(errno));
+		struct stat file_stat;
+		if (fstat(_file, &file_stat) != 0) {
+			close();
+			throw Exception("Failed to determine size of file {} ({})", path, std::strerror(errno));
+		}
+		_size = static_cast<std::size_t>(file_stat.st_size);
+		if (_size == 0)
+			return;
+		void* data = mmap(nullptr, _size, PROT_READ, MAP_SHARED, _file, 0);
+		if (data == MAP_FAILED) {
+			close();
+			throw Exception("Failed to map file {} ({})", path, std::strerror(errno));
+		}
+		_data = static_cast<const char*>(data);
+	}
+
+	MappedFile::MappedFile()
+		: _data(nullptr),
+		_size(0),
+		_file(-1) {
+	}
+
+	MappedFile::MappedFile(MappedFile&& other) noexcept
+		: _data(other._data),
+		_size(other._size),
+		_file(other._file) {
+		other._data = nullptr;
+		other._size = 0;
+		other._file = -1;
+	}
+
+	MappedFile MappedFile::from_shared_memory(SharedMemoryHandle handle, std::size_t size) {
+		MappedFile file;
+		file._file = handle;
+		file._size = size;
+		if (size == 0)
+			return file;
+		void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, handle, 0);
+		if (data == MAP_FAILED)
+			throw Exception("Failed to map shared memory ({})", std::strerror(errno));
+		file._data = static_cast<const char*>(data);
+		return file;
+	}
+
+	void MappedFile::close() {
+		if (_data != nullptr)
+			munmap(const_cast<char*>(_data), _size);
+		if (_file != -1)
+			::close(_file);
+		_data = nullptr;
+		_file = -1;
+	}
+#endif
+
+	MappedFile::~MappedFile() {
+		close();
+	}
+
+	const char* MappedFile::get_data() const {
+		return _data;
+	}
+
+	std::size_t MappedFile::get_size() const {
+		return _size;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,396 @@
+#include <cstdlib>
+#include <new>
+#include <map>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <tuple>
+#include <vector>
+#include <format>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <ctime>
+#include <sys/resource.h>
+#endif
+
+#include "confounding/metrics.h"
+#include "confounding/output.h"
+
+namespace confounding {
+	namespace {
+		struct StageSample {
+			PipelineStage stage;
+			MetricsKey key;
+			// Nanoseconds since trace_epoch
+			int64_t start;
+			int64_t wall_time;
+			int64_t cpu_time;
+			uint64_t rows;
+			uint64_t nan_records;
+			uint64_t bytes;
+			uint64_t allocations;
+			uint64_t allocated_bytes;
+			uint64_t peak_memory;
+			bool has_counters;
+			HardwareCounterValues counters;
+		};
+
+		struct StageTotals {
+			uint64_t calls = 0;
+			int64_t wall_time = 0;
+			int64_t cpu_time = 0;
+			uint64_t rows = 0;
+			uint64_t nan_records = 0;
+			uint64_t bytes = 0;
+			uint64_t allocations = 0;
+			uint64_t allocated_bytes = 0;
+			uint64_t peak_memory = 0;
+
+			void add(const StageSample& sample) {
+				calls++;
+				wall_time += sample.wall_time;
+				cpu_time += sample.cpu_time;
+				rows += sample.rows;
+				nan_records += sample.nan_records;
+				bytes += sample.bytes;
+				allocations += sample.allocations;
+				allocated_bytes += sample.allocated_bytes;
+				peak_memory = std::max(peak_memory, sample.peak_memory);
+			}
+		};
+
+		struct SampleBuffer {
+			// Track of the thread in the trace
+			uint32_t thread;
+			std::vector<StageSample> samples;
+		};
+
+		const auto trace_epoch = std::chrono::steady_clock::now();
+		std::atomic<bool> trace_counters = false;
+
+		// The buffers are never freed so that samples survive the threads of the pool that recorded them
+		std::mutex buffers_mutex;
+		std::vector<std::unique_ptr<SampleBuffer>> sample_buffers;
+		thread_local SampleBuffer* thread_buffer = nullptr;
+		thread_local uint64_t thread_allocations = 0;
+		thread_local uint64_t thread_allocated_bytes = 0;
+
+		SampleBuffer& get_thread_buffer() {
+			if (thread_buffer == nullptr) {
+				// Only happens once per thread
+				std::lock_guard<std::mutex> lock(buffers_mutex);
+				auto buffer = std::make_unique<SampleBuffer>();
+				buffer->thread = static_cast<uint32_t>(sample_buffers.size());
+				sample_buffers.push_back(std::move(buffer));
+				thread_buffer = sample_buffers.back().get();
+			}
+			return *thread_buffer;
+		}
+
+		// Only opened by threads that record spans while the counters are enabled
+		const HardwareCounters& get_thread_counters() {
+			thread_local HardwareCounters counters;
+			return counters;
+		}
+
+		int64_t get_thread_cpu_time() {
+#ifdef _WIN32
+			FILETIME creation_time;
+			FILETIME exit_time;
+			FILETIME kernel_time;
+			FILETIME user_time;
+			if (!GetThreadTimes(GetCurrentThread(), &creation_time, &exit_time, &kernel_time, &user_time))
+				return 0;
+			auto get_ticks = [](const FILETIME& time) {
+				return (static_cast<int64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+			};
+			// FILETIME uses 100 ns units
+			return (get_ticks(kernel_time) + get_ticks(user_time)) * 100;
+#else
+			timespec time;
+			if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0)
+				return 0;
+			return static_cast<int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+#endif
+		}
+
+		const char* get_stage_string(PipelineStage stage) {
+			switch (stage) {
+			case PipelineStage::read_daily_records:
+				return "read_daily_records";
+			case PipelineStage::read_intraday_records:
+				return "read_intraday_records";
+			case PipelineStage::generate:
+				return "generate";
+			case PipelineStage::encode:
+				return "encode";
+			case PipelineStage::output_wait:
+				return "output_wait";
+			case PipelineStage::output:
+				return "output";
+			case PipelineStage::build_panels:
+				return "build_panels";
+			case PipelineStage::build_correlations:
+				return "build_correlations";
+			}
+			return "unknown";
+		}
+
+		double get_seconds(int64_t nanoseconds) {
+			return static_cast<double>(nanoseconds) / 1e9;
+		}
+
+		// Chrome trace events use microseconds
+		double get_microseconds(int64_t nanoseconds) {
+			return static_cast<double>(nanoseconds) / 1e3;
+		}
+
+		// Symbols and series are plain identifiers from the YAML files, null is used for missing ones
+		std::string get_json_string(const std::string& string) {
+			if (string.empty())
+				return "null";
+			std::string output = "\"";
+			for (char c : string) {
+				if (c == '"' || c == '\\')
+					output += '\\';
+				output += c;
+			}
+			output += '"';
+			return output;
+		}
+
+		void append_totals(std::string& output, const StageTotals& totals) {
+			double wall_time = get_seconds(totals.wall_time);
+			double rows_per_second = wall_time > 0.0 ? static_cast<double>(totals.rows) / wall_time : 0.0;
+			output += std::format(
+				"\"calls\": {}, \"wall_time\": {}, \"cpu_time\": {}, \"rows\": {}, \"rows_per_second\": {:.0f}, "
+				"\"nan_records\": {}, \"bytes\": {}, \"allocations\": {}, \"allocated_bytes\": {}, \"peak_memory\": {}",
+				totals.calls,
+				wall_time,
+				get_seconds(totals.cpu_time),
+				totals.rows,
+				rows_per_second,
+				totals.nan_records,
+				totals.bytes,
+				totals.allocations,
+				totals.allocated_bytes,
+				totals.peak_memory
+			);
+		}
+	}
+
+	StageTimer::StageTimer(PipelineStage stage, const MetricsKey& key)
+		: _stage(stage),
+		_key(key),
+		_start(std::chrono::steady_clock::now()),
+		_cpu_start(get_thread_cpu_time()),
+		_allocations_start(thread_allocations),
+		_allocated_bytes_start(thread_allocated_bytes),
+		_rows(0),
+		_nan_records(0),
+		_bytes(0),
+		_has_counters(false) {
+		if (trace_counters.load(std::memory_order_relaxed))
+			_has_counters = get_thread_counters().read(_counters_start);
+	}
+
+	StageTimer::~StageTimer() {
+		// Read the counters first so that the allocations of the sample itself aren't included
+		HardwareCounterValues counters;
+		bool has_counters = _has_counters && get_thread_counters().read(counters);
+		auto wall_time = std::chrono::steady_clock::now() - _start;
+		int64_t cpu_time = get_thread_cpu_time() - _cpu_start;
+		uint64_t allocations = thread_allocations - _allocations_start;
+		uint64_t allocated_bytes = thread_allocated_bytes - _allocated_bytes_start;
+		StageSample sample{
+			.stage = _stage,
+			.key = std::move(_key),
+			.start = std::chrono::duration_cast<std::chrono::nanoseconds>(_start - trace_epoch).count(),
+			.wall_time = std::chrono::duration_cast<std::chrono::nanoseconds>(wall_time).count(),
+			.cpu_time = cpu_time,
+			.rows = _rows,
+			.nan_records = _nan_records,
+			.bytes = _bytes,
+			.allocations = allocations,
+			.allocated_bytes = allocated_bytes,
+			.peak_memory = get_peak_memory(),
+			.has_counters = has_counters,
+		};
+		if (has_counters) {
+			for (std::size_t i = 0; i < hardware_counter_count; i++)
+				sample.counters[i] = counters[i] - _counters_start[i];
+		}
+		// Destructors are noexcept, so a failure to allocate the buffer of the thread or to grow it just drops the sample
+		try {
+			get_thread_buffer().samples.push_back(std::move(sample));
+		} catch (const std::exception&) {
+		}
+	}
+
+	void StageTimer::add_rows(uint64_t rows) {
+		_rows += rows;
+	}
+
+	void StageTimer::add_nan_records(uint64_t nan_records) {
+		_nan_records += nan_records;
+	}
+
+	void StageTimer::add_bytes(uint64_t bytes) {
+		_bytes += bytes;
+	}
+
+	void reset_metrics() {
+		std::lock_guard<std::mutex> lock(buffers_mutex);
+		for (auto& buffer : sample_buffers)
+			buffer->samples.clear();
+	}
+
+	void write_metrics(const std::string& path, std::chrono::steady_clock::duration wall_time) {
+		std::map<std::tuple<std::string, std::string, PipelineStage>, StageTotals> entries;
+		std::map<PipelineStage, StageTotals> stage_totals;
+		{
+			std::lock_guard<std::mutex> lock(buffers_mutex);
+			for (const auto& buffer : sample_buffers) {
+				for (const auto& sample : buffer->samples) {
+					auto entry_key = std::make_tuple(sample.key.symbol, sample.key.series, sample.stage);
+					entries[entry_key].add(sample);
+					stage_totals[sample.stage].add(sample);
+				}
+			}
+		}
+		std::string output = std::format(
+			"{{\n\t\"wall_time\": {},\n\t\"peak_memory\": {},\n\t\"stages\": [",
+			get_seconds(std::chrono::duration_cast<std::chrono::nanoseconds>(wall_time).count()),
+			get_peak_memory()
+		);
+		bool first = true;
+		for (const auto& [stage, totals] : stage_totals) {
+			output += first ? "\n" : ",\n";
+			output += std::format("\t\t{{\"stage\": \"{}\", ", get_stage_string(stage));
+			append_totals(output, totals);
+			output += "}";
+			first = false;
+		}
+		output += "\n\t],\n\t\"entries\": [";
+		first = true;
+		for (const auto& [entry_key, totals] : entries) {
+			const auto& [symbol, series, stage] = entry_key;
+			output += first ? "\n" : ",\n";
+			output += std::format(
+				"\t\t{{\"symbol\": {}, \"series\": {}, \"stage\": \"{}\", ",
+				get_json_string(symbol),
+				get_json_string(series),
+				get_stage_string(stage)
+			);
+			append_totals(output, totals);
+			output += "}";
+			first = false;
+		}
+		output += "\n\t]\n}\n";
+		write_file(path, output.data(), output.size());
+	}
+
+	void write_trace(const std::string& path) {
+		std::string output = "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+		bool first = true;
+		std::lock_guard<std::mutex> lock(buffers_mutex);
+		for (const auto& buffer : sample_buffers) {
+			if (buffer->samples.empty())
+				continue;
+			output += first ? "\n" : ",\n";
+			output += std::format(
+				"\t{{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": {}, \"args\": {{\"name\": \"Thread {}\"}}}}",
+				buffer->thread,
+				buffer->thread
+			);
+			first = false;
+			for (const auto& sample : buffer->samples) {
+				const auto& key = sample.key;
+				std::string name = get_stage_string(sample.stage);
+				if (!key.symbol.empty())
+					name += " " + key.symbol;
+				if (!key.series.empty())
+					name += " " + key.series;
+				output += std::format(
+					",\n\t{{\"name\": \"{}\", \"cat\": \"{}\", \"ph\": \"X\", \"ts\": {:.3f}, \"dur\": {:.3f}, \"pid\": 0, \"tid\": {}, \"args\": {{"
+					"\"symbol\": {}, \"series\": {}, \"cpu_time\": {}, \"rows\": {}, \"nan_records\": {}, \"bytes\": {}, \"allocations\": {}, \"allocated_bytes\": {}",
+					name,
+					get_stage_string(sample.stage),
+					get_microseconds(sample.start),
+					get_microseconds(sample.wall_time),
+					buffer->thread,
+					get_json_string(key.symbol),
+					get_json_string(key.series),
+					get_seconds(sample.cpu_time),
+					sample.rows,
+					sample.nan_records,
+					sample.bytes,
+					sample.allocations,
+					sample.allocated_bytes
+				);
+				if (sample.has_counters) {
+					for (std::size_t i = 0; i < hardware_counter_count; i++)
+						output += std::format(", \"{}\": {}", hardware_counter_names[i], sample.counters[i]);
+				}
+				output += "}}";
+			}
+		}
+		output += "\n]}\n";
+		write_file(path, output.data(), output.size());
+	}
+
+	void set_trace_counters(bool enabled) {
+		trace_counters.store(enabled, std::memory_order_relaxed);
+	}
+
+	uint64_t get_peak_memory() {
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS counters;
+		if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+			return 0;
+		return static_cast<uint64_t>(counters.PeakWorkingSetSize);
+#else
+		rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) != 0)
+			return 0;
+		// ru_maxrss is in KiB on Linux
+		return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+	}
+}
+
+#ifdef CONFOUNDING_COUNT_ALLOCATIONS
+/*
+Opt-in since replacing the global allocation functions in a library affects every program that links it.
+Add CONFOUNDING_COUNT_ALLOCATIONS to GlobalPreprocessorDefinitions in confounding.props to enable it,
+otherwise the allocations of all stages are reported as 0.
+Replacing the global allocation functions counts all allocations performed by the code of confounding.dll on Windows
+and all allocations of the process on Linux, where the definitions are interposed.
+Only the calling thread's counters are updated so this is just a malloc call and two increments of thread-local variables.
+The array, nothrow and sized forms of the default implementations forward to these two functions.
+Over-aligned allocations use separate functions that are not counted.
+*/
+void* operator new(std::size_t size) {
+	confounding::thread_allocations++;
+	confounding::thread_allocated_bytes += size;
+	if (size == 0)
+		size = 1;
+	while (true) {
+		void* pointer = std::malloc(size);
+		if (pointer != nullptr)
+			return pointer;
+		auto handler = std::get_new_handler();
+		if (handler == nullptr)
+			throw std::bad_alloc();
+		handler();
+	}
+}
+
+void operator delete(void* pointer) noexcept {
+	std::free(pointer);
+}
+#endif
\ No newline at end of file
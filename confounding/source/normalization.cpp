@@ -0,0 +1,71 @@
+#include <cmath>
+#include <limits>
+
+#include "confounding/normalization.h"
+
+namespace confounding {
+	RollingZScore::RollingZScore(std::chrono::hours window)
+		: _window(window),
+		_mean(0.0),
+		_m2(0.0),
+		_updates(0) {
+	}
+
+	double RollingZScore::update(MinuteTime time, double value) {
+		if (!_first_time)
+			_first_time = time;
+		while (!_values.empty() && _values.front().first + _window <= time) {
+			remove(_values.front().second);
+			_values.pop_front();
+		}
+		double z_score = std::numeric_limits<double>::quiet_NaN();
+		std::size_t count = _values.size();
+		if (*_first_time + _window <= time && count >= 2) {
+			double variance = _m2 / static_cast<double>(count - 1);
+			if (variance > 0.0)
+				z_score = (value - _mean) / std::sqrt(variance);
+		}
+		_values.emplace_back(time, value);
+		add(value);
+		_updates++;
+		// Recalculating the moments once per window length keeps the amortized cost constant
+		if (_updates >= _values.size()) {
+			recalculate();
+			_updates = 0;
+		}
+		return z_score;
+	}
+
+	void RollingZScore::add(double value) {
+		double count = static_cast<double>(_values.size());
+		double delta = value - _mean;
+		_mean += delta / count;
+		_m2 += delta * (value - _mean);
+	}
+
+	void RollingZScore::remove(double value) {
+		double count = static_cast<double>(_values.size() - 1);
+		if (count == 0.0) {
+			_mean = 0.0;
+			_m2 = 0.0;
+			return;
+		}
+		double delta = value - _mean;
+		_mean -= delta / count;
+		_m2 -= delta * (value - _mean);
+		if (_m2 < 0.0)
+			_m2 = 0.0;
+	}
+
+	void RollingZScore::recalculate() {
+		double sum = 0.0;
+		for (const auto& [time, value] : _values)
+			sum += value;
+		_mean = sum / static_cast<double>(_values.size());
+		_m2 = 0.0;
+		for (const auto& [time, value] : _values) {
+			double delta = value - _mean;
+			_m2 += delta * delta;
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,180 @@
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <filesystem>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#endif
+
+#include "confounding/output.h"
+#include "confounding/exception.h"
+
+namespace confounding {
+	namespace {
+		// Keep individual writes large but within the limits of a DWORD
+		constexpr std::size_t write_chunk_size = 16 * 1024 * 1024;
+
+		std::string get_temporary_path(const std::string& path) {
+			return path + ".tmp";
+		}
+	}
+
+#ifdef _WIN32
+	void write_file(const std::string& path, const char* data, std::size_t size) {
+		std::string temporary_path = get_temporary_path(path);
+		HANDLE file = CreateFileA(
+			temporary_path.c_str(),
+			GENERIC_WRITE,
+			0,
+			nullptr,
+			CREATE_ALWAYS,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+			nullptr
+		);
+		if (file == INVALID_HANDLE_VALUE)
+			throw Exception("Failed to open file {} for writing (error {})", temporary_path, GetLastError());
+		std::size_t offset = 0;
+		while (offset < size) {
+			DWORD chunk_size = static_cast<DWORD>(std::min(write_chunk_size, size - offset));
+			DWORD bytes_written = 0;
+			if (!WriteFile(file, data + offset, chunk_size, &bytes_written, nullptr) || bytes_written == 0) {
+				DWORD error = GetLastError();
+				CloseHandle(file);
+				throw Exception("Failed to write to file {} (error {})", temporary_path, error);
+			}
+			offset += bytes_written;
+		}
+		if (!FlushFileBuffers(file)) {
+			DWORD error = GetLastError();
+			CloseHandle(file);
+			throw Exception("Failed to flush file {} (error {})", temporary_path, error);
+		}
+		CloseHandle(file);
+		if (!MoveFileExA(temporary_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+			throw Exception("Failed to rename {} to {} (error {})", temporary_path, path, GetLastError());
+	}
+#else
+	void write_file(const std::string& path, const char* data, std::size_t size) {
+		std::string temporary_path = get_temporary_path(path);
+		int file = ::open(temporary_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (file == -1)
+			throw Exception("Failed to open file {} for writing ({})", temporary_path, std::strerror(errno));
+		std::size_t offset = 0;
+		while (offset < size) {
+			std::size_t chunk_size = std::min(write_chunk_size, size - offset);
+			ssize_t bytes_written = ::write(file, data + offset, chunk_size);
+			if (bytes_written == -1 && errno == EINTR)
+				continue;
+			if (bytes_written <= 0) {
+				int error = errno;
+				::close(file);
+				throw Exception("Failed to write to file {} ({})", temporary_path, std::strerror(error));
+			}
+			offset += static_cast<std::size_t>(bytes_written);
+		}
+		if (::fsync(file) != 0) {
+			int error = errno;
+			::close(file);
+			throw Exception("Failed to flush file {} ({})", temporary_path, std::strerror(error));
+		}
+		::close(file);
+		if (std::rename(temporary_path.c_str(), path.c_str()) != 0)
+			throw Exception("Failed to rename {} to {} ({})", temporary_path, path, std::strerror(errno));
+		// The rename itself is only durable once the directory has been flushed, too
+		auto directory = std::filesystem::path(path).parent_path();
+		if (directory.empty())
+			directory = ".";
+		int directory_file = ::open(directory.c_str(), O_RDONLY | O_CLOEXEC);
+		if (directory_file != -1) {
+			::fsync(directory_file);
+			::close(directory_file);
+		}
+	}
+#endif
+
+	AsyncFileWriter::AsyncFileWriter(unsigned thread_count, std::size_t max_pending_bytes)
+		: _max_pending_bytes(max_pending_bytes),
+		_pending_bytes(0),
+		_pending_jobs(0),
+		_stop(false) {
+		if (thread_count == 0)
+			throw Exception("Invalid number of writer threads");
+		for (unsigned i = 0; i < thread_count; i++)
+			_threads.emplace_back(&AsyncFileWriter::run_worker, this);
+	}
+
+	AsyncFileWriter::~AsyncFileWriter() {
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_job_done.wait(lock, [&]() { return _pending_jobs == 0; });
+			_stop = true;
+		}
+		_job_available.notify_all();
+		for (auto& thread : _threads)
+			thread.join();
+	}
+
+	void AsyncFileWriter::submit(const std::string& path, std::vector<char>&& data, const MetricsKey& key) {
+		std::unique_lock<std::mutex> lock(_mutex);
+		if (_error)
+			std::rethrow_exception(_error);
+		// Always accept at least one job so that buffers larger than the limit don't block forever
+		_job_done.wait(lock, [&]() {
+			return _pending_jobs == 0 || _pending_bytes + data.size() <= _max_pending_bytes;
+		});
+		_pending_bytes += data.size();
+		_pending_jobs++;
+		Job job{
+			.path = path,
+			.data = std::move(data),
+			.key = key
+		};
+		_jobs.push_back(std::move(job));
+		lock.unlock();
+		_job_available.notify_one();
+	}
+
+	void AsyncFileWriter::flush() {
+		std::unique_lock<std::mutex> lock(_mutex);
+		_job_done.wait(lock, [&]() { return _pending_jobs == 0; });
+		if (_error) {
+			auto error = _error;
+			_error = nullptr;
+			std::rethrow_exception(error);
+		}
+	}
+
+	void AsyncFileWriter::run_worker() {
+		while (true) {
+			std::unique_lock<std::mutex> lock(_mutex);
+			_job_available.wait(lock, [&]() { return _stop || !_jobs.empty(); });
+			if (_jobs.empty())
+				return;
+			Job job = std::move(_jobs.front());
+			_jobs.pop_front();
+			lock.unlock();
+			std::exception_ptr error;
+			try {
+				StageTimer timer(PipelineStage::output, job.key);
+				timer.add_bytes(job.data.size());
+				write_file(job.path, job.data.data(), job.data.size());
+			} catch (...) {
+				error = std::current_exception();
+			}
+			std::size_t size = job.data.size();
+			job.data = std::vector<char>();
+			lock.lock();
+			if (error && !_error)
+				_error = error;
+			_pending_bytes -= size;
+			_pending_jobs--;
+			lock.unlock();
+			_job_done.notify_all();
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,307 @@
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <execution>
+#include <limits>
+#include <numeric>
+
+#include "confounding/panel.h"
+#include "confounding/archive.h"
+#include "confounding/constants.h"
+#include "confounding/exception.h"
+#include "confounding/output.h"
+
+namespace confounding {
+	namespace {
+		constexpr std::size_t presence_word_bits = 64;
+
+		template<typename T>
+		std::vector<char> get_panel_column(
+			const std::vector<std::vector<T>>& symbol_values,
+			const std::vector<std::vector<uint32_t>>& rows,
+			std::size_t time_count,
+			T missing_value
+		) {
+			std::size_t symbol_count = symbol_values.size();
+			std::vector<T> values(time_count * symbol_count, missing_value);
+			for (std::size_t s = 0; s < symbol_count; s++) {
+				const auto& symbol_rows = rows[s];
+				const auto& input = symbol_values[s];
+				for (std::size_t i = 0; i < input.size(); i++)
+					values[symbol_rows[i] * symbol_count + s] = input[i];
+			}
+			const char* pointer = reinterpret_cast<const char*>(values.data());
+			return std::vector<char>(pointer, pointer + values.size() * sizeof(T));
+		}
+	}
+
+	PanelWriter::PanelWriter(const std::string& series, const std::vector<std::string>& archive_paths)
+		: _series(series) {
+		_readers.reserve(archive_paths.size());
+		for (const auto& path : archive_paths) {
+			_readers.emplace_back(path);
+			const auto& header = _readers.back().get_header();
+			std::string symbol(header.symbol, strnlen(header.symbol, archive_symbol_size));
+			std::string archive_series(header.series, strnlen(header.series, archive_series_size));
+			if (archive_series != series)
+				throw Exception("Archive {} is of series {} rather than {}", path, archive_series, series);
+			_symbols.push_back(symbol);
+		}
+	}
+
+	const std::vector<char>& PanelWriter::encode() {
+		if (!_buffer.empty())
+			return _buffer;
+		build_time_axis();
+		build_presence_mask();
+		build_intraday_columns();
+		serialize();
+		return _buffer;
+	}
+
+	void PanelWriter::write(const std::string& path) {
+		const auto& buffer = encode();
+		write_file(path, buffer.data(), buffer.size());
+	}
+
+	void PanelWriter::build_time_axis() {
+		std::vector<std::vector<int64_t>> symbol_timestamps;
+		for (const auto& reader : _readers) {
+			std::vector<int64_t> timestamps;
+			for (Time time : reader.read_timestamps())
+				timestamps.push_back(static_cast<int64_t>(time.time_since_epoch().count()));
+			symbol_timestamps.push_back(std::move(timestamps));
+		}
+		for (const auto& timestamps : symbol_timestamps) {
+			std::vector<int64_t> merged;
+			merged.reserve(_timestamps.size() + timestamps.size());
+			std::ranges::set_union(_timestamps, timestamps, std::back_inserter(merged));
+			_timestamps = std::move(merged);
+		}
+		if (_timestamps.size() > std::numeric_limits<uint32_t>::max())
+			throw Exception("Too many rows in panel of series {}", _series);
+		for (const auto& timestamps : symbol_timestamps) {
+			std::vector<uint32_t> rows;
+			rows.reserve(timestamps.size());
+			std::size_t row = 0;
+			for (int64_t time : timestamps) {
+				while (_timestamps[row] < time)
+					row++;
+				rows.push_back(static_cast<uint32_t>(row));
+			}
+			_rows.push_back(std::move(rows));
+		}
+		std::vector<char> data(
+			reinterpret_cast<const char*>(_timestamps.data()),
+			reinterpret_cast<const char*>(_timestamps.data() + _timestamps.size())
+		);
+		add_column(panel_time_column, ColumnType::int64, _timestamps.size(), std::move(data));
+	}
+
+	void PanelWriter::build_presence_mask() {
+		std::size_t presence_words = (_symbols.size() + presence_word_bits - 1) / presence_word_bits;
+		std::vector<uint64_t> presence(_timestamps.size() * presence_words, 0);
+		for (std::size_t s = 0; s < _rows.size(); s++) {
+			uint64_t bit = 1ull << (s % presence_word_bits);
+			std::size_t word = s / presence_word_bits;
+			for (uint32_t row : _rows[s])
+				presence[row * presence_words + word] |= bit;
+		}
+		std::vector<char> data(
+			reinterpret_cast<const char*>(presence.data()),
+			reinterpret_cast<const char*>(presence.data() + presence.size())
+		);
+		add_column(panel_presence_column, ColumnType::int64, presence.size(), std::move(data));
+	}
+
+	void PanelWriter::build_intraday_columns() {
+		struct PanelColumn {
+			std::string name;
+			ColumnType type;
+		};
+		std::vector<PanelColumn> columns;
+		for (const auto& column : intraday_columns)
+			columns.push_back(PanelColumn{.name = column.name, .type = column.type});
+		// The extra return columns depend on the configuration, so all archives of a panel must share them
+		// Archives generated with different settings are rejected up front since a missing column would only surface in the parallel decoding
+		std::vector<std::string> extra_columns;
+		for (std::size_t i = 0; i < _readers.size(); i++) {
+			std::vector<std::string> reader_columns;
+			for (const auto& column : _readers[i].get_columns()) {
+				if (column.flags & column_flag_extra)
+					reader_columns.push_back(column.name);
+			}
+			if (i == 0)
+				extra_columns = std::move(reader_columns);
+			else if (reader_columns != extra_columns)
+				throw Exception("The extra columns of {} in the panel of series {} don't match those of {}", _symbols[i], _series, _symbols.front());
+		}
+		for (const auto& name : extra_columns)
+			columns.push_back(PanelColumn{.name = name, .type = ColumnType::int32});
+		std::size_t column_count = columns.size();
+		std::vector<std::vector<char>> column_data(column_count);
+		std::vector<std::size_t> indexes(column_count);
+		std::iota(indexes.begin(), indexes.end(), 0);
+		// Each column only holds the values of a single field at a time, decode and scatter them in parallel
+		std::for_each(
+			std::execution::par,
+			indexes.begin(),
+			indexes.end(),
+			[&](std::size_t i) {
+				const auto& column = columns[i];
+				if (column.type == ColumnType::float32) {
+					std::vector<std::vector<float>> values;
+					for (const auto& reader : _readers)
+						values.push_back(reader.read_floats(column.name));
+					column_data[i] = get_panel_column<float>(values, _rows, _timestamps.size(), std::numeric_limits<float>::quiet_NaN());
+				} else {
+					std::vector<std::vector<int32_t>> values;
+					for (const auto& reader : _readers)
+						values.push_back(reader.read_returns(column.name));
+					column_data[i] = get_panel_column<int32_t>(values, _rows, _timestamps.size(), intraday_invalid_returns);
+				}
+			}
+		);
+		std::size_t count = _timestamps.size() * _symbols.size();
+		for (std::size_t i = 0; i < column_count; i++)
+			add_column(columns[i].name, columns[i].type, count, std::move(column_data[i]));
+	}
+
+	void PanelWriter::add_column(const std::string& name, ColumnType type, std::size_t count, std::vector<char>&& data) {
+		ColumnHeader column;
+		std::memset(&column, 0, sizeof(column));
+		copy_string(column.name, name);
+		column.type = type;
+		column.encoding = ColumnEncoding::raw;
+		column.count = count;
+		column.size = data.size();
+		_columns.push_back(column);
+		_column_data.push_back(std::move(data));
+	}
+
+	void PanelWriter::serialize() {
+		PanelHeader header;
+		std::memset(&header, 0, sizeof(header));
+		header.magic = panel_magic;
+		header.version = panel_version;
+		copy_string(header.series, _series);
+		header.symbol_count = static_cast<uint32_t>(_symbols.size());
+		header.column_count = static_cast<uint32_t>(_columns.size());
+		header.time_count = _timestamps.size();
+		header.presence_words = static_cast<uint32_t>((_symbols.size() + presence_word_bits - 1) / presence_word_bits);
+		std::size_t symbols_offset = sizeof(PanelHeader);
+		std::size_t columns_offset = symbols_offset + _symbols.size() * archive_symbol_size;
+		std::size_t offset = columns_offset + _columns.size() * sizeof(ColumnHeader);
+		for (std::size_t i = 0; i < _columns.size(); i++) {
+			offset = get_aligned_offset(offset);
+			_columns[i].offset = offset;
+			offset += _column_data[i].size();
+		}
+		_buffer.assign(offset, 0);
+		std::memcpy(_buffer.data(), &header, sizeof(header));
+		for (std::size_t i = 0; i < _symbols.size(); i++) {
+			char symbol[archive_symbol_size];
+			copy_string(symbol, _symbols[i]);
+			std::memcpy(_buffer.data() + symbols_offset + i * archive_symbol_size, symbol, archive_symbol_size);
+		}
+		std::memcpy(_buffer.data() + columns_offset, _columns.data(), _columns.size() * sizeof(ColumnHeader));
+		for (std::size_t i = 0; i < _columns.size(); i++)
+			std::ranges::copy(_column_data[i], _buffer.begin() + _columns[i].offset);
+		_column_data.clear();
+	}
+
+	PanelReader::PanelReader(const std::string& path)
+		: _file(path) {
+		const char* data = _file.get_data();
+		std::size_t size = _file.get_size();
+		if (size < sizeof(PanelHeader))
+			throw Exception("Panel {} is too small", path);
+		_header = reinterpret_cast<const PanelHeader*>(data);
+		if (_header->magic != panel_magic)
+			throw Exception("Invalid panel magic in {}", path);
+		if (_header->version != panel_version)
+			throw Exception("Unsupported panel version {} in {}", _header->version, path);
+		std::size_t symbols_offset = sizeof(PanelHeader);
+		std::size_t columns_offset = symbols_offset + _header->symbol_count * archive_symbol_size;
+		std::size_t columns_end = columns_offset + _header->column_count * sizeof(ColumnHeader);
+		if (size < columns_end)
+			throw Exception("Panel {} is truncated", path);
+		_symbols = data + symbols_offset;
+		auto columns = reinterpret_cast<const ColumnHeader*>(data + columns_offset);
+		_columns = std::span<const ColumnHeader>(columns, _header->column_count);
+		for (const auto& column : _columns) {
+			if (column.offset + column.size > size || column.size != column.count * get_type_size(column.type))
+				throw Exception("Column {} in panel {} is invalid", column.name, path);
+		}
+		const auto& time_column = get_column(panel_time_column, ColumnType::int64);
+		const auto& presence_column = get_column(panel_presence_column, ColumnType::int64);
+		if (
+			time_column.count != _header->time_count ||
+			presence_column.count != _header->time_count * _header->presence_words
+		) {
+			throw Exception("Panel {} has an inconsistent time axis", path);
+		}
+		_timestamps = std::span<const int64_t>(reinterpret_cast<const int64_t*>(get_column_data(time_column)), time_column.count);
+		_presence = std::span<const int64_t>(reinterpret_cast<const int64_t*>(get_column_data(presence_column)), presence_column.count);
+	}
+
+	const PanelHeader& PanelReader::get_header() const {
+		return *_header;
+	}
+
+	std::vector<std::string> PanelReader::get_symbols() const {
+		std::vector<std::string> symbols;
+		for (std::size_t i = 0; i < _header->symbol_count; i++) {
+			const char* symbol = _symbols + i * archive_symbol_size;
+			symbols.emplace_back(symbol, strnlen(symbol, archive_symbol_size));
+		}
+		return symbols;
+	}
+
+	std::size_t PanelReader::get_symbol_index(const std::string& symbol) const {
+		auto symbols = get_symbols();
+		auto iterator = std::ranges::find(symbols, symbol);
+		if (iterator == symbols.end())
+			throw Exception("Unable to find symbol {} in panel", symbol);
+		return iterator - symbols.begin();
+	}
+
+	std::span<const int64_t> PanelReader::get_timestamps() const {
+		return _timestamps;
+	}
+
+	std::size_t PanelReader::get_row(Time time) const {
+		auto time_count = static_cast<int64_t>(time.time_since_epoch().count());
+		return std::ranges::lower_bound(_timestamps, time_count) - _timestamps.begin();
+	}
+
+	bool PanelReader::is_present(std::size_t row, std::size_t symbol_index) const {
+		std::size_t word = row * _header->presence_words + symbol_index / presence_word_bits;
+		return (static_cast<uint64_t>(_presence[word]) >> (symbol_index % presence_word_bits)) & 1;
+	}
+
+	std::span<const float> PanelReader::get_floats(const std::string& name) const {
+		const auto& column = get_column(name, ColumnType::float32);
+		return std::span<const float>(reinterpret_cast<const float*>(get_column_data(column)), column.count);
+	}
+
+	std::span<const int32_t> PanelReader::get_returns(const std::string& name) const {
+		const auto& column = get_column(name, ColumnType::int32);
+		return std::span<const int32_t>(reinterpret_cast<const int32_t*>(get_column_data(column)), column.count);
+	}
+
+	const ColumnHeader& PanelReader::get_column(const std::string& name, ColumnType type) const {
+		auto iterator = std::ranges::find_if(_columns, [&](const ColumnHeader& column) {
+			return name == column.name;
+		});
+		if (iterator == _columns.end())
+			throw Exception("Unable to find column {} in panel", name);
+		if (iterator->type != type)
+			throw Exception("Column {} in panel has an unexpected type", name);
+		return *iterator;
+	}
+
+	const char* PanelReader::get_column_data(const ColumnHeader& column) const {
+		return _file.get_data() + column.offset;
+	}
+}
\ No newline at end of file
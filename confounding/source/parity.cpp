@@ -0,0 +1,354 @@
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <format>
+#include <bit>
+#include <span>
+#include <algorithm>
+
+#include "confounding/parity.h"
+#include "confounding/constants.h"
+#include "confounding/common.h"
+#include "confounding/format.h"
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define CONFOUNDING_SSE2
+#include <immintrin.h>
+#endif
+
+namespace confounding {
+	namespace {
+		// Record indexes of the dense view that don't refer to an element of Archive::intraday_records
+		constexpr std::size_t missing_record = std::numeric_limits<std::size_t>::max();
+		constexpr std::size_t nan_record = missing_record - 1;
+
+		struct DenseEntry {
+			Time time;
+			std::size_t index;
+		};
+
+		// Union of the dense hourly views of both archives
+		struct Alignment {
+			std::vector<Time> times;
+			std::vector<std::size_t> reference_indexes;
+			std::vector<std::size_t> candidate_indexes;
+		};
+
+		struct Mismatches {
+			std::size_t count = 0;
+			std::size_t first = missing_record;
+
+			void add(std::size_t index) {
+				if (count == 0)
+					first = index;
+				count++;
+			}
+		};
+
+		std::vector<DenseEntry> get_dense_entries(const Archive& archive) {
+			std::vector<DenseEntry> entries;
+			entries.reserve(archive.get_dense_size());
+			const IntradayRecord* records = archive.intraday_records.data();
+			for (auto iterator = archive.dense_begin(); iterator != archive.dense_end(); ++iterator) {
+				auto record = *iterator;
+				DenseEntry entry{
+					.time = record.time,
+					.index = record.record == &nan_intraday_record ? nan_record : static_cast<std::size_t>(record.record - records),
+				};
+				entries.push_back(entry);
+			}
+			return entries;
+		}
+
+		std::string get_index_string(std::size_t index) {
+			if (index == missing_record)
+				return "missing";
+			else if (index == nan_record)
+				return "NaN record";
+			else
+				return "valid record";
+		}
+
+		Alignment align_archives(const Archive& reference, const Archive& candidate, std::vector<ColumnDivergence>& divergences) {
+			auto reference_entries = get_dense_entries(reference);
+			auto candidate_entries = get_dense_entries(candidate);
+			Alignment alignment;
+			std::size_t size = std::max(reference_entries.size(), candidate_entries.size());
+			alignment.times.reserve(size);
+			alignment.reference_indexes.reserve(size);
+			alignment.candidate_indexes.reserve(size);
+			Mismatches mismatches;
+			std::size_t i = 0;
+			std::size_t j = 0;
+			while (i < reference_entries.size() || j < candidate_entries.size()) {
+				Time time;
+				std::size_t reference_index = missing_record;
+				std::size_t candidate_index = missing_record;
+				if (j == candidate_entries.size() || (i < reference_entries.size() && reference_entries[i].time < candidate_entries[j].time)) {
+					time = reference_entries[i].time;
+					reference_index = reference_entries[i++].index;
+				} else if (i == reference_entries.size() || candidate_entries[j].time < reference_entries[i].time) {
+					time = candidate_entries[j].time;
+					candidate_index = candidate_entries[j++].index;
+				} else {
+					time = reference_entries[i].time;
+					reference_index = reference_entries[i++].index;
+					candidate_index = candidate_entries[j++].index;
+				}
+				if (reference_index == missing_record || candidate_index == missing_record)
+					mismatches.add(alignment.times.size());
+				alignment.times.push_back(time);
+				alignment.reference_indexes.push_back(reference_index);
+				alignment.candidate_indexes.push_back(candidate_index);
+			}
+			if (mismatches.count > 0) {
+				ColumnDivergence divergence{
+					.column = intraday_time_column,
+					.mismatches = mismatches.count,
+					.first_time = alignment.times[mismatches.first],
+					.reference_value = get_index_string(alignment.reference_indexes[mismatches.first]),
+					.candidate_value = get_index_string(alignment.candidate_indexes[mismatches.first]),
+				};
+				divergences.push_back(divergence);
+			}
+			return alignment;
+		}
+
+		// Records that aren't valid are filled in with the value of NaN records
+		template<typename T, typename Getter>
+		std::vector<T> gather_values(const std::vector<std::size_t>& indexes, T invalid_value, Getter get_value) {
+			std::vector<T> values(indexes.size());
+			for (std::size_t i = 0; i < indexes.size(); i++)
+				values[i] = indexes[i] >= nan_record ? invalid_value : get_value(indexes[i]);
+			return values;
+		}
+
+		bool is_float_mismatch(float reference, float candidate, float tolerance) {
+			bool reference_nan = std::isnan(reference);
+			bool candidate_nan = std::isnan(candidate);
+			if (reference_nan || candidate_nan)
+				return reference_nan != candidate_nan;
+			// Matching infinities result in NaN, which never exceeds the tolerance
+			return std::abs(reference - candidate) > tolerance;
+		}
+
+		bool is_returns_mismatch(int32_t reference, int32_t candidate, double tolerance) {
+			if (reference == candidate)
+				return false;
+			if (reference == intraday_invalid_returns || candidate == intraday_invalid_returns)
+				return true;
+			double difference = std::abs(static_cast<double>(reference) - static_cast<double>(candidate));
+			return difference > tolerance;
+		}
+
+		Mismatches compare_floats(std::span<const float> reference, std::span<const float> candidate, float tolerance) {
+			Mismatches mismatches;
+			std::size_t count = reference.size();
+			std::size_t i = 0;
+#ifdef CONFOUNDING_SSE2
+			__m128 tolerance_vector = _mm_set1_ps(tolerance);
+			__m128 sign_mask = _mm_set1_ps(-0.0f);
+			for (; i + 4 <= count; i += 4) {
+				__m128 a = _mm_loadu_ps(reference.data() + i);
+				__m128 b = _mm_loadu_ps(candidate.data() + i);
+				__m128 nan_mismatch = _mm_xor_ps(_mm_cmpunord_ps(a, a), _mm_cmpunord_ps(b, b));
+				__m128 difference = _mm_andnot_ps(sign_mask, _mm_sub_ps(a, b));
+				__m128 mismatch = _mm_or_ps(nan_mismatch, _mm_cmpgt_ps(difference, tolerance_vector));
+				unsigned mask = static_cast<unsigned>(_mm_movemask_ps(mismatch));
+				for (; mask != 0; mask &= mask - 1)
+					mismatches.add(i + std::countr_zero(mask));
+			}
+#endif
+			for (; i < count; i++) {
+				if (is_float_mismatch(reference[i], candidate[i], tolerance))
+					mismatches.add(i);
+			}
+			return mismatches;
+		}
+
+		Mismatches compare_returns(std::span<const int32_t> reference, std::span<const int32_t> candidate, double tolerance) {
+			Mismatches mismatches;
+			std::size_t count = reference.size();
+			std::size_t i = 0;
+#ifdef CONFOUNDING_SSE2
+			// Most values are identical, only lanes that aren't are checked against the tolerance
+			for (; i + 4 <= count; i += 4) {
+				__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(reference.data() + i));
+				__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(candidate.data() + i));
+				unsigned mask = ~static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a, b)))) & 0xf;
+				for (; mask != 0; mask &= mask - 1) {
+					std::size_t index = i + std::countr_zero(mask);
+					if (is_returns_mismatch(reference[index], candidate[index], tolerance))
+						mismatches.add(index);
+				}
+			}
+#endif
+			for (; i < count; i++) {
+				if (is_returns_mismatch(reference[i], candidate[i], tolerance))
+					mismatches.add(i);
+			}
+			return mismatches;
+		}
+
+		std::string get_returns_string(int32_t returns) {
+			if (returns == intraday_invalid_returns)
+				return "invalid";
+			return std::to_string(returns);
+		}
+
+		std::vector<float> get_float_column(const Archive& archive, const std::vector<std::size_t>& indexes, std::size_t offset) {
+			const char* records = reinterpret_cast<const char*>(archive.intraday_records.data());
+			return gather_values<float>(indexes, std::numeric_limits<float>::quiet_NaN(), [&](std::size_t index) {
+				float value;
+				std::memcpy(&value, records + index * sizeof(IntradayRecord) + offset, sizeof(float));
+				return value;
+			});
+		}
+
+		std::vector<int32_t> get_returns_column(const Archive& archive, const std::vector<std::size_t>& indexes, std::size_t offset) {
+			const char* records = reinterpret_cast<const char*>(archive.intraday_records.data());
+			return gather_values<int32_t>(indexes, intraday_invalid_returns, [&](std::size_t index) {
+				int32_t value;
+				std::memcpy(&value, records + index * sizeof(IntradayRecord) + offset, sizeof(int32_t));
+				return value;
+			});
+		}
+
+		std::vector<int32_t> get_extra_column(const Archive& archive, const std::vector<std::size_t>& indexes, std::size_t column_index) {
+			return gather_values<int32_t>(indexes, intraday_invalid_returns, [&](std::size_t index) {
+				return archive.get_extra_value(index, column_index);
+			});
+		}
+
+		void compare_returns_columns(
+			const std::string& column,
+			const std::vector<int32_t>& reference_values,
+			const std::vector<int32_t>& candidate_values,
+			const Alignment& alignment,
+			const ParityOptions& options,
+			std::vector<ColumnDivergence>& divergences
+		) {
+			auto mismatches = compare_returns(reference_values, candidate_values, options.get_tolerance(column));
+			if (mismatches.count == 0)
+				return;
+			ColumnDivergence divergence{
+				.column = column,
+				.mismatches = mismatches.count,
+				.first_time = alignment.times[mismatches.first],
+				.reference_value = get_returns_string(reference_values[mismatches.first]),
+				.candidate_value = get_returns_string(candidate_values[mismatches.first]),
+			};
+			divergences.push_back(divergence);
+		}
+
+		void compare_daily_records(const Archive& reference, const Archive& candidate, std::vector<ColumnDivergence>& divergences) {
+			const auto& reference_records = reference.daily_records;
+			const auto& candidate_records = candidate.daily_records;
+			std::size_t common_size = std::min(reference_records.size(), candidate_records.size());
+			Mismatches mismatches;
+			for (std::size_t i = 0; i < common_size; i++) {
+				const auto& reference_record = reference_records[i];
+				const auto& candidate_record = candidate_records[i];
+				if (reference_record.date != candidate_record.date || reference_record.close.to_int() != candidate_record.close.to_int())
+					mismatches.add(i);
+			}
+			std::size_t size = std::max(reference_records.size(), candidate_records.size());
+			for (std::size_t i = common_size; i < size; i++)
+				mismatches.add(i);
+			if (mismatches.count == 0)
+				return;
+			auto get_record_string = [&](const std::vector<DailyRecord>& records) -> std::string {
+				if (mismatches.first >= records.size())
+					return "missing";
+				const auto& record = records[mismatches.first];
+				return std::format("{} {}", get_date_string(record.date), record.close.to_double());
+			};
+			const auto& records = mismatches.first < reference_records.size() ? reference_records : candidate_records;
+			ColumnDivergence divergence{
+				.column = daily_close_column,
+				.mismatches = mismatches.count,
+				.first_time = get_time(records[mismatches.first].date),
+				.reference_value = get_record_string(reference_records),
+				.candidate_value = get_record_string(candidate_records),
+			};
+			divergences.push_back(divergence);
+		}
+	}
+
+	double ParityOptions::get_tolerance(const std::string& column) const {
+		auto iterator = column_tolerances.find(column);
+		if (iterator == column_tolerances.end())
+			return tolerance;
+		return iterator->second;
+	}
+
+	std::vector<ColumnDivergence> compare_archives(
+		const Archive& reference,
+		const Archive& candidate,
+		const ParityOptions& options
+	) {
+		if (reference.symbol != candidate.symbol || reference.series != candidate.series) {
+			throw Exception(
+				"Unable to compare archive {} {} to archive {} {}",
+				reference.symbol,
+				reference.series,
+				candidate.symbol,
+				candidate.series
+			);
+		}
+		std::vector<ColumnDivergence> divergences;
+		compare_daily_records(reference, candidate, divergences);
+		auto alignment = align_archives(reference, candidate, divergences);
+		if (alignment.times.empty())
+			return divergences;
+		for (const auto& column : intraday_columns) {
+			if (column.type == ColumnType::float32) {
+				auto reference_values = get_float_column(reference, alignment.reference_indexes, column.offset);
+				auto candidate_values = get_float_column(candidate, alignment.candidate_indexes, column.offset);
+				auto tolerance = static_cast<float>(options.get_tolerance(column.name));
+				auto mismatches = compare_floats(reference_values, candidate_values, tolerance);
+				if (mismatches.count == 0)
+					continue;
+				ColumnDivergence divergence{
+					.column = column.name,
+					.mismatches = mismatches.count,
+					.first_time = alignment.times[mismatches.first],
+					.reference_value = std::format("{}", reference_values[mismatches.first]),
+					.candidate_value = std::format("{}", candidate_values[mismatches.first]),
+				};
+				divergences.push_back(divergence);
+			} else {
+				auto reference_values = get_returns_column(reference, alignment.reference_indexes, column.offset);
+				auto candidate_values = get_returns_column(candidate, alignment.candidate_indexes, column.offset);
+				compare_returns_columns(column.name, reference_values, candidate_values, alignment, options, divergences);
+			}
+		}
+		std::vector<std::string> extra_columns = reference.extra_columns;
+		for (const auto& column : candidate.extra_columns) {
+			if (std::ranges::find(extra_columns, column) == extra_columns.end())
+				extra_columns.push_back(column);
+		}
+		for (const auto& column : extra_columns) {
+			auto reference_iterator = std::ranges::find(reference.extra_columns, column);
+			auto candidate_iterator = std::ranges::find(candidate.extra_columns, column);
+			if (reference_iterator == reference.extra_columns.end() || candidate_iterator == candidate.extra_columns.end()) {
+				bool in_reference = reference_iterator != reference.extra_columns.end();
+				ColumnDivergence divergence{
+					.column = column,
+					.mismatches = alignment.times.size(),
+					.first_time = alignment.times.front(),
+					.reference_value = in_reference ? "present" : "missing column",
+					.candidate_value = in_reference ? "missing column" : "present",
+				};
+				divergences.push_back(divergence);
+				continue;
+			}
+			std::size_t reference_column = reference_iterator - reference.extra_columns.begin();
+			std::size_t candidate_column = candidate_iterator - candidate.extra_columns.begin();
+			auto reference_values = get_extra_column(reference, alignment.reference_indexes, reference_column);
+			auto candidate_values = get_extra_column(candidate, alignment.candidate_indexes, candidate_column);
+			compare_returns_columns(column, reference_values, candidate_values, alignment, options, divergences);
+		}
+		return divergences;
+	}
+}
\ No newline at end of file
@@ -6,6 +6,14 @@
 #include <deque>
 #include <ranges>
 #include <cmath>
+#include <memory>
+#include <fstream>
+#include <set>
+#include <numeric>
+#include <limits>
+#include <tuple>
+#include <functional>
+#include <cstring>
 
 #pragma warning(push)
 #pragma warning(disable: 4267 4244)
@@ -19,16 +27,161 @@
 #include "confounding/configuration/filters.h"
 #include "confounding/common.h"
 #include "confounding/constants.h"
+#include "confounding/writer.h"
+#include "confounding/reader.h"
+#include "confounding/shard.h"
+#include "confounding/gzip.h"
+#include "confounding/index.h"
+#include "confounding/panel.h"
+#include "confounding/correlation.h"
+#include "confounding/metrics.h"
 
 namespace confounding {
 	namespace {
 		constexpr unsigned default_f_records_limit = 3;
-		constexpr unsigned hours_per_day = 24;
-		constexpr int intraday_max_holding_days = 3;
-		constexpr std::size_t recent_closes_window_size = 40;
-		constexpr std::size_t recent_returns_window_size = recent_closes_window_size;
+		constexpr std::size_t recent_closes_window_size = get_feature_closes_window();
+		constexpr std::size_t recent_returns_window_size = get_feature_returns_window();
+		constexpr auto feature_session_lags = get_feature_session_lags();
 		constexpr std::chrono::hours min_session_end_offset(8);
+		// Offset of the close that the intraday momentum features are relative to
+		constexpr std::chrono::hours feature_close_lag(8);
 		constexpr double close_minimum = 0.001;
+		constexpr std::chrono::days percentile_rank_window(40);
+
+		constexpr std::size_t correlation_windows[] = {10, 40};
+		constexpr const char* correlation_file = "correlations.bin";
+		constexpr const char* gzip_extension = ".gz";
+		// Rough ratio of the size of a Barchart CSV file to that of its gzip-compressed version, for the costs of the shards
+		constexpr uint64_t gzip_size_factor = 5;
+		constexpr uint64_t date_index_sample_interval = 64 * 1024;
+		// The 40 trading days required by the momentum/volatility features, including weekends and holidays
+		constexpr std::chrono::days date_index_warm_up(2 * recent_closes_window_size);
+
+		// Reads plain or gzip-compressed CSV files, optionally skipping a range of rows or building a date index on the way
+		class CsvByteSource : public io::ByteSourceBase {
+		public:
+			CsvByteSource(
+				const std::string& path,
+				uint64_t skip_offset,
+				uint64_t skip_size,
+				std::optional<DateIndexBuilder>&& index_builder
+			)
+				: _path(path),
+				_skip_offset(skip_offset),
+				_skip_size(skip_size),
+				_position(0),
+				_index_builder(std::move(index_builder)) {
+				// Compressed files are decompressed on the fly rather than extracting them to disk first
+				if (path.ends_with(gzip_extension)) {
+					_gzip_stream = std::make_unique<GzipStream>(path, skip_offset, skip_size);
+				} else {
+					_file.open(path, std::ios::binary);
+					if (!_file)
+						throw Exception("Failed to open file {}", path);
+				}
+			}
+
+			int read(char* buffer, int size) override {
+				int bytes;
+				if (_gzip_stream)
+					bytes = _gzip_stream->read(buffer, size);
+				else
+					bytes = read_file(buffer, size);
+				if (_index_builder) {
+					if (bytes > 0) {
+						_index_builder->update(buffer, bytes);
+					} else {
+						auto index = _index_builder->finish(get_file_fingerprint(_path));
+						if (index)
+							index->save(_path);
+						_index_builder.reset();
+					}
+				}
+				return bytes;
+			}
+
+		private:
+			std::string _path;
+			uint64_t _skip_offset;
+			uint64_t _skip_size;
+			uint64_t _position;
+			std::ifstream _file;
+			std::unique_ptr<GzipStream> _gzip_stream;
+			std::optional<DateIndexBuilder> _index_builder;
+
+			int read_file(char* buffer, int size) {
+				if (_skip_size > 0 && _position == _skip_offset) {
+					_position += _skip_size;
+					_skip_size = 0;
+					_file.seekg(static_cast<std::streamoff>(_position));
+				}
+				std::size_t read_size = static_cast<std::size_t>(size);
+				if (_skip_size > 0)
+					read_size = static_cast<std::size_t>(std::min<uint64_t>(read_size, _skip_offset - _position));
+				_file.read(buffer, static_cast<std::streamsize>(read_size));
+				auto bytes = _file.gcount();
+				if (_file.bad())
+					throw Exception("Failed to read file {}", _path);
+				_position += bytes;
+				return static_cast<int>(bytes);
+			}
+		};
+
+		// First date of the rows that are read with date_index enabled, nullopt if all rows are read
+		// The earlier rows are dropped even if the index doesn't exist yet so that the output doesn't depend on it
+		std::optional<Date> get_start_date() {
+			const auto& configuration = Configuration::get();
+			if (!configuration.date_index)
+				return std::nullopt;
+			return std::chrono::sys_days{configuration.reference_date} - date_index_warm_up;
+		}
+
+		template<unsigned column_count>
+		std::unique_ptr<io::CSVReader<column_count>> open_csv(const std::string& path, const std::string& date_column) {
+			std::unique_ptr<CsvByteSource> source;
+			auto start_date = get_start_date();
+			if (!start_date) {
+				// Full runs neither use nor create the indexes
+				source = std::make_unique<CsvByteSource>(path, 0, 0, std::nullopt);
+				return std::make_unique<io::CSVReader<column_count>>(path, std::move(source));
+			}
+			auto index = DateIndex::load(path);
+			if (index) {
+				// Keep the header line and seek straight to the first rows required by the run
+				uint64_t header_size = index->get_header_size();
+				uint64_t offset = index->get_offset(*start_date);
+				source = std::make_unique<CsvByteSource>(path, header_size, offset - header_size, std::nullopt);
+			} else {
+				DateIndexBuilder index_builder(date_column, date_index_sample_interval);
+				source = std::make_unique<CsvByteSource>(path, 0, 0, std::move(index_builder));
+			}
+			return std::make_unique<io::CSVReader<column_count>>(path, std::move(source));
+		}
+
+		// Intraday bars that start at or after the session end belong to the session of the following day
+		template<BarDuration Bar>
+		BarTime<Session> get_session_time(BarTime<Bar> time, TimeOfDay session_end) {
+			BarTime<Session> midnight = std::chrono::floor<Session>(time);
+			if (time - midnight >= session_end.to_duration())
+				return midnight + Session{1};
+			return midnight;
+		}
+
+		// The intraday bars of a contract are read in chronological order, so each one either extends the last derived bar or starts a new one
+		template<BarDuration Bar>
+		void add_derived_close(IntradayRecordMapT<Bar>& records, GlobexCode globex_code, BarTime<Bar> time, Money close) {
+			IntradayRecordsKey key(get_date<Bar>(time), globex_code);
+			auto& closes = records[key];
+			if (!closes.empty() && closes.back().time == time) {
+				closes.back().close = close;
+			} else {
+				IntradayCloseT<Bar> derived_close{
+					.time = time,
+					.close = close,
+				};
+				closes.push_back(derived_close);
+			}
+		}
 	}
 
 	IntradayRecordsKey::IntradayRecordsKey(Date date, GlobexCode globex_code)
@@ -37,17 +190,147 @@ namespace confounding {
 	}
 
 	bool IntradayRecordsKey::operator<(const IntradayRecordsKey& key) const {
-		return
-			date < key.date &&
-			globex_code < key.globex_code;
+		return std::tie(date, globex_code) < std::tie(key.date, key.globex_code);
+	}
+
+	void CONFOUNDING_API ArchiveGeneratorBase::parse_futures(std::optional<ShardSpecification> shard) {
+		switch (Configuration::get().bar_resolution) {
+			case BarResolution::h1:
+				ArchiveGeneratorT<H1>::run_pipeline(shard);
+				break;
+			case BarResolution::m30:
+				ArchiveGeneratorT<M30>::run_pipeline(shard);
+				break;
+			case BarResolution::m15:
+				ArchiveGeneratorT<M15>::run_pipeline(shard);
+				break;
+			case BarResolution::m5:
+				ArchiveGeneratorT<M5>::run_pipeline(shard);
+				break;
+			default:
+				throw Exception("Unable to generate archives from bars with a resolution of {}", get_bar_resolution_string(Configuration::get().bar_resolution));
+		}
+	}
+
+	void ArchiveGeneratorBase::merge_shards(unsigned shard_count) {
+		const auto& configuration = Configuration::get();
+		const auto& contract_configuration = ContractConfiguration::get();
+		const auto& filter_configuration = ContractFilterConfiguration::get();
+		auto start = std::chrono::steady_clock::now();
+		reset_metrics();
+		set_trace_counters(configuration.trace_path.has_value() && configuration.trace_counters);
+		if (shard_count == 0)
+			throw Exception("Invalid shard count: {}", shard_count);
+		auto bar_names = get_bar_names();
+		// All shards are validated before anything is moved so that a failed merge can be repeated once the affected shards have been rerun
+		std::map<std::string, Path> symbol_directories;
+		std::map<std::string, std::vector<ManifestArchive>> symbol_archives;
+		std::map<std::string, DailyReturns> symbol_returns;
+		for (unsigned index = 1; index <= shard_count; index++) {
+			ShardSpecification shard{
+				.index = index,
+				.count = shard_count,
+			};
+			Path directory = get_shard_directory(shard);
+			Path manifest_path = directory / manifest_file;
+			if (!std::filesystem::exists(manifest_path))
+				throw Exception("Shard {} of {} hasn't finished, {} is missing", index, shard_count, manifest_path.string());
+			auto manifest = ArchiveManifest::load(manifest_path.string());
+			if (manifest.shard.index != index || manifest.shard.count != shard_count)
+				throw Exception("Manifest {} belongs to shard {} of {}", manifest_path.string(), manifest.shard.index, manifest.shard.count);
+			if (manifest.bar_resolution != configuration.bar_resolution || manifest.reference_date != configuration.reference_date)
+				throw Exception("Shard {} of {} was generated with a different configuration", index, shard_count);
+			auto shard_returns = read_daily_returns((directory / daily_returns_file).string());
+			for (const auto& symbol : manifest.symbols) {
+				if (symbol_directories.contains(symbol))
+					throw Exception("Symbol {} was assigned to more than one shard", symbol);
+				auto returns_iterator = shard_returns.find(symbol);
+				if (returns_iterator == shard_returns.end())
+					throw Exception("The daily returns of shard {} of {} lack symbol {}", index, shard_count, symbol);
+				symbol_directories[symbol] = directory;
+				symbol_archives[symbol] = {};
+				symbol_returns[symbol] = std::move(returns_iterator->second);
+			}
+			for (const auto& archive : manifest.archives) {
+				auto iterator = symbol_directories.find(archive.symbol);
+				if (iterator == symbol_directories.end() || iterator->second != directory)
+					throw Exception("Archive {} of shard {} of {} belongs to symbol {}, which wasn't assigned to it", archive.file, index, shard_count, archive.symbol);
+				bool expected_file = std::ranges::any_of(bar_names, [&](const std::string& bar_name) {
+					return archive.file == get_archive_file(archive.symbol, archive.series, bar_name);
+				});
+				if (!expected_file)
+					throw Exception("Unexpected archive {} in shard {} of {}", archive.file, index, shard_count);
+				Path path = directory / archive.file;
+				std::error_code error;
+				auto size = std::filesystem::file_size(path, error);
+				if (error || size != archive.size)
+					throw Exception("Archive {} is missing or doesn't match the size in the manifest", path.string());
+				ArchiveReader reader(path.string());
+				const auto& header = reader.get_header();
+				std::string symbol(header.symbol, strnlen(header.symbol, archive_symbol_size));
+				std::string series(header.series, strnlen(header.series, archive_series_size));
+				if (symbol != archive.symbol || series != archive.series)
+					throw Exception("Archive {} contains {} {} rather than {} {}", path.string(), symbol, series, archive.symbol, archive.series);
+				symbol_archives[archive.symbol].push_back(archive);
+			}
+		}
+		// Each contract must have been processed by exactly one shard, with all of its series
+		ArchiveManifest merged{
+			.shard = ShardSpecification{
+				.index = 1,
+				.count = 1,
+			},
+			.bar_resolution = configuration.bar_resolution,
+			.reference_date = configuration.reference_date,
+		};
+		for (const auto& contract : contract_configuration) {
+			auto iterator = symbol_archives.find(contract.symbol);
+			if (iterator == symbol_archives.end())
+				throw Exception("Symbol {} wasn't assigned to any of the {} shards", contract.symbol, shard_count);
+			const auto& archives = iterator->second;
+			const auto& filter = filter_configuration.get_filter(contract.symbol);
+			for (const auto& bar_name : bar_names) {
+				for (const auto& series : get_series(filter)) {
+					std::string file = get_archive_file(contract.symbol, series, bar_name);
+					auto archive_iterator = std::ranges::find(archives, file, &ManifestArchive::file);
+					if (archive_iterator == archives.end())
+						throw Exception("The shards lack the archive {}", file);
+				}
+			}
+			merged.symbols.push_back(contract.symbol);
+			std::ranges::copy(archives, std::back_inserter(merged.archives));
+		}
+		if (symbol_archives.size() != merged.symbols.size())
+			throw Exception("The shards contain symbols that are missing from the contract configuration");
+		Path archive_directory = configuration.archive_directory;
+		for (const auto& archive : merged.archives)
+			std::filesystem::rename(symbol_directories[archive.symbol] / archive.file, archive_directory / archive.file);
+		if (configuration.bar_resolution == BarResolution::h1)
+			build_panels();
+		std::vector<DailyReturns> daily_returns;
+		for (const auto& symbol : merged.symbols)
+			daily_returns.push_back(std::move(symbol_returns[symbol]));
+		build_correlations(merged.symbols, daily_returns);
+		merged.save((archive_directory / manifest_file).string());
+		for (unsigned index = 1; index <= shard_count; index++) {
+			ShardSpecification shard{
+				.index = index,
+				.count = shard_count,
+			};
+			std::filesystem::remove_all(get_shard_directory(shard));
+		}
+		write_metrics(configuration.metrics_path, std::chrono::steady_clock::now() - start);
+		if (configuration.trace_path)
+			write_trace(*configuration.trace_path);
 	}
 
-	ArchiveGenerator::ArchiveGenerator(
+	template<BarDuration Bar>
+	ArchiveGeneratorT<Bar>::ArchiveGeneratorT(
 		std::optional<unsigned> f_number,
 		bool fy_record,
 		const std::string& symbol,
 		const GlobexRecordMap& daily_records,
-		const IntradayRecordMap& intraday_records,
+		const IntradayRecordMapT<Bar>& intraday_records,
 		const ContractFilter& filter,
 		const Contract& contract
 	)
@@ -57,136 +340,279 @@ namespace confounding {
 		_daily_records(daily_records),
 		_intraday_records(intraday_records),
 		_filter(filter),
-		_contract(contract) {
+		_contract(contract),
+		_record_count(0) {
+		for (std::size_t i = 0; i < feature_count; i++)
+			_feature_ranks.emplace_back(percentile_rank_window);
+		const auto& configuration = Configuration::get();
+		for (const auto& [column, window] : configuration.normalization_windows) {
+			std::size_t feature = get_feature_index(column);
+			if (feature == feature_count)
+				throw Exception("Unable to normalize unknown feature {}", column);
+			FeatureNormalization normalization{
+				.feature = feature,
+				.z_score = RollingZScore(window)
+			};
+			_normalizations.push_back(normalization);
+		}
+		_max_holding_days = configuration.max_holding_days;
+		_return_horizons = configuration.return_horizons;
+		_barriers = configuration.barriers;
+		_barrier_horizon = configuration.barrier_horizon;
+		for (auto horizon : _return_horizons)
+			_archive.extra_columns.push_back(std::format("returns_{}h", horizon.count()));
+		for (const auto& barrier : _barriers) {
+			_archive.extra_columns.push_back(std::format("tp{}_sl{}_returns", barrier.take_profit, barrier.stop_loss));
+			_archive.extra_columns.push_back(std::format("tp{}_sl{}_exit", barrier.take_profit, barrier.stop_loss));
+		}
+		_archive.symbol = symbol;
+		if (f_number)
+			_archive.series = std::format("F{}", *f_number);
+		else
+			_archive.series = "FY";
 	}
 
-	void CONFOUNDING_API ArchiveGenerator::parse_futures() {
+	template<BarDuration Bar>
+	void ArchiveGeneratorT<Bar>::run_pipeline(std::optional<ShardSpecification> shard) {
+		const auto& configuration = Configuration::get();
 		const auto& contract_configuration = ContractConfiguration::get();
+		auto start = std::chrono::steady_clock::now();
+		reset_metrics();
+		set_trace_counters(configuration.trace_path.has_value() && configuration.trace_counters);
+		Path directory = configuration.archive_directory;
+		Path metrics_path = configuration.metrics_path;
+		std::optional<Path> trace_path;
+		if (configuration.trace_path)
+			trace_path = *configuration.trace_path;
+		std::vector<const Contract*> contracts;
+		if (shard) {
+			directory = get_shard_directory(*shard);
+			std::filesystem::create_directories(directory);
+			// The manifest of a previous attempt would mark the shard as finished while it's still being regenerated
+			std::filesystem::remove(directory / manifest_file);
+			// The shards may share a file system, keep their metrics apart
+			metrics_path = directory / metrics_path.filename();
+			if (trace_path)
+				trace_path = directory / trace_path->filename();
+			auto symbols = get_shard_symbols(*shard, get_bar_name<Bar>());
+			for (const auto& contract : contract_configuration) {
+				if (std::ranges::find(symbols, contract.symbol) != symbols.end())
+					contracts.push_back(&contract);
+			}
+		} else {
+			for (const auto& contract : contract_configuration)
+				contracts.push_back(&contract);
+		}
+		std::vector<std::vector<ManifestArchive>> contract_archives(contracts.size());
+		std::vector<DailyReturns> contract_returns(contracts.size());
+		std::vector<std::size_t> indexes(contracts.size());
+		std::iota(indexes.begin(), indexes.end(), 0);
+		// Archives are written in the background so that the workers can move on to the next contract right away
+		AsyncFileWriter output(configuration.archive_writer_threads, configuration.archive_writer_memory * 1024 * 1024);
 		std::for_each(
 			std::execution::par,
-			contract_configuration.begin(),
-			contract_configuration.end(),
-			&parse_single_contract
+			indexes.begin(),
+			indexes.end(),
+			[&](std::size_t i) {
+				contract_archives[i] = parse_single_contract(*contracts[i], directory.string(), output, contract_returns[i]);
+			}
 		);
+		output.flush();
+		ArchiveManifest manifest{
+			.shard = shard.value_or(ShardSpecification{.index = 1, .count = 1}),
+			.bar_resolution = configuration.bar_resolution,
+			.reference_date = configuration.reference_date,
+		};
+		for (std::size_t i = 0; i < contracts.size(); i++) {
+			manifest.symbols.push_back(contracts[i]->symbol);
+			std::ranges::copy(contract_archives[i], std::back_inserter(manifest.archives));
+		}
+		if (shard) {
+			write_daily_returns((directory / daily_returns_file).string(), manifest.symbols, contract_returns);
+		} else {
+			// The panels are aligned to the hourly timestamps of the H1 archives
+			if constexpr (std::same_as<Bar, H1>)
+				build_panels();
+			build_correlations(manifest.symbols, contract_returns);
+		}
+		manifest.save((directory / manifest_file).string());
+		write_metrics(metrics_path.string(), std::chrono::steady_clock::now() - start);
+		if (trace_path)
+			write_trace(trace_path->string());
+	}
+
+	template<BarDuration Bar>
+	ManifestArchive ArchiveGeneratorT<Bar>::run(const std::string& directory, AsyncFileWriter& output) {
+		const auto& configuration = Configuration::get();
+		MetricsKey metrics_key{
+			.symbol = _archive.symbol,
+			.series = _archive.series,
+		};
+		build_archive();
+		std::vector<char> buffer;
+		{
+			// The CPU time and allocations of the parallel block compression on other threads aren't included
+			StageTimer timer(PipelineStage::encode, metrics_key);
+			ArchiveWriterT<Bar> writer(_archive, configuration.archive_options);
+			buffer = writer.release();
+			timer.add_rows(_archive.intraday_records.size());
+			timer.add_bytes(buffer.size());
+		}
+		ManifestArchive archive{
+			.symbol = _archive.symbol,
+			.series = _archive.series,
+			.file = get_archive_file(_archive.symbol, _archive.series, get_bar_name<Bar>()),
+			.size = buffer.size(),
+		};
+		StageTimer timer(PipelineStage::output_wait, metrics_key);
+		output.submit((Path(directory) / archive.file).string(), std::move(buffer), metrics_key);
+		return archive;
 	}
 
-	void ArchiveGenerator::run() {
-		// Allocate more memory than necessary for the H1 intraday records without shrinking them
+	template<BarDuration Bar>
+	const ArchiveT<Bar>& ArchiveGeneratorT<Bar>::build_archive() {
+		// Allocate more memory than necessary for the intraday records without shrinking them
 		// at the end of the function because the archive will be freed anyway
-		_archive.daily_records.reserve(_daily_records.size());
 		const auto& last_date = _daily_records.rbegin()->first;
 		const auto& configuration = Configuration::get();
-		auto reference_date = configuration.reference_date;
-		auto days1 = std::chrono::sys_days{reference_date};
+		auto days1 = std::chrono::sys_days{configuration.reference_date};
 		auto days2 = std::chrono::sys_days{last_date};
 		std::chrono::days days_diff = days2 - days1;
-		std::size_t daily_records_reserve = days_diff.count();
-		std::size_t intraday_records_reserve = hours_per_day * daily_records_reserve;
-		_raw_intraday_records.reserve(intraday_records_reserve);
-		std::map<Date, GlobexRecord> selected_daily_records;
-		auto add_nan_records = [&]() {
-			for (unsigned i = 0; i < hours_per_day; i++) {
-				Time time = get_time(reference_date) + std::chrono::hours{i};
-				add_nan_record(time);
-			}
-		};
+		std::size_t intraday_records_reserve = bars_per_day<Bar> * days_diff.count();
+		_archive.daily_records.reserve(_daily_records.size());
+		_archive.intraday_timestamps.reserve(intraday_records_reserve);
+		_archive.intraday_records.reserve(intraday_records_reserve);
+		StageTimer timer(PipelineStage::generate, {.symbol = _archive.symbol, .series = _archive.series});
+		for (const auto& chunk : generate())
+			_archive.append(chunk);
+		uint64_t nan_records = 0;
+		for (const auto& run : _archive.invalid_runs)
+			nan_records += run.length;
+		timer.add_rows(_archive.intraday_records.size());
+		timer.add_nan_records(nan_records);
+		return _archive;
+	}
+
+	template<BarDuration Bar>
+	std::generator<const ArchiveChunkT<Bar>&> ArchiveGeneratorT<Bar>::generate() {
+		const auto& last_date = _daily_records.rbegin()->first;
+		const auto& configuration = Configuration::get();
+		auto reference_date = configuration.reference_date;
 		for (; reference_date <= last_date; add_day(reference_date)) {
-			// Health check
-			if (_raw_intraday_records.size() % hours_per_day != 0)
-				throw Exception("Invalid number of records in raw_intraday_records: {}", _raw_intraday_records.size());
 			auto weekday = std::chrono::weekday{reference_date};
 			if (weekday == std::chrono::Saturday || weekday == std::chrono::Sunday) {
 				// Skipping weekends like this isn't entirely correct since CME futures actually do have intraday records
 				// for Sundays but they're on the low liquidity side so it shouldn't hurt much
 				continue;
 			}
-			bool success = get_globex_records(reference_date);
-			if (!success) {
-				add_nan_records();
-				continue;
-			}
-			success = get_intraday_closes();
-			if (!success) {
-				add_nan_records();
-				continue;
-			}
-			Time reference_time = get_time(reference_date);
-			for (const auto& record : _today_closes) {
-				while (reference_time < record.time) {
-					// Fill the gaps in the intraday data with NaN records
-					add_nan_record(reference_time);
-					reference_time += std::chrono::hours{1};
-				}
-				generate_intraday_record(record);
+			_chunk.date = reference_date;
+			process_day(reference_date);
+			if (!_chunk.empty()) {
+				co_yield _chunk;
+				_chunk.clear();
 			}
 		}
-		if (_archive.intraday_timestamps.size() != _archive.intraday_records.size()) {
-			throw Exception(
-				"Number of intraday timestamps ({}) doesn't match number of intraday records ({})",
-				_archive.intraday_timestamps.size(),
-				_archive.intraday_records.size()
-			);
+	}
+
+	template<BarDuration Bar>
+	void ArchiveGeneratorT<Bar>::process_day(Date reference_date) {
+		_entry_closes.clear();
+		bool success = get_globex_records(reference_date);
+		if (!success) {
+			add_nan_run(get_time<Bar>(reference_date), bars_per_day<Bar>);
+			return;
 		}
-		throw Exception("Not implemented: archive output");
+		success = get_intraday_closes();
+		if (!success) {
+			add_nan_run(get_time<Bar>(reference_date), bars_per_day<Bar>);
+			return;
+		}
+		BarTime<Bar> reference_time = get_time<Bar>(reference_date);
+		for (const auto& record : _today_closes) {
+			if (reference_time < record.time) {
+				// Fill the gaps in the intraday data with NaN records
+				auto gap = record.time - reference_time;
+				add_nan_run(reference_time, static_cast<uint32_t>(gap.count()));
+			}
+			generate_intraday_record(record);
+			reference_time = record.time + Bar{1};
+		}
+		get_forward_returns();
 	}
 
-	void ArchiveGenerator::parse_single_contract(const Contract& contract) {
+	template<BarDuration Bar>
+	std::vector<ManifestArchive> ArchiveGeneratorT<Bar>::parse_single_contract(
+		const Contract& contract,
+		const std::string& directory,
+		AsyncFileWriter& output,
+		DailyReturns& daily_returns
+	) {
 		const std::string& symbol = contract.symbol;
 		const auto& filter_configuration = ContractFilterConfiguration::get();
 		const auto& filter = filter_configuration.get_filter(symbol);
-		const auto& contract_configuration = ContractConfiguration::get();
 		auto daily_records = read_daily_records(symbol, filter);
-		auto intraday_records = read_intraday_records(symbol, filter);
-		unsigned f_number_limit = default_f_records_limit;
-		if (filter.f_records_limit)
-			f_number_limit = *filter.f_records_limit;
-		for (unsigned f_number = 1; f_number <= f_number_limit; f_number++) {
-			ArchiveGenerator generator(
-				f_number,
-				false,
-				symbol,
-				daily_records,
-				intraday_records,
-				filter,
-				contract
-			);
-			generator.run();
-		}
-		if (filter.enable_fy_records) {
-			ArchiveGenerator generator(
-				std::nullopt,
-				true,
-				symbol,
-				daily_records,
-				intraday_records,
-				filter,
-				contract
-			);
-			generator.run();
+		daily_returns = get_daily_returns(daily_records);
+		const auto& configuration = Configuration::get();
+		DerivedIntradayRecords derived_records;
+		for (BarResolution resolution : configuration.derived_bars) {
+			if (resolution == BarResolution::h4)
+				derived_records.h4.emplace();
+			else if (resolution == BarResolution::session)
+				derived_records.session.emplace();
 		}
-		throw Exception("Not implemented: missing intraday data");
+		auto intraday_records = read_intraday_records(symbol, filter, &derived_records);
+		std::vector<ManifestArchive> archives;
+		auto generate_archives = [&]<BarDuration Output>(const IntradayRecordMapT<Output>& records) {
+			for (const auto& series : get_series(filter)) {
+				auto f_number = get_f_number(series);
+				ArchiveGeneratorT<Output> generator(
+					f_number,
+					!f_number.has_value(),
+					symbol,
+					daily_records,
+					records,
+					filter,
+					contract
+				);
+				archives.push_back(generator.run(directory, output));
+			}
+		};
+		generate_archives(intraday_records);
+		for (BarResolution resolution : configuration.derived_bars) {
+			if (resolution == BarResolution::h4)
+				generate_archives(*derived_records.h4);
+			else if (resolution == BarResolution::session)
+				generate_archives(*derived_records.session);
+		}
+		return archives;
 	}
 
-	GlobexRecordMap ArchiveGenerator::read_daily_records(const std::string& symbol, const ContractFilter& filter) {
+	GlobexRecordMap ArchiveGeneratorBase::read_daily_records(const std::string& symbol, const ContractFilter& filter) {
+		StageTimer timer(PipelineStage::read_daily_records, {.symbol = symbol});
 		const std::string& path = get_symbol_path(symbol, "D1");
-		io::CSVReader<4> csv(path);
-		csv.read_header(io::ignore_extra_column, "symbol", "time", "close", "open_interest");
+		auto csv = open_csv<4>(path, "time");
+		auto start_date = get_start_date();
+		csv->read_header(io::ignore_extra_column, "symbol", "time", "close", "open_interest");
 		GlobexRecord record;
 		std::string globex_string;
 		std::string date_string;
 		std::string close_string;
 		GlobexRecordMap daily_records;
 		auto read_row = [&]() {
-			return csv.read_row(
+			return csv->read_row(
 				globex_string,
 				date_string,
 				close_string,
 				record.open_interest
 			);
 		};
+		uint64_t rows = 0;
 		while (read_row()) {
+			rows++;
 			record.globex_code = GlobexCode(globex_string);
 			record.date = get_date(date_string);
+			if (start_date && record.date < *start_date)
+				continue;
 			record.close = Money(close_string);
 			// Only include contracts that are sufficiently liquid and feature volume/open interest data
 			// Most Barchart futures data from prior to 2006 has to be filtered out
@@ -202,33 +628,47 @@ namespace confounding {
 				}
 			);
 		}
+		timer.add_rows(rows);
 		return std::move(daily_records);
 	}
 
-	IntradayRecordMap ArchiveGenerator::read_intraday_records(const std::string& symbol, const ContractFilter& filter) {
-		const std::string& path = get_symbol_path(symbol, "H1");
-		io::CSVReader<3> csv(path);
-		csv.read_header(io::ignore_extra_column, "symbol", "time", "close");
-		IntradayClose record;
+	template<BarDuration Bar>
+	IntradayRecordMapT<Bar> ArchiveGeneratorT<Bar>::read_intraday_records(
+		const std::string& symbol,
+		const ContractFilter& filter,
+		DerivedIntradayRecords* derived_records
+	) {
+		StageTimer timer(PipelineStage::read_intraday_records, {.symbol = symbol});
+		const std::string& path = get_symbol_path(symbol, get_bar_name<Bar>());
+		auto csv = open_csv<3>(path, "time");
+		std::optional<BarTime<Bar>> start_time;
+		if (auto start_date = get_start_date())
+			start_time = std::chrono::local_days{*start_date};
+		csv->read_header(io::ignore_extra_column, "symbol", "time", "close");
+		IntradayCloseT<Bar> record;
 		std::string globex_string;
 		std::string time_string;
 		std::string close_string;
-		IntradayRecordMap intraday_records;
+		IntradayRecordMapT<Bar> intraday_records;
 		auto liquid_hours_start = filter.liquid_hours_start;
 		auto liquid_hours_end = filter.liquid_hours_end;
 		auto read_row = [&]() {
-			return csv.read_row(
+			return csv->read_row(
 				globex_string,
 				time_string,
 				close_string
 			);
 		};
+		uint64_t rows = 0;
 		while (read_row()) {
+			rows++;
 			GlobexCode globex_code = globex_string;
-			record.time = get_time(time_string);
+			record.time = get_time<Bar>(time_string);
+			if (start_time && record.time < *start_time)
+				continue;
 			record.close = Money(close_string);
 			auto midnight = std::chrono::floor<std::chrono::days>(record.time);
-			auto hours_since_midnight = record.time - midnight;
+			auto time_since_midnight = record.time - midnight;
 			bool add;
 			if (liquid_hours_start.has_value() && liquid_hours_end.has_value()) {
 				auto start_duration = liquid_hours_start->to_duration();
@@ -236,8 +676,8 @@ namespace confounding {
 				if (start_duration > end_duration)
 					std::swap(start_duration, end_duration);
 				add =
-					hours_since_midnight >= start_duration &&
-					hours_since_midnight < end_duration;
+					time_since_midnight >= start_duration &&
+					time_since_midnight < end_duration;
 			} else {
 				add = true;
 			}
@@ -245,20 +685,190 @@ namespace confounding {
 				Date date = get_date(record.time);
 				IntradayRecordsKey key(date, globex_code);
 				intraday_records[key].push_back(record);
+				if (derived_records != nullptr) {
+					if (derived_records->h4)
+						add_derived_close(*derived_records->h4, globex_code, std::chrono::floor<H4>(record.time), record.close);
+					if (derived_records->session)
+						add_derived_close(*derived_records->session, globex_code, get_session_time(record.time, filter.session_end), record.close);
+				}
 			}
 		}
+		timer.add_rows(rows);
 		return std::move(intraday_records);
 	}
 
-	std::string ArchiveGenerator::get_symbol_path(const std::string& symbol, const std::string& suffix) {
+	std::string ArchiveGeneratorBase::get_symbol_path(const std::string& symbol, const std::string& suffix) {
 		const auto& configuration = Configuration::get();
 		Path barchart_path = configuration.barchart_directory;
 		Path filename = std::format("{}.{}.csv", symbol, suffix);
 		Path path = barchart_path / filename;
+		if (!std::filesystem::exists(path)) {
+			// Fall back to the gzip-compressed version of the file
+			Path compressed_path = path;
+			compressed_path += gzip_extension;
+			if (std::filesystem::exists(compressed_path))
+				return compressed_path.string();
+		}
 		return path.string();
 	}
 
-	bool ArchiveGenerator::get_globex_records(Date reference_date) {
+	std::optional<unsigned> ArchiveGeneratorBase::get_f_number(const std::string& series) {
+		if (series == "FY")
+			return std::nullopt;
+		if (!series.starts_with("F"))
+			throw Exception("Invalid archive series: {}", series);
+		return get_number<unsigned>(series.substr(1));
+	}
+
+	void ArchiveGeneratorBase::build_panels() {
+		StageTimer timer(PipelineStage::build_panels, {});
+		const auto& contract_configuration = ContractConfiguration::get();
+		const auto& filter_configuration = ContractFilterConfiguration::get();
+		std::map<std::string, std::vector<std::string>> series_archives;
+		for (const auto& contract : contract_configuration) {
+			const std::string& symbol = contract.symbol;
+			const auto& filter = filter_configuration.get_filter(symbol);
+			for (const auto& series : get_series(filter))
+				series_archives[series].push_back(get_archive_path(symbol, series, get_bar_name<H1>()));
+		}
+		// The panels are built one at a time since each one holds the intraday data of all symbols in memory
+		for (const auto& [series, archive_paths] : series_archives) {
+			PanelWriter writer(series, archive_paths);
+			writer.write(get_panel_path(series));
+		}
+	}
+
+	void ArchiveGeneratorBase::build_correlations(const std::vector<std::string>& symbols, const std::vector<DailyReturns>& daily_returns) {
+		StageTimer timer(PipelineStage::build_correlations, {});
+		std::set<Date> date_set;
+		for (const auto& symbol_returns : daily_returns) {
+			for (const auto& [date, _] : symbol_returns)
+				date_set.insert(date);
+		}
+		std::vector<Date> dates(date_set.begin(), date_set.end());
+		std::vector<double> returns(dates.size() * symbols.size(), std::numeric_limits<double>::quiet_NaN());
+		for (std::size_t s = 0; s < symbols.size(); s++) {
+			auto date_iterator = dates.begin();
+			for (const auto& [date, symbol_returns] : daily_returns[s]) {
+				date_iterator = std::lower_bound(date_iterator, dates.end(), date);
+				std::size_t date_index = date_iterator - dates.begin();
+				returns[date_index * symbols.size() + s] = symbol_returns;
+			}
+		}
+		CorrelationEngine engine(symbols, dates, std::move(returns));
+		std::vector<CorrelationMatrices> matrices;
+		for (std::size_t window : correlation_windows)
+			matrices.push_back(engine.compute(window));
+		const auto& configuration = Configuration::get();
+		Path path = Path(configuration.archive_directory) / correlation_file;
+		engine.write(path.string(), matrices);
+	}
+
+	DailyReturns ArchiveGeneratorBase::get_daily_returns(const GlobexRecordMap& daily_records) {
+		DailyReturns daily_returns;
+		const std::vector<GlobexRecord>* previous_records = nullptr;
+		for (const auto& [date, today_records] : daily_records) {
+			double returns = std::numeric_limits<double>::quiet_NaN();
+			const auto& today = today_records.front();
+			if (previous_records != nullptr) {
+				auto previous = std::find_if(
+					previous_records->begin(),
+					previous_records->end(),
+					[&](const GlobexRecord& record) {
+						return record.globex_code == today.globex_code;
+					}
+				);
+				if (previous != previous_records->end()) {
+					double close1 = today.close.to_double();
+					double close2 = previous->close.to_double();
+					if (close1 > close_minimum && close2 > close_minimum)
+						returns = get_rate_of_change(close1, close2);
+				}
+			}
+			daily_returns[date] = returns;
+			previous_records = &today_records;
+		}
+		return daily_returns;
+	}
+
+	std::vector<std::string> ArchiveGeneratorBase::get_series(const ContractFilter& filter) {
+		std::vector<std::string> series;
+		unsigned f_number_limit = default_f_records_limit;
+		if (filter.f_records_limit)
+			f_number_limit = *filter.f_records_limit;
+		for (unsigned f_number = 1; f_number <= f_number_limit; f_number++)
+			series.push_back(std::format("F{}", f_number));
+		if (filter.enable_fy_records)
+			series.push_back("FY");
+		return series;
+	}
+
+	std::vector<std::string> ArchiveGeneratorBase::get_bar_names() {
+		const auto& configuration = Configuration::get();
+		std::vector<std::string> bar_names;
+		bar_names.push_back(get_bar_resolution_string(configuration.bar_resolution));
+		for (BarResolution resolution : configuration.derived_bars)
+			bar_names.push_back(get_bar_resolution_string(resolution));
+		return bar_names;
+	}
+
+	std::vector<std::string> ArchiveGeneratorBase::get_shard_symbols(ShardSpecification shard, const std::string& bar_name) {
+		const auto& contract_configuration = ContractConfiguration::get();
+		const auto& filter_configuration = ContractFilterConfiguration::get();
+		std::vector<std::pair<uint64_t, std::string>> costs;
+		for (const auto& contract : contract_configuration) {
+			const auto& filter = filter_configuration.get_filter(contract.symbol);
+			uint64_t input_size = 0;
+			for (const auto& suffix : {std::string("D1"), bar_name}) {
+				std::string path = get_symbol_path(contract.symbol, suffix);
+				std::error_code error;
+				uint64_t size = std::filesystem::file_size(path, error);
+				// Missing files are reported by the shard that the contract ends up in
+				if (error)
+					continue;
+				if (path.ends_with(gzip_extension))
+					size *= gzip_size_factor;
+				input_size += size;
+			}
+			costs.emplace_back(input_size * get_series(filter).size(), contract.symbol);
+		}
+		// Contracts with equal costs are ordered by symbol so that the order of the configuration doesn't matter
+		std::ranges::sort(costs, std::greater<>());
+		std::vector<uint64_t> shard_costs(shard.count, 0);
+		std::vector<std::string> symbols;
+		for (const auto& [cost, symbol] : costs) {
+			auto iterator = std::ranges::min_element(shard_costs);
+			*iterator += cost;
+			if (static_cast<unsigned>(iterator - shard_costs.begin()) + 1 == shard.index)
+				symbols.push_back(symbol);
+		}
+		return symbols;
+	}
+
+	std::string ArchiveGeneratorBase::get_archive_file(const std::string& symbol, const std::string& series, const std::string& bar_name) {
+		if (bar_name == get_bar_name<H1>())
+			return std::format("{}.{}.archive", symbol, series);
+		else
+			return std::format("{}.{}.{}.archive", symbol, series, bar_name);
+	}
+
+	std::string ArchiveGeneratorBase::get_archive_path(const std::string& symbol, const std::string& series, const std::string& bar_name) {
+		const auto& configuration = Configuration::get();
+		Path archive_path = configuration.archive_directory;
+		Path path = archive_path / get_archive_file(symbol, series, bar_name);
+		return path.string();
+	}
+
+	std::string ArchiveGeneratorBase::get_panel_path(const std::string& series) {
+		const auto& configuration = Configuration::get();
+		Path archive_path = configuration.archive_directory;
+		Path filename = std::format("{}.panel", series);
+		Path path = archive_path / filename;
+		return path.string();
+	}
+
+	template<BarDuration Bar>
+	bool ArchiveGeneratorT<Bar>::get_globex_records(Date reference_date) {
 		auto daily_iterator = _daily_records.find(reference_date);
 		if (daily_iterator == _daily_records.end()) {
 			// Could be a holiday, return nullopt to generate NaN records
@@ -267,10 +877,22 @@ namespace confounding {
 		const auto& [date, records] = *daily_iterator;
 		GlobexRecord today = get_daily_globex_record(date, records);
 		update_recent_closes(today);
+		DailyRecord daily_record{
+			.date = today.date,
+			.close = today.close
+		};
+		_chunk.daily_record = daily_record;
 		daily_iterator++;
+		if (daily_iterator == _daily_records.end()) {
+			// The returns of the last day can't be calculated yet
+			return false;
+		}
 		const auto& [tomorrow_date, tomorrow_records] = *daily_iterator;
 		GlobexRecord tomorrow = get_daily_globex_record(tomorrow_date, tomorrow_records);
-		if (_recent_closes.size() < recent_closes_window_size) {
+		if (
+			_recent_closes.size() < recent_closes_window_size ||
+			_recent_returns.size() < recent_returns_window_size
+		) {
 			// Can't calculate all momentum/volatility features yet, generate NaN records
 			return false;
 		}
@@ -279,7 +901,8 @@ namespace confounding {
 		return true;
 	}
 
-	GlobexRecord ArchiveGenerator::get_daily_globex_record(Date date, const std::vector<GlobexRecord>& records) {
+	template<BarDuration Bar>
+	GlobexRecord ArchiveGeneratorT<Bar>::get_daily_globex_record(Date date, const std::vector<GlobexRecord>& records) {
 		GlobexRecord daily_globex_record;
 		if (_f_number) {
 			std::size_t index = static_cast<std::size_t>(*_f_number) - 1;
@@ -302,44 +925,59 @@ namespace confounding {
 				});
 			if (iterator == records.end())
 				throw Exception("Symbol {} lacks a daily FY record at {}", _symbol, get_date_string(date));
-			DailyRecord daily_record{
-				.date = daily_globex_record.date,
-				.close = daily_globex_record.close
-			};
 			daily_globex_record = *iterator;
-			_archive.daily_records.push_back(daily_record);
 		}
 		return daily_globex_record;
 	}
 
-	bool ArchiveGenerator::get_intraday_closes() {
+	template<BarDuration Bar>
+	bool ArchiveGeneratorT<Bar>::get_intraday_closes() {
 		IntradayRecordsKey key(_globex_today.date, _globex_today.globex_code);
 		auto intraday_iterator = _intraday_records.find(key);
-		if (
-			intraday_iterator == _intraday_records.begin() ||
-			intraday_iterator == _intraday_records.end()
-		) {
+		if (intraday_iterator == _intraday_records.end()) {
 			// There are typically fewer intraday records than daily records available anyway, skip it
 			return false;
 		}
-		// Collect local intraday closes around the day we are currently processing,
-		// in a period ranging from the previous day to three days after today
+		// The trading sessions are the dates of the daily records, the returns are indexed by them so that weekends and holidays are skipped
+		// Returns with holding periods that extend beyond the end of the data are invalid
+		auto daily_iterator = _daily_records.find(_globex_today.date);
+		Date first_date = daily_iterator == _daily_records.begin() ? _globex_today.date : std::prev(daily_iterator)->first;
+		_session_dates.clear();
+		for (auto iterator = std::next(daily_iterator); iterator != _daily_records.end() && _session_dates.size() < _max_holding_days; iterator++)
+			_session_dates.push_back(iterator->first);
+		Date last_date = _session_dates.empty() ? _globex_today.date : _session_dates.back();
+		// Collect local intraday closes of the same contract around the day we are currently processing,
+		// in a period ranging from the previous session to max_holding_days sessions after today
+		// Neighbouring keys of the map may belong to other contracts, so each date is looked up separately
 		_today_closes = intraday_iterator->second;
-		std::size_t intraday_closes_reserve = (intraday_max_holding_days + 1) * hours_per_day;
+		std::size_t intraday_closes_reserve = (_max_holding_days + 2) * bars_per_day<Bar>;
 		_intraday_closes.reserve(intraday_closes_reserve);
 		_intraday_closes.clear();
-		intraday_iterator--;
-		for (int i = -1; i < intraday_max_holding_days; i++) {
-			if (intraday_iterator == _intraday_records.end())
-				throw Exception("Unable to calculate all returns for symbol {} at {} due to missing data", _symbol, get_date_string(_globex_today.date));
-			const auto& records = intraday_iterator->second;
+		std::chrono::sys_days last_day{ last_date };
+		for (std::chrono::sys_days day{ first_date }; day <= last_day; day += std::chrono::days{1}) {
+			Date date{ day };
+			auto date_iterator = date == _globex_today.date ? intraday_iterator : _intraday_records.find(IntradayRecordsKey(date, _globex_today.globex_code));
+			if (date_iterator == _intraday_records.end())
+				continue;
+			const auto& records = date_iterator->second;
 			std::ranges::copy(records, std::back_inserter(_intraday_closes));
-			intraday_iterator++;
 		}
+		// Health check, the dense ticks and the binary searches of the barrier returns depend on it
+		for (std::size_t i = 1; i < _intraday_closes.size(); i++) {
+			if (_intraday_closes[i].time <= _intraday_closes[i - 1].time)
+				throw Exception("Intraday closes of symbol {} are not strictly increasing at {}", _symbol, get_time_string(_intraday_closes[i].time));
+		}
+		get_bar_ticks();
+		std::vector<int64_t> amounts;
+		amounts.reserve(_intraday_closes.size());
+		for (const auto& intraday_close : _intraday_closes)
+			amounts.push_back(intraday_close.close.to_int());
+		_close_extrema.build(amounts);
 		return true;
 	}
 
-	void ArchiveGenerator::update_recent_closes(const GlobexRecord& daily_globex_record) {
+	template<BarDuration Bar>
+	void ArchiveGeneratorT<Bar>::update_recent_closes(const GlobexRecord& daily_globex_record) {
 		_recent_closes.push_front(daily_globex_record.close.to_double());
 		while (_recent_closes.size() > recent_closes_window_size)
 			_recent_closes.pop_back();
@@ -355,9 +993,10 @@ namespace confounding {
 		}
 	}
 
-	void ArchiveGenerator::generate_intraday_record(const IntradayClose& record) {
+	template<BarDuration Bar>
+	void ArchiveGeneratorT<Bar>::generate_intraday_record(const IntradayCloseT<Bar>& record) {
 		std::chrono::local_days local_days{ _globex_today.date };
-		Time close_time = local_days + std::chrono::duration_cast<std::chrono::hours>(_filter.session_end.to_duration());
+		BarTime<Bar> close_time = local_days + std::chrono::duration_cast<Bar>(_filter.session_end.to_duration());
 		bool use_today = record.time > close_time + min_session_end_offset;
 		RawIntradayRecord raw_intraday_record;
 		bool success = get_features(
@@ -370,163 +1009,267 @@ namespace confounding {
 			return;
 		}
 		get_returns(record, use_today, raw_intraday_record);
-		_archive.intraday_timestamps.push_back(record.time);
-		_raw_intraday_records.push_back(raw_intraday_record);
+		get_ranks(record.time, raw_intraday_record);
+		normalize_features(record.time, raw_intraday_record);
+		add_timestamp(record.time);
+		_chunk.intraday_records.push_back(get_intraday_record(raw_intraday_record));
+		_entry_closes.push_back(record.close.to_int());
+		_record_count++;
 	}
 
-	bool ArchiveGenerator::get_features(
-		const IntradayClose& record,
+	template<BarDuration Bar>
+	bool ArchiveGeneratorT<Bar>::get_features(
+		const IntradayCloseT<Bar>& record,
 		bool use_today,
 		RawIntradayRecord& raw_intraday_record
 	) {
-		std::size_t recent_closes_offset = use_today ? 0 : 1;
-		double close = record.close.to_double();
-		auto get_recent_close = [&](std::size_t i) {
-			return _recent_closes[recent_closes_offset + i];
-		};
-		double close_1d = get_recent_close(0);
-		double close_2d = get_recent_close(1);
-		double close_10d = get_recent_close(9);
-		double close_40d = get_recent_close(39);
-		auto time_8h = record.time - std::chrono::hours(8);
-		auto intraday_iterator = std::find_if(
-			_intraday_closes.begin(),
-			_intraday_closes.end(),
-			[&](const IntradayClose& intraday_close) {
-				return intraday_close.time == time_8h;
-			}
-		);
+		auto intraday_iterator = _intraday_closes.end();
+		if constexpr (Bar{1} < feature_close_lag) {
+			auto time_8h = record.time - feature_close_lag;
+			intraday_iterator = std::find_if(
+				_intraday_closes.begin(),
+				_intraday_closes.end(),
+				[&](const IntradayCloseT<Bar>& intraday_close) {
+					return intraday_close.time == time_8h;
+				}
+			);
+		} else {
+			// Bars that span the entire lag, i.e. session bars, are relative to the close of the previous bar instead
+			auto next_iterator = std::ranges::lower_bound(_intraday_closes, record.time, {}, &IntradayCloseT<Bar>::time);
+			if (next_iterator != _intraday_closes.begin())
+				intraday_iterator = std::prev(next_iterator);
+		}
 		if (intraday_iterator == _intraday_closes.end()) {
 			// The intraday buffer lacks a corresponding value for that offset
 			// Could be the result of daily maintenance, but skip it either way
 			return false;
 		}
-		double close_8h = intraday_iterator->close.to_double();
-		if (
-			close < close_minimum ||
-			close_1d < close_minimum ||
-			close_2d < close_minimum ||
-			close_10d < close_minimum ||
-			close_40d < close_minimum ||
-			close_8h < close_minimum
-		) {
+		FeatureInputs inputs{
+			.close = record.close.to_double(),
+			.close_8h = intraday_iterator->close.to_double(),
+			.recent_closes = _recent_closes,
+			.session_offset = use_today ? 0u : 1u,
+			.recent_returns = _recent_returns,
+		};
+		bool abnormal_close = inputs.close < close_minimum || inputs.close_8h < close_minimum;
+		for (std::size_t lag : feature_session_lags)
+			abnormal_close = abnormal_close || inputs.get_session_close(lag) < close_minimum;
+		if (abnormal_close) {
 			// At least one of the recent values reached pathologically low values that will grossly distort ratios
 			// Just skip all of these abnormal values
 			return false;
 		}
-		raw_intraday_record.momentum_1d = get_rate_of_change(close, close_1d);
-		raw_intraday_record.momentum_2d = get_rate_of_change(close, close_2d);
-		raw_intraday_record.momentum_2d_gap = get_rate_of_change(close_1d, close_2d);
-		raw_intraday_record.momentum_8h = get_rate_of_change(close, close_2d);
-		raw_intraday_record.momentum_10d = get_rate_of_change(close, close_10d);
-		raw_intraday_record.momentum_40d = get_rate_of_change(close, close_40d);
-		raw_intraday_record.volatility_10d = get_volatility(10);
-		raw_intraday_record.volatility_40d = get_volatility(40);
+		evaluate_features(inputs, raw_intraday_record.features);
 		return true;
 	}
 
-	void ArchiveGenerator::get_returns(
-		const IntradayClose& record,
+	template<BarDuration Bar>
+	void ArchiveGeneratorT<Bar>::get_returns(
+		const IntradayCloseT<Bar>& record,
 		bool use_today,
 		RawIntradayRecord& raw_intraday_record
 	) {
-		auto get_tick_delta = [&](Money close) {
-			int32_t delta = close - record.close;
-			int32_t tick_size = static_cast<int32_t>(_contract.tick_size.to_int());
-			if (delta % tick_size != 0)
-				throw Exception("Close delta at {} does not match tick size of {}", get_time_string(record.time), _contract.symbol);
-			int32_t tick_delta = delta / tick_size;
-			return tick_delta;
-			};
+		// The fixed horizon returns and the TP/SL-based returns are calculated for all records of the day at once in get_forward_returns
+		raw_intraday_record.returns_next_close = intraday_invalid_returns;
+		if (_filter.features_only)
+			return;
 		Money next_close = use_today ? _globex_today.close : _globex_tomorrow.close;
-		int32_t returns_next_close = get_tick_delta(next_close);
-		TimeOfDay record_time_of_day = get_time_of_day(record.time);
-		auto matching_records_view = _intraday_closes | std::views::filter([&](const IntradayClose& intraday_close) {
-			TimeOfDay time_of_day = get_time_of_day(intraday_close.time);
-			bool match =
-				intraday_close.time > record.time &&
-				time_of_day.to_duration() == record_time_of_day.to_duration();
-			return match;
-			});
-		std::vector<IntradayClose> matching_records(matching_records_view.begin(), matching_records_view.end());
-		raw_intraday_record.returns_20h = intraday_invalid_returns;
-		raw_intraday_record.returns_22h = intraday_invalid_returns;
-		raw_intraday_record.returns_24h = intraday_invalid_returns;
-		raw_intraday_record.returns_26h = intraday_invalid_returns;
-		raw_intraday_record.returns_28h = intraday_invalid_returns;
-		raw_intraday_record.returns_48h = intraday_invalid_returns;
-		raw_intraday_record.returns_72h = intraday_invalid_returns;
-		if (!_filter.features_only && matching_records.size() == 3) {
-			auto get_matching_close = [&](std::size_t i) {
-				int32_t tick_delta = get_tick_delta(matching_records[i].close);
-				return tick_delta;
-			};
-			auto get_next_day = [&](int hours_offset) {
-				auto next_day_time = matching_records[0].time;
-				auto offset_time = next_day_time + std::chrono::hours{hours_offset};
-				auto iterator = std::find_if(
-					_intraday_closes.begin(),
-					_intraday_closes.end(),
-					[&](const IntradayClose& intrday_close) {
-						return intrday_close.time == offset_time;
-					}
-				);
-				if (iterator != _intraday_closes.begin()) {
-					int32_t tick_delta = get_tick_delta(iterator->close);
-					return tick_delta;
-				} else {
-					return intraday_invalid_returns;
-				}
-			};
-			raw_intraday_record.returns_20h = get_next_day(-4);
-			raw_intraday_record.returns_22h = get_next_day(-2);
-			raw_intraday_record.returns_24h = get_matching_close(0);
-			raw_intraday_record.returns_26h = get_next_day(2);
-			raw_intraday_record.returns_28h = get_next_day(4);
-			raw_intraday_record.returns_48h = get_matching_close(1);
-			raw_intraday_record.returns_72h = get_matching_close(2);
-		}
-	}
-
-	double ArchiveGenerator::get_volatility(std::size_t n) {
-		double mean_sum = 0.0;
-		auto returns_view = _recent_returns | std::views::take(n);
-		for (double x : returns_view)
-			mean_sum += x;
-		double mean = mean_sum / n;
-		double delta_sum = 0.0;
-		for (double x : returns_view) {
-			double delta = x - mean;
-			delta_sum += delta * delta;
-		}
-		double standard_deviation = delta_sum / (n - 1);
-		double volatility = std::sqrt(static_cast<double>(n)) * standard_deviation;
-		return volatility;
-	}
-
-	void ArchiveGenerator::add_nan_record(Time time) {
-		if (_raw_intraday_records.size() == 0)
+		int32_t delta = next_close - record.close;
+		int32_t tick_size = static_cast<int32_t>(_contract.tick_size.to_int());
+		if (delta % tick_size != 0)
+			throw Exception("Close delta at {} does not match tick size of {}", get_time_string(record.time), _contract.symbol);
+		raw_intraday_record.returns_next_close = delta / tick_size;
+	}
+
+	template<BarDuration Bar>
+	void ArchiveGeneratorT<Bar>::get_bar_ticks() {
+		// Dense closes in ticks relative to the first close with one slot per bar, padded with invalid values up to the end of the day after the last session
+		// so that the returns of a horizon can be gathered without bounds checks, see get_forward_returns
+		_bar_ticks.clear();
+		if (_intraday_closes.empty())
+			return;
+		_bars_start = _intraday_closes.front().time;
+		Date last_date = _session_dates.empty() ? _globex_today.date : _session_dates.back();
+		BarTime<Bar> bars_end = std::chrono::local_days{ last_date } + std::chrono::days{2};
+		auto bars = std::max(bars_end - _bars_start, _intraday_closes.back().time + Bar{1} - _bars_start);
+		std::size_t size = static_cast<std::size_t>(bars.count());
+		_bar_ticks.assign(size, intraday_invalid_returns);
+		int64_t first_close = _intraday_closes.front().close.to_int();
+		int64_t tick_size = _contract.tick_size.to_int();
+		for (const auto& intraday_close : _intraday_closes) {
+			int64_t delta = intraday_close.close.to_int() - first_close;
+			if (delta % tick_size != 0)
+				throw Exception("Close delta at {} does not match tick size of {}", get_time_string(intraday_close.time), _contract.symbol);
+			auto offset = intraday_close.time - _bars_start;
+			_bar_ticks[offset.count()] = static_cast<int32_t>(delta / tick_size);
+		}
+	}
+
+	template<BarDuration Bar>
+	void ArchiveGeneratorT<Bar>::get_forward_returns() {
+		std::size_t record_count = _chunk.intraday_records.size();
+		std::size_t column_count = _archive.extra_columns.size();
+		_chunk.extra_values.assign(record_count * column_count, intraday_invalid_returns);
+		if (_filter.features_only || record_count == 0)
 			return;
-		constexpr float nan = std::numeric_limits<float>::signaling_NaN();
-		auto intraday_record = RawIntradayRecord{
-			.momentum_1d = nan,
-			.momentum_2d = nan,
-			.momentum_2d_gap = nan,
-			.momentum_8h = nan,
-			.momentum_10d = nan,
-			.momentum_40d = nan,
-			.volatility_10d = nan,
-			.volatility_40d = nan,
-			.returns_next_close = intraday_invalid_returns,
-			.returns_20h = intraday_invalid_returns,
-			.returns_22h = intraday_invalid_returns,
-			.returns_24h = intraday_invalid_returns,
-			.returns_26h = intraday_invalid_returns,
-			.returns_28h = intraday_invalid_returns,
-			.returns_48h = intraday_invalid_returns,
-			.returns_72h = intraday_invalid_returns,
+		const auto& horizons = _return_horizons;
+		std::vector<std::size_t> offsets(record_count);
+		std::vector<int32_t> entries(record_count);
+		// The entries are the closes of the records themselves, in ticks relative to the first close of _bar_ticks
+		int64_t first_close = _intraday_closes.front().close.to_int();
+		int64_t tick_size = _contract.tick_size.to_int();
+		for (std::size_t i = 0; i < record_count; i++) {
+			auto offset = _chunk.intraday_timestamps[i] - _bars_start;
+			offsets[i] = static_cast<std::size_t>(offset.count());
+			entries[i] = static_cast<int32_t>((_entry_closes[i] - first_close) / tick_size);
+		}
+		std::chrono::sys_days today{ _globex_today.date };
+		// One gathered load from the dense ticks per record and horizon
+		for (std::size_t j = 0; j < horizons.size(); j++) {
+			// The horizons are indexed by trading session, all records of the day share the same shift
+			// A horizon of n days exits at the time of day of the record on the n-th session after today, e.g. the 24h returns of a Friday exit on Monday,
+			// other horizons are relative to the nearest number of days, e.g. 20h exits 4 hours before the time of day of the record on the next session
+			int64_t sessions = (horizons[j] + std::chrono::hours{12}) / std::chrono::days{1};
+			auto remainder = horizons[j] - std::chrono::days{sessions};
+			// Horizons that aren't a multiple of the bar duration remain invalid, e.g. 22 hours with H4 bars
+			if ((remainder % Bar{1}).count() != 0)
+				continue;
+			std::chrono::hours session_offset{0};
+			if (sessions > 0) {
+				if (static_cast<std::size_t>(sessions) > _session_dates.size())
+					continue;
+				session_offset = std::chrono::sys_days{_session_dates[sessions - 1]} - today;
+			}
+			std::size_t shift = static_cast<std::size_t>(std::chrono::duration_cast<Bar>(session_offset + remainder).count());
+			int32_t* values = _chunk.extra_values.data() + j;
+			for (std::size_t i = 0; i < record_count; i++) {
+				int32_t exit = _bar_ticks[offsets[i] + shift];
+				values[i * column_count] = exit == intraday_invalid_returns ? intraday_invalid_returns : exit - entries[i];
+			}
+		}
+		for (std::size_t i = 0; i < record_count; i++) {
+			int32_t* values = _chunk.extra_values.data() + i * column_count + horizons.size();
+			get_barrier_returns(_chunk.intraday_timestamps[i], _entry_closes[i], values);
+		}
+	}
+
+	template<BarDuration Bar>
+	void ArchiveGeneratorT<Bar>::get_barrier_returns(BarTime<Bar> time, int64_t entry, int32_t* values) {
+		// _intraday_closes only contains the closes of the contract of the record and is sorted by time,
+		// so the holding period consists of the closes after the record up to and including the end of the horizon
+		auto first_iterator = std::ranges::upper_bound(_intraday_closes, time, {}, &IntradayCloseT<Bar>::time);
+		std::size_t first = first_iterator - _intraday_closes.begin();
+		std::size_t last;
+		if constexpr (std::same_as<Bar, Session>) {
+			// Like the fixed horizons, the holding period of session bars is a number of trading sessions
+			last = first + static_cast<std::size_t>(_barrier_horizon / Bar{1});
+			if (last > _intraday_closes.size())
+				return;
+		} else {
+			BarTime<Bar> horizon_end = std::chrono::floor<Bar>(time + _barrier_horizon);
+			if (_intraday_closes.back().time < horizon_end)
+				return;
+			auto last_iterator = std::ranges::upper_bound(_intraday_closes, horizon_end, {}, &IntradayCloseT<Bar>::time);
+			last = last_iterator - _intraday_closes.begin();
+		}
+		if (first == last)
+			return;
+		int64_t tick_size = _contract.tick_size.to_int();
+		for (const auto& barrier : _barriers) {
+			std::size_t take_profit_index = _close_extrema.find_first_at_least(first, last, entry + barrier.take_profit * tick_size);
+			std::size_t stop_loss_index = _close_extrema.find_first_at_most(first, last, entry - barrier.stop_loss * tick_size);
+			// Exit with the first close that crosses either barrier, i.e. the earlier of the two indexes,
+			// otherwise exit at the end of the holding period
+			std::size_t exit_index = std::min(take_profit_index, stop_loss_index);
+			if (exit_index == last)
+				exit_index = last - 1;
+			const auto& exit = _intraday_closes[exit_index];
+			int64_t delta = exit.close.to_int() - entry;
+			if (delta % tick_size != 0)
+				throw Exception("Close delta at {} does not match tick size of {}", get_time_string(time), _contract.symbol);
+			int64_t exit_bars;
+			if constexpr (std::same_as<Bar, Session>)
+				exit_bars = static_cast<int64_t>(exit_index - first + 1);
+			else
+				exit_bars = (exit.time - time).count();
+			values[0] = static_cast<int32_t>(delta / tick_size);
+			values[1] = static_cast<int32_t>(exit_bars);
+			values += 2;
+		}
+	}
+
+	template<BarDuration Bar>
+	void ArchiveGeneratorT<Bar>::get_ranks(BarTime<Bar> time, RawIntradayRecord& raw_intraday_record) {
+		for (std::size_t i = 0; i < feature_count; i++)
+			raw_intraday_record.ranks[i] = _feature_ranks[i].update(time, raw_intraday_record.features[i]);
+	}
+
+	template<BarDuration Bar>
+	void ArchiveGeneratorT<Bar>::normalize_features(BarTime<Bar> time, RawIntradayRecord& raw_intraday_record) {
+		// Performed in double precision, prior to the conversion to IntradayRecord
+		for (auto& normalization : _normalizations) {
+			double& value = raw_intraday_record.features[normalization.feature];
+			value = normalization.z_score.update(time, value);
+		}
+	}
+
+	template<BarDuration Bar>
+	void ArchiveGeneratorT<Bar>::add_nan_record(BarTime<Bar> time) {
+		add_nan_run(time, 1);
+	}
+
+	template<BarDuration Bar>
+	void ArchiveGeneratorT<Bar>::add_nan_run(BarTime<Bar> start, uint32_t length) {
+		// NaN records are never materialized, they are stored as runs in the archive instead
+		if (_record_count == 0 || length == 0)
+			return;
+		check_time(start);
+		// Runs that continue the last run of the previous chunk are merged by Archive::append
+		auto& runs = _chunk.invalid_runs;
+		if (!runs.empty()) {
+			auto& run = runs.back();
+			if (run.start + Bar{run.length} == start) {
+				run.length += length;
+				_last_time = start + Bar{length - 1};
+				return;
+			}
+		}
+		InvalidRunT<Bar> run{
+			.start = start,
+			.length = length
 		};
-		_archive.intraday_timestamps.push_back(time);
-		_raw_intraday_records.push_back(intraday_record);
+		runs.push_back(run);
+		_last_time = start + Bar{length - 1};
+	}
+
+	template<BarDuration Bar>
+	void ArchiveGeneratorT<Bar>::add_timestamp(BarTime<Bar> time) {
+		check_time(time);
+		_chunk.intraday_timestamps.push_back(time);
+		_last_time = time;
 	}
+
+	template<BarDuration Bar>
+	void ArchiveGeneratorT<Bar>::check_time(BarTime<Bar> time) const {
+		// Health check
+		if (_last_time && time <= *_last_time)
+			throw Exception("Intraday timestamps of symbol {} are not strictly increasing at {}", _symbol, get_time_string(time));
+	}
+
+	IntradayRecord ArchiveGeneratorBase::get_intraday_record(const RawIntradayRecord& raw_intraday_record) {
+		IntradayRecord intraday_record;
+		for (std::size_t i = 0; i < feature_count; i++) {
+			intraday_record.features[i] = static_cast<float>(raw_intraday_record.features[i]);
+			intraday_record.ranks[i] = static_cast<float>(raw_intraday_record.ranks[i]);
+		}
+		intraday_record.returns_next_close = raw_intraday_record.returns_next_close;
+		return intraday_record;
+	}
+
+	template class ArchiveGeneratorT<H1>;
+	template class ArchiveGeneratorT<M30>;
+	template class ArchiveGeneratorT<M15>;
+	template class ArchiveGeneratorT<M5>;
+	template class ArchiveGeneratorT<H4>;
+	template class ArchiveGeneratorT<Session>;
 }
\ No newline at end of file
@@ -0,0 +1,166 @@
+#include <limits>
+
+#include "confounding/rank.h"
+
+namespace confounding {
+	namespace {
+		constexpr int32_t null_node = -1;
+	}
+
+	OrderStatistics::OrderStatistics()
+		: _root(null_node),
+		_random_state(0x9e3779b9) {
+	}
+
+	void OrderStatistics::insert(double value) {
+		int32_t left;
+		int32_t right;
+		split(_root, value, false, left, right);
+		_root = merge(merge(left, allocate(value)), right);
+	}
+
+	void OrderStatistics::erase(double value) {
+		int32_t left;
+		int32_t middle;
+		int32_t right;
+		split(_root, value, false, left, middle);
+		split(middle, value, true, middle, right);
+		if (middle != null_node) {
+			// All nodes in the middle tree are equal to the value, drop its root
+			const Node& node = _nodes[middle];
+			_free_nodes.push_back(middle);
+			middle = merge(node.left, node.right);
+		}
+		_root = merge(merge(left, middle), right);
+	}
+
+	std::size_t OrderStatistics::count_less(double value) const {
+		std::size_t count = 0;
+		int32_t node = _root;
+		while (node != null_node) {
+			const Node& current = _nodes[node];
+			if (current.value < value) {
+				count += get_size(current.left) + 1;
+				node = current.right;
+			} else {
+				node = current.left;
+			}
+		}
+		return count;
+	}
+
+	std::size_t OrderStatistics::count_less_equal(double value) const {
+		std::size_t count = 0;
+		int32_t node = _root;
+		while (node != null_node) {
+			const Node& current = _nodes[node];
+			if (current.value <= value) {
+				count += get_size(current.left) + 1;
+				node = current.right;
+			} else {
+				node = current.left;
+			}
+		}
+		return count;
+	}
+
+	std::size_t OrderStatistics::size() const {
+		return get_size(_root);
+	}
+
+	int32_t OrderStatistics::allocate(double value) {
+		Node node{
+			.value = value,
+			.priority = get_random(),
+			.size = 1,
+			.left = null_node,
+			.right = null_node
+		};
+		if (!_free_nodes.empty()) {
+			int32_t index = _free_nodes.back();
+			_free_nodes.pop_back();
+			_nodes[index] = node;
+			return index;
+		}
+		_nodes.push_back(node);
+		return static_cast<int32_t>(_nodes.size() - 1);
+	}
+
+	uint32_t OrderStatistics::get_size(int32_t node) const {
+		return node == null_node ? 0 : _nodes[node].size;
+	}
+
+	void OrderStatistics::update_size(int32_t node) {
+		Node& current = _nodes[node];
+		current.size = get_size(current.left) + get_size(current.right) + 1;
+	}
+
+	void OrderStatistics::split(int32_t node, double value, bool inclusive, int32_t& left, int32_t& right) {
+		if (node == null_node) {
+			left = null_node;
+			right = null_node;
+			return;
+		}
+		Node& current = _nodes[node];
+		bool goes_left = inclusive ? current.value <= value : current.value < value;
+		if (goes_left) {
+			split(current.right, value, inclusive, _nodes[node].right, right);
+			left = node;
+		} else {
+			split(current.left, value, inclusive, left, _nodes[node].left);
+			right = node;
+		}
+		update_size(node);
+	}
+
+	int32_t OrderStatistics::merge(int32_t left, int32_t right) {
+		if (left == null_node)
+			return right;
+		if (right == null_node)
+			return left;
+		if (_nodes[left].priority > _nodes[right].priority) {
+			int32_t merged = merge(_nodes[left].right, right);
+			_nodes[left].right = merged;
+			update_size(left);
+			return left;
+		} else {
+			int32_t merged = merge(left, _nodes[right].left);
+			_nodes[right].left = merged;
+			update_size(right);
+			return right;
+		}
+	}
+
+	uint32_t OrderStatistics::get_random() {
+		// xorshift32, the priorities merely need to be well distributed
+		_random_state ^= _random_state << 13;
+		_random_state ^= _random_state >> 17;
+		_random_state ^= _random_state << 5;
+		return _random_state;
+	}
+
+	RollingRank::RollingRank(std::chrono::hours window)
+		: _window(window) {
+	}
+
+	double RollingRank::update(MinuteTime time, double value) {
+		if (!_first_time)
+			_first_time = time;
+		while (!_values.empty() && _values.front().first + _window <= time) {
+			_statistics.erase(_values.front().second);
+			_values.pop_front();
+		}
+		_values.emplace_back(time, value);
+		_statistics.insert(value);
+		if (*_first_time + _window > time)
+			return std::numeric_limits<double>::quiet_NaN();
+		std::size_t count = _statistics.size();
+		if (count < 2)
+			return std::numeric_limits<double>::quiet_NaN();
+		// Ties are assigned the average of their ranks
+		std::size_t less = _statistics.count_less(value);
+		std::size_t equal = _statistics.count_less_equal(value) - less;
+		double rank = (static_cast<double>(less) + 0.5 * static_cast<double>(equal - 1)) / static_cast<double>(count - 1);
+		return rank;
+	}
+}
\ No newline at end of file
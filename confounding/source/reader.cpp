@@ -0,0 +1,423 @@
+#include <cstring>
+#include <algorithm>
+#include <execution>
+#include <numeric>
+
+#include "confounding/reader.h"
+#include "confounding/exception.h"
+#include "confounding/compression.h"
+
+namespace confounding {
+	namespace {
+		template<BarDuration Bar>
+		int64_t get_time_count(BarTime<Bar> time) {
+			return static_cast<int64_t>(time.time_since_epoch().count());
+		}
+
+		int64_t read_int64(const char* data, std::size_t index) {
+			int64_t value;
+			std::memcpy(&value, data + index * sizeof(int64_t), sizeof(value));
+			return value;
+		}
+	}
+
+	ArchiveReader::ArchiveReader(const std::string& path)
+		: _file(path) {
+		load(path);
+	}
+
+	ArchiveReader::ArchiveReader(MappedFile&& file)
+		: _file(std::move(file)) {
+		load("in memory");
+	}
+
+	void ArchiveReader::load(const std::string& path) {
+		const char* data = _file.get_data();
+		std::size_t size = _file.get_size();
+		if (size < sizeof(ArchiveHeader))
+			throw Exception("Archive {} is too small", path);
+		_header = reinterpret_cast<const ArchiveHeader*>(data);
+		if (_header->magic != archive_magic)
+			throw Exception("Invalid archive magic in {}", path);
+		if (_header->version != archive_version)
+			throw Exception("Unsupported archive version {} in {}", _header->version, path);
+		constexpr uint32_t minutes_per_day = 24 * 60;
+		if (_header->bar_minutes == 0 || minutes_per_day % _header->bar_minutes != 0)
+			throw Exception("Invalid bar duration in archive {}", path);
+		_bars_per_day = minutes_per_day / _header->bar_minutes;
+		std::size_t columns_end = sizeof(ArchiveHeader) + _header->column_count * sizeof(ColumnHeader);
+		if (size < columns_end)
+			throw Exception("Archive {} is truncated", path);
+		auto columns = reinterpret_cast<const ColumnHeader*>(data + sizeof(ArchiveHeader));
+		_columns = std::span<const ColumnHeader>(columns, _header->column_count);
+		if (is_blocked()) {
+			std::size_t blocks_end = _header->block_index_offset + _header->block_count * sizeof(ArchiveBlock);
+			if (_header->block_size == 0 || size < blocks_end)
+				throw Exception("Archive {} has an invalid block index", path);
+			auto blocks = reinterpret_cast<const ArchiveBlock*>(data + _header->block_index_offset);
+			_blocks = std::span<const ArchiveBlock>(blocks, _header->block_count);
+		}
+		for (const auto& column : _columns) {
+			if (column.offset + column.size > size)
+				throw Exception("Column {} in archive {} is truncated", column.name, path);
+			if (column.flags & column_flag_blocked) {
+				if (column.size < _blocks.size() * sizeof(BlockEntry))
+					throw Exception("Column {} in archive {} has an invalid block table", column.name, path);
+				auto entries = reinterpret_cast<const BlockEntry*>(get_column_data(column));
+				for (std::size_t i = 0; i < _blocks.size(); i++) {
+					if (entries[i].offset + entries[i].compressed_size > column.size)
+						throw Exception("Block {} of column {} in archive {} is truncated", i, column.name, path);
+				}
+			} else if (column.size != column.count * get_encoded_size(column.type, column.encoding)) {
+				throw Exception("Column {} in archive {} has an invalid size", column.name, path);
+			}
+		}
+		_time_column = &get_column(intraday_time_column);
+		const auto& day_index_header = get_column(day_index_column);
+		auto day_index = reinterpret_cast<const int64_t*>(get_column_data(day_index_header));
+		_day_index = std::span<const int64_t>(day_index, day_index_header.count);
+	}
+
+	const ArchiveHeader& ArchiveReader::get_header() const {
+		return *_header;
+	}
+
+	std::span<const ColumnHeader> ArchiveReader::get_columns() const {
+		return _columns;
+	}
+
+	std::span<const ArchiveBlock> ArchiveReader::get_blocks() const {
+		return _blocks;
+	}
+
+	const ColumnHeader& ArchiveReader::get_column(const std::string& name) const {
+		const ColumnHeader* column = find_column(name);
+		if (column == nullptr)
+			throw Exception("Unable to find column {} in archive", name);
+		return *column;
+	}
+
+	const ColumnHeader* ArchiveReader::find_column(const std::string& name) const {
+		auto iterator = std::ranges::find_if(_columns, [&](const ColumnHeader& column) {
+			return name == column.name;
+		});
+		if (iterator == _columns.end())
+			return nullptr;
+		return &*iterator;
+	}
+
+	bool ArchiveReader::is_blocked() const {
+		return (_header->flags & archive_flag_blocked) != 0;
+	}
+
+	template<BarDuration Bar>
+	RecordRange ArchiveReader::get_record_range(BarTime<Bar> start, BarTime<Bar> end) const {
+		check_resolution<Bar>();
+		int64_t start_count = get_time_count(start);
+		int64_t end_count = get_time_count(end);
+		if (start_count >= end_count)
+			return RecordRange{.first = 0, .count = 0};
+		std::size_t first = get_record_index(start_count);
+		std::size_t last = get_record_index(end_count);
+		return RecordRange{.first = first, .count = last - first};
+	}
+
+	RecordRange ArchiveReader::get_record_range(Date start, Date end) const {
+		int64_t start_day = std::chrono::sys_days{start}.time_since_epoch().count();
+		int64_t end_day = std::chrono::sys_days{end}.time_since_epoch().count();
+		if (start_day >= end_day)
+			return RecordRange{.first = 0, .count = 0};
+		std::size_t first = get_day_record_index(start_day);
+		std::size_t last = get_day_record_index(end_day);
+		return RecordRange{.first = first, .count = last - first};
+	}
+
+	std::span<const int64_t> ArchiveReader::get_time_span(RecordRange range) const {
+		auto data = reinterpret_cast<const int64_t*>(get_raw_records(*_time_column, ColumnType::int64, range));
+		return std::span<const int64_t>(data, range.count);
+	}
+
+	std::span<const float> ArchiveReader::get_float_span(const std::string& name, RecordRange range) const {
+		auto data = reinterpret_cast<const float*>(get_raw_records(get_column(name), ColumnType::float32, range));
+		return std::span<const float>(data, range.count);
+	}
+
+	std::span<const int32_t> ArchiveReader::get_returns_span(const std::string& name, RecordRange range) const {
+		auto data = reinterpret_cast<const int32_t*>(get_raw_records(get_column(name), ColumnType::int32, range));
+		return std::span<const int32_t>(data, range.count);
+	}
+
+	std::vector<float> ArchiveReader::read_floats(const std::string& name) const {
+		return read_floats(name, get_full_range());
+	}
+
+	std::vector<float> ArchiveReader::read_floats(const std::string& name, RecordRange range) const {
+		const auto& column = get_column(name);
+		if (column.type != ColumnType::float32)
+			throw Exception("Column {} does not contain floats", name);
+		std::vector<char> buffer;
+		const char* data = get_encoded_records(column, range, buffer);
+		std::vector<float> output(range.count);
+		decode_floats(data, column.encoding, output);
+		return output;
+	}
+
+	std::vector<int32_t> ArchiveReader::read_returns(const std::string& name) const {
+		return read_returns(name, get_full_range());
+	}
+
+	std::vector<int32_t> ArchiveReader::read_returns(const std::string& name, RecordRange range) const {
+		const auto& column = get_column(name);
+		if (column.type != ColumnType::int32)
+			throw Exception("Column {} does not contain returns", name);
+		std::vector<char> buffer;
+		const char* data = get_encoded_records(column, range, buffer);
+		std::vector<int32_t> output(range.count);
+		decode_returns(data, column.encoding, output);
+		return output;
+	}
+
+	template<BarDuration Bar>
+	std::vector<BarTime<Bar>> ArchiveReader::read_timestamps() const {
+		return read_timestamps<Bar>(get_full_range());
+	}
+
+	template<BarDuration Bar>
+	std::vector<BarTime<Bar>> ArchiveReader::read_timestamps(RecordRange range) const {
+		check_resolution<Bar>();
+		const auto& column = get_column(intraday_time_column);
+		std::vector<char> buffer;
+		const char* data = get_encoded_records(column, range, buffer);
+		std::vector<BarTime<Bar>> output;
+		output.reserve(range.count);
+		for (std::size_t i = 0; i < range.count; i++)
+			output.push_back(BarTime<Bar>{Bar{read_int64(data, i)}});
+		return output;
+	}
+
+	std::vector<DailyRecord> ArchiveReader::read_daily_records() const {
+		const auto& date_column = get_column(daily_date_column);
+		const auto& close_column = get_column(daily_close_column);
+		auto days = reinterpret_cast<const int32_t*>(get_column_data(date_column));
+		auto closes = reinterpret_cast<const int64_t*>(get_column_data(close_column));
+		std::vector<DailyRecord> output;
+		output.reserve(date_column.count);
+		for (std::size_t i = 0; i < date_column.count; i++) {
+			DailyRecord record{
+				.date = Date{std::chrono::sys_days{std::chrono::days{days[i]}}},
+				.close = Money(closes[i]),
+			};
+			output.push_back(record);
+		}
+		return output;
+	}
+
+	template<BarDuration Bar>
+	std::vector<InvalidRunT<Bar>> ArchiveReader::read_invalid_runs(BarTime<Bar> start, BarTime<Bar> end) const {
+		check_resolution<Bar>();
+		const auto& start_column = get_column(invalid_run_start_column);
+		const auto& length_column = get_column(invalid_run_length_column);
+		auto starts = reinterpret_cast<const int64_t*>(get_column_data(start_column));
+		auto lengths = reinterpret_cast<const int32_t*>(get_column_data(length_column));
+		int64_t start_count = get_time_count(start);
+		int64_t end_count = get_time_count(end);
+		std::vector<InvalidRunT<Bar>> output;
+		for (std::size_t i = 0; i < start_column.count; i++) {
+			int64_t run_start = std::max(starts[i], start_count);
+			int64_t run_end = std::min(starts[i] + lengths[i], end_count);
+			if (run_start >= run_end)
+				continue;
+			InvalidRunT<Bar> run{
+				.start = BarTime<Bar>{Bar{run_start}},
+				.length = static_cast<uint32_t>(run_end - run_start)
+			};
+			output.push_back(run);
+		}
+		return output;
+	}
+
+	template<BarDuration Bar>
+	ArchiveT<Bar> ArchiveReader::read_archive() const {
+		return read_archive<Bar>(BarTime<Bar>::min(), BarTime<Bar>::max());
+	}
+
+	template<BarDuration Bar>
+	ArchiveT<Bar> ArchiveReader::read_archive(BarTime<Bar> start, BarTime<Bar> end) const {
+		RecordRange range = get_record_range(start, end);
+		ArchiveT<Bar> archive;
+		archive.symbol = _header->symbol;
+		archive.series = _header->series;
+		archive.daily_records = read_daily_records();
+		archive.invalid_runs = read_invalid_runs(start, end);
+		archive.intraday_timestamps = read_timestamps<Bar>(range);
+		archive.intraday_records.assign(range.count, nan_intraday_record);
+		char* records = reinterpret_cast<char*>(archive.intraday_records.data());
+		auto scatter = [&](const auto& values, std::size_t offset) {
+			for (std::size_t i = 0; i < range.count; i++)
+				std::memcpy(records + i * sizeof(IntradayRecord) + offset, &values[i], sizeof(values[i]));
+		};
+		for (const auto& column : intraday_columns) {
+			if (find_column(column.name) == nullptr)
+				continue;
+			if (column.type == ColumnType::float32)
+				scatter(read_floats(column.name, range), column.offset);
+			else
+				scatter(read_returns(column.name, range), column.offset);
+		}
+		for (const auto& column : _columns) {
+			if (column.flags & column_flag_extra)
+				archive.extra_columns.push_back(column.name);
+		}
+		std::size_t extra_count = archive.extra_columns.size();
+		archive.extra_values.resize(range.count * extra_count);
+		for (std::size_t i = 0; i < extra_count; i++) {
+			auto values = read_returns(archive.extra_columns[i], range);
+			for (std::size_t j = 0; j < range.count; j++)
+				archive.extra_values[j * extra_count + i] = values[j];
+		}
+		return archive;
+	}
+
+	const char* ArchiveReader::get_column_data(const ColumnHeader& column) const {
+		return _file.get_data() + column.offset;
+	}
+
+	const char* ArchiveReader::get_encoded_records(const ColumnHeader& column, RecordRange range, std::vector<char>& buffer) const {
+		if (range.first + range.count > column.count)
+			throw Exception("Invalid record range for column {}", column.name);
+		std::size_t element_size = get_encoded_size(column.type, column.encoding);
+		const char* column_data = get_column_data(column);
+		if ((column.flags & column_flag_blocked) == 0)
+			return column_data + range.first * element_size;
+		if (range.count == 0)
+			return nullptr;
+		std::size_t block_size = _header->block_size;
+		std::size_t first_block = range.first / block_size;
+		std::size_t last_block = (range.first + range.count - 1) / block_size;
+		std::size_t first_record = _blocks[first_block].first_record;
+		std::size_t last_record = _blocks[last_block].first_record + _blocks[last_block].record_count;
+		buffer.resize((last_record - first_record) * element_size);
+		auto entries = reinterpret_cast<const BlockEntry*>(column_data);
+		std::vector<std::size_t> indexes(last_block - first_block + 1);
+		std::iota(indexes.begin(), indexes.end(), first_block);
+		std::for_each(
+			std::execution::par,
+			indexes.begin(),
+			indexes.end(),
+			[&](std::size_t i) {
+				const auto& block = _blocks[i];
+				const auto& entry = entries[i];
+				decompress_block(
+					column.type,
+					column.encoding,
+					column_data + entry.offset,
+					entry.compressed_size,
+					entry.payload_size,
+					block.record_count,
+					buffer.data() + (block.first_record - first_record) * element_size
+				);
+			}
+		);
+		return buffer.data() + (range.first - first_record) * element_size;
+	}
+
+	RecordRange ArchiveReader::get_full_range() const {
+		return RecordRange{.first = 0, .count = _header->intraday_record_count};
+	}
+
+	std::size_t ArchiveReader::get_record_index(int64_t time) const {
+		// Times outside of the days covered by the index are resolved up front, e.g. the unbounded ranges of Time::min() and Time::max(),
+		// otherwise the multiplication below would overflow
+		if (_day_index.empty())
+			return 0;
+		int64_t index_start = _header->day_index_start * _bars_per_day;
+		int64_t index_end = (_header->day_index_start + static_cast<int64_t>(_day_index.size())) * _bars_per_day;
+		if (time <= index_start)
+			return 0;
+		if (time >= index_end)
+			return _header->intraday_record_count;
+		// Floor division
+		int64_t day = time / _bars_per_day;
+		if (time % _bars_per_day < 0)
+			day--;
+		std::size_t first = get_day_record_index(day);
+		if (time == day * _bars_per_day)
+			return first;
+		std::size_t last = get_day_record_index(day + 1);
+		if (first == last)
+			return first;
+		// Scan the records of a single day, in the block-compressed layout this decompresses at most two blocks
+		RecordRange range{.first = first, .count = last - first};
+		std::vector<char> buffer;
+		const char* data = get_encoded_records(*_time_column, range, buffer);
+		std::size_t i = 0;
+		while (i < range.count && read_int64(data, i) < time)
+			i++;
+		return first + i;
+	}
+
+	std::size_t ArchiveReader::get_day_record_index(int64_t day) const {
+		if (_day_index.empty() || day < _header->day_index_start)
+			return 0;
+		std::size_t offset = static_cast<std::size_t>(day - _header->day_index_start);
+		if (offset >= _day_index.size())
+			return _header->intraday_record_count;
+		return static_cast<std::size_t>(_day_index[offset]);
+	}
+
+	const char* ArchiveReader::get_raw_records(const ColumnHeader& column, ColumnType type, RecordRange range) const {
+		if (column.type != type || column.encoding != ColumnEncoding::raw || (column.flags & column_flag_blocked))
+			throw Exception("Column {} can't be accessed without decoding it", column.name);
+		if (range.first + range.count > column.count)
+			throw Exception("Invalid record range for column {}", column.name);
+		return get_column_data(column) + range.first * get_type_size(type);
+	}
+
+	template<BarDuration Bar>
+	void ArchiveReader::check_resolution() const {
+		if (_header->bar_minutes != bar_minutes<Bar>)
+			throw Exception("Archive contains {} minute bars rather than {} bars", _header->bar_minutes, get_bar_name<Bar>());
+	}
+
+	template RecordRange ArchiveReader::get_record_range<H1>(BarTime<H1> start, BarTime<H1> end) const;
+	template std::vector<BarTime<H1>> ArchiveReader::read_timestamps<H1>() const;
+	template std::vector<BarTime<H1>> ArchiveReader::read_timestamps<H1>(RecordRange range) const;
+	template std::vector<InvalidRunT<H1>> ArchiveReader::read_invalid_runs<H1>(BarTime<H1> start, BarTime<H1> end) const;
+	template ArchiveT<H1> ArchiveReader::read_archive<H1>() const;
+	template ArchiveT<H1> ArchiveReader::read_archive<H1>(BarTime<H1> start, BarTime<H1> end) const;
+
+	template RecordRange ArchiveReader::get_record_range<M30>(BarTime<M30> start, BarTime<M30> end) const;
+	template std::vector<BarTime<M30>> ArchiveReader::read_timestamps<M30>() const;
+	template std::vector<BarTime<M30>> ArchiveReader::read_timestamps<M30>(RecordRange range) const;
+	template std::vector<InvalidRunT<M30>> ArchiveReader::read_invalid_runs<M30>(BarTime<M30> start, BarTime<M30> end) const;
+	template ArchiveT<M30> ArchiveReader::read_archive<M30>() const;
+	template ArchiveT<M30> ArchiveReader::read_archive<M30>(BarTime<M30> start, BarTime<M30> end) const;
+
+	template RecordRange ArchiveReader::get_record_range<M15>(BarTime<M15> start, BarTime<M15> end) const;
+	template std::vector<BarTime<M15>> ArchiveReader::read_timestamps<M15>() const;
+	template std::vector<BarTime<M15>> ArchiveReader::read_timestamps<M15>(RecordRange range) const;
+	template std::vector<InvalidRunT<M15>> ArchiveReader::read_invalid_runs<M15>(BarTime<M15> start, BarTime<M15> end) const;
+	template ArchiveT<M15> ArchiveReader::read_archive<M15>() const;
+	template ArchiveT<M15> ArchiveReader::read_archive<M15>(BarTime<M15> start, BarTime<M15> end) const;
+
+	template RecordRange ArchiveReader::get_record_range<M5>(BarTime<M5> start, BarTime<M5> end) const;
+	template std::vector<BarTime<M5>> ArchiveReader::read_timestamps<M5>() const;
+	template std::vector<BarTime<M5>> ArchiveReader::read_timestamps<M5>(RecordRange range) const;
+	template std::vector<InvalidRunT<M5>> ArchiveReader::read_invalid_runs<M5>(BarTime<M5> start, BarTime<M5> end) const;
+	template ArchiveT<M5> ArchiveReader::read_archive<M5>() const;
+	template ArchiveT<M5> ArchiveReader::read_archive<M5>(BarTime<M5> start, BarTime<M5> end) const;
+
+	template RecordRange ArchiveReader::get_record_range<H4>(BarTime<H4> start, BarTime<H4> end) const;
+	template std::vector<BarTime<H4>> ArchiveReader::read_timestamps<H4>() const;
+	template std::vector<BarTime<H4>> ArchiveReader::read_timestamps<H4>(RecordRange range) const;
+	template std::vector<InvalidRunT<H4>> ArchiveReader::read_invalid_runs<H4>(BarTime<H4> start, BarTime<H4> end) const;
+	template ArchiveT<H4> ArchiveReader::read_archive<H4>() const;
+	template ArchiveT<H4> ArchiveReader::read_archive<H4>(BarTime<H4> start, BarTime<H4> end) const;
+
+	template RecordRange ArchiveReader::get_record_range<Session>(BarTime<Session> start, BarTime<Session> end) const;
+	template std::vector<BarTime<Session>> ArchiveReader::read_timestamps<Session>() const;
+	template std::vector<BarTime<Session>> ArchiveReader::read_timestamps<Session>(RecordRange range) const;
+	template std::vector<InvalidRunT<Session>> ArchiveReader::read_invalid_runs<Session>(BarTime<Session> start, BarTime<Session> end) const;
+	template ArchiveT<Session> ArchiveReader::read_archive<Session>() const;
+	template ArchiveT<Session> ArchiveReader::read_archive<Session>(BarTime<Session> start, BarTime<Session> end) const;
+}
\ No newline at end of file
@@ -0,0 +1,319 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <random>
+#include <new>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include "confounding/sampler.h"
+#include "confounding/constants.h"
+#include "confounding/exception.h"
+
+namespace confounding {
+	namespace {
+		constexpr std::size_t page_size = 4096;
+		constexpr std::size_t bits_per_word = 64;
+
+		bool is_invalid(float value) {
+			return std::isnan(value);
+		}
+
+		bool is_invalid(int32_t value) {
+			return value == intraday_invalid_returns;
+		}
+
+		bool is_valid_record(const std::vector<uint64_t>& validity, std::size_t offset) {
+			return (validity[offset / bits_per_word] >> (offset % bits_per_word)) & 1;
+		}
+
+		// Calls function with a span of the values of the column in range, zero-copy for raw columns in the plain layout
+		template<typename Function>
+		void read_column(const ArchiveReader& reader, const ColumnHeader& column, RecordRange range, Function function) {
+			bool raw = column.encoding == ColumnEncoding::raw && (column.flags & column_flag_blocked) == 0;
+			if (column.type == ColumnType::float32) {
+				if (raw) {
+					function(reader.get_float_span(column.name, range));
+				} else {
+					auto values = reader.read_floats(column.name, range);
+					function(std::span<const float>(values));
+				}
+			} else {
+				if (raw) {
+					function(reader.get_returns_span(column.name, range));
+				} else {
+					auto values = reader.read_returns(column.name, range);
+					function(std::span<const int32_t>(values));
+				}
+			}
+		}
+	}
+
+	// Page-aligned batch buffer that is locked into physical memory if the limits of the process permit it
+	class BatchSampler::Buffer {
+	public:
+		Buffer(std::size_t size)
+			: _size((size * sizeof(float) + page_size - 1) / page_size * page_size),
+			_locked(false) {
+			_data = static_cast<float*>(::operator new(_size, std::align_val_t{page_size}));
+#ifdef _WIN32
+			_locked = VirtualLock(_data, _size) != 0;
+#else
+			_locked = mlock(_data, _size) == 0;
+#endif
+		}
+
+		Buffer(const Buffer&) = delete;
+
+		~Buffer() {
+			if (_locked) {
+#ifdef _WIN32
+				VirtualUnlock(_data, _size);
+#else
+				munlock(_data, _size);
+#endif
+			}
+			::operator delete(_data, std::align_val_t{page_size});
+		}
+
+		Buffer& operator=(const Buffer&) = delete;
+
+		float* get_data() {
+			return _data;
+		}
+
+	private:
+		float* _data;
+		std::size_t _size;
+		bool _locked;
+	};
+
+	BatchSampler::BatchSampler(const SamplerOptions& options)
+		: _options(options),
+		_record_count(0),
+		_current_buffer(nullptr),
+		_stop(false) {
+		if (_options.columns.empty())
+			throw Exception("No columns were specified for the sampler");
+		if (_options.batch_size == 0 || _options.chunk_size == 0 || _options.shuffle_chunks == 0 || _options.prefetch_batches == 0)
+			throw Exception("Invalid sampler options");
+		for (const auto& path : _options.archive_paths) {
+			auto reader = std::make_unique<ArchiveReader>(path);
+			for (const auto& name : _options.columns) {
+				const auto& column = reader->get_column(name);
+				if (column.type != ColumnType::float32 && column.type != ColumnType::int32)
+					throw Exception("Column {} in archive {} can't be sampled", name, path);
+			}
+			_ranges.push_back(reader->get_record_range(_options.start, _options.end));
+			_readers.push_back(std::move(reader));
+		}
+		_validity.resize(_readers.size());
+		std::vector<std::size_t> indexes(_readers.size());
+		std::iota(indexes.begin(), indexes.end(), 0);
+		std::for_each(
+			std::execution::par,
+			indexes.begin(),
+			indexes.end(),
+			[&](std::size_t i) {
+				build_validity(i);
+			}
+		);
+		for (std::size_t i = 0; i < _readers.size(); i++) {
+			const auto& reader = *_readers[i];
+			RecordRange range = _ranges[i];
+			// Chunks start at multiples of the chunk size so that they never straddle the blocks of blocked archives
+			std::size_t chunk_size = _options.chunk_size;
+			if (reader.is_blocked()) {
+				std::size_t block_size = reader.get_header().block_size;
+				chunk_size = (chunk_size + block_size - 1) / block_size * block_size;
+			}
+			std::size_t end = range.first + range.count;
+			for (std::size_t first = range.first; first < end;) {
+				std::size_t last = std::min((first / chunk_size + 1) * chunk_size, end);
+				std::size_t valid_count = 0;
+				for (std::size_t j = first; j < last; j++) {
+					if (is_valid_record(_validity[i], j - range.first))
+						valid_count++;
+				}
+				if (valid_count > 0) {
+					Chunk chunk{
+						.archive = i,
+						.range = RecordRange{.first = first, .count = last - first},
+					};
+					_chunks.push_back(chunk);
+					_record_count += valid_count;
+				}
+				first = last;
+			}
+		}
+		// Otherwise the background thread would keep producing empty epochs without ever waiting for a buffer
+		if (_record_count == 0 || (_options.drop_last && _record_count < _options.batch_size))
+			throw Exception("The archives contain fewer than {} valid records in the specified range", _options.batch_size);
+		// The consumer holds on to one buffer while the producer fills the others
+		for (std::size_t i = 0; i < _options.prefetch_batches + 1; i++) {
+			_buffers.push_back(std::make_unique<Buffer>(_options.batch_size * _options.columns.size()));
+			_free_buffers.push_back(_buffers.back().get());
+		}
+		_thread = std::thread(&BatchSampler::run_producer, this);
+	}
+
+	BatchSampler::~BatchSampler() {
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stop = true;
+		}
+		_buffer_available.notify_all();
+		_thread.join();
+	}
+
+	SampleBatch BatchSampler::next() {
+		std::unique_lock<std::mutex> lock(_mutex);
+		if (_current_buffer != nullptr) {
+			_free_buffers.push_back(_current_buffer);
+			_current_buffer = nullptr;
+			_buffer_available.notify_one();
+		}
+		_entry_available.wait(lock, [&]() {
+			return !_entries.empty() || _error;
+		});
+		if (_entries.empty())
+			std::rethrow_exception(_error);
+		Entry entry = _entries.front();
+		_entries.pop_front();
+		_current_buffer = entry.buffer;
+		SampleBatch batch{
+			.values = entry.buffer != nullptr ? entry.buffer->get_data() : nullptr,
+			.rows = entry.rows,
+			.columns = _options.columns.size(),
+		};
+		return batch;
+	}
+
+	std::size_t BatchSampler::get_record_count() const {
+		return _record_count;
+	}
+
+	void BatchSampler::build_validity(std::size_t archive) {
+		const auto& reader = *_readers[archive];
+		RecordRange range = _ranges[archive];
+		auto& validity = _validity[archive];
+		validity.assign((range.count + bits_per_word - 1) / bits_per_word, ~uint64_t{0});
+		for (const auto& name : _options.columns) {
+			read_column(reader, reader.get_column(name), range, [&](const auto& values) {
+				for (std::size_t i = 0; i < values.size(); i++) {
+					if (is_invalid(values[i]))
+						validity[i / bits_per_word] &= ~(uint64_t{1} << (i % bits_per_word));
+				}
+			});
+		}
+	}
+
+	void BatchSampler::read_chunk(const Chunk& chunk, std::vector<float>& values) const {
+		const auto& reader = *_readers[chunk.archive];
+		const auto& validity = _validity[chunk.archive];
+		std::size_t validity_offset = chunk.range.first - _ranges[chunk.archive].first;
+		std::size_t column_count = _options.columns.size();
+		std::size_t first_row = values.size() / column_count;
+		std::size_t row_count = 0;
+		for (std::size_t i = 0; i < chunk.range.count; i++)
+			row_count += is_valid_record(validity, validity_offset + i) ? 1 : 0;
+		values.resize(values.size() + row_count * column_count);
+		for (std::size_t column_index = 0; column_index < column_count; column_index++) {
+			const auto& column = reader.get_column(_options.columns[column_index]);
+			read_column(reader, column, chunk.range, [&](const auto& column_values) {
+				float* output = values.data() + first_row * column_count + column_index;
+				for (std::size_t i = 0; i < column_values.size(); i++) {
+					if (!is_valid_record(validity, validity_offset + i))
+						continue;
+					*output = static_cast<float>(column_values[i]);
+					output += column_count;
+				}
+			});
+		}
+	}
+
+	void BatchSampler::run_producer() {
+		try {
+			for (uint64_t epoch = 0; produce_epoch(epoch); epoch++);
+		} catch (...) {
+			std::lock_guard<std::mutex> lock(_mutex);
+			_error = std::current_exception();
+			_entry_available.notify_all();
+		}
+	}
+
+	bool BatchSampler::produce_epoch(uint64_t epoch) {
+		std::seed_seq seed{_options.seed, epoch};
+		std::mt19937_64 generator(seed);
+		std::vector<std::size_t> order(_chunks.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::shuffle(order.begin(), order.end(), generator);
+		std::size_t column_count = _options.columns.size();
+		std::size_t row_size = column_count * sizeof(float);
+		std::vector<float> window;
+		std::vector<std::size_t> permutation;
+		Buffer* buffer = nullptr;
+		std::size_t rows = 0;
+		for (std::size_t i = 0; i < order.size(); i += _options.shuffle_chunks) {
+			auto window_begin = order.begin() + i;
+			auto window_end = order.begin() + std::min(i + _options.shuffle_chunks, order.size());
+			// The chunks are stored in file order, reading the randomly selected ones in that order keeps the access pattern sequential
+			std::sort(window_begin, window_end);
+			window.clear();
+			for (auto iterator = window_begin; iterator != window_end; ++iterator)
+				read_chunk(_chunks[*iterator], window);
+			permutation.resize(window.size() / column_count);
+			std::iota(permutation.begin(), permutation.end(), 0);
+			std::shuffle(permutation.begin(), permutation.end(), generator);
+			for (std::size_t row : permutation) {
+				if (buffer == nullptr) {
+					buffer = acquire_buffer();
+					if (buffer == nullptr)
+						return false;
+					rows = 0;
+				}
+				std::memcpy(buffer->get_data() + rows * column_count, window.data() + row * column_count, row_size);
+				rows++;
+				if (rows == _options.batch_size) {
+					push_entry(Entry{.buffer = buffer, .rows = rows});
+					buffer = nullptr;
+				}
+			}
+		}
+		if (buffer != nullptr) {
+			if (_options.drop_last) {
+				std::lock_guard<std::mutex> lock(_mutex);
+				_free_buffers.push_back(buffer);
+			} else {
+				push_entry(Entry{.buffer = buffer, .rows = rows});
+			}
+		}
+		// Marks the end of the epoch
+		push_entry(Entry{.buffer = nullptr, .rows = 0});
+		return true;
+	}
+
+	BatchSampler::Buffer* BatchSampler::acquire_buffer() {
+		std::unique_lock<std::mutex> lock(_mutex);
+		_buffer_available.wait(lock, [&]() {
+			return !_free_buffers.empty() || _stop;
+		});
+		if (_stop)
+			return nullptr;
+		Buffer* buffer = _free_buffers.back();
+		_free_buffers.pop_back();
+		return buffer;
+	}
+
+	void BatchSampler::push_entry(Entry entry) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		_entries.push_back(entry);
+		_entry_available.notify_one();
+	}
+}
\ No newline at end of file
@@ -0,0 +1,533 @@
+#include <cstring>
+#include <cerrno>
+#include <thread>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <WinSock2.h>
+#include <afunix.h>
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#include "confounding/service.h"
+#include "confounding/writer.h"
+#include "confounding/common.h"
+#include "confounding/exception.h"
+#include "confounding/configuration/contracts.h"
+#include "confounding/configuration/filters.h"
+
+namespace confounding {
+	namespace {
+		typedef std::intptr_t Socket;
+
+		constexpr Socket invalid_socket = -1;
+		constexpr Time all_time_start = Time::min();
+		constexpr Time all_time_end = Time::max();
+
+#ifdef _WIN32
+		std::once_flag winsock_flag;
+
+		void initialize_sockets() {
+			std::call_once(winsock_flag, []() {
+				WSADATA data;
+				int result = WSAStartup(MAKEWORD(2, 2), &data);
+				if (result != 0)
+					throw Exception("Failed to initialize Winsock (error {})", result);
+			});
+		}
+
+		std::string get_socket_error() {
+			return std::format("error {}", WSAGetLastError());
+		}
+
+		void close_socket(Socket socket) {
+			closesocket(static_cast<SOCKET>(socket));
+		}
+
+		uint32_t get_process_id() {
+			return static_cast<uint32_t>(GetCurrentProcessId());
+		}
+#else
+		void initialize_sockets() {
+		}
+
+		std::string get_socket_error() {
+			return std::strerror(errno);
+		}
+
+		void close_socket(Socket socket) {
+			::close(static_cast<int>(socket));
+		}
+
+		uint32_t get_process_id() {
+			return static_cast<uint32_t>(getpid());
+		}
+#endif
+
+		sockaddr_un get_socket_address(const std::string& path) {
+			sockaddr_un address;
+			std::memset(&address, 0, sizeof(address));
+			address.sun_family = AF_UNIX;
+			if (path.size() >= sizeof(address.sun_path))
+				throw Exception("Socket path is too long: {}", path);
+			std::memcpy(address.sun_path, path.data(), path.size());
+			return address;
+		}
+
+		Socket create_socket() {
+			initialize_sockets();
+			Socket output = static_cast<Socket>(::socket(AF_UNIX, SOCK_STREAM, 0));
+			if (output == invalid_socket)
+				throw Exception("Failed to create socket ({})", get_socket_error());
+			return output;
+		}
+
+		void send_all(Socket socket, const void* data, std::size_t size) {
+			auto pointer = static_cast<const char*>(data);
+			while (size > 0) {
+				auto bytes_sent = ::send(socket, pointer, static_cast<int>(size), 0);
+				if (bytes_sent <= 0)
+					throw Exception("Failed to send data ({})", get_socket_error());
+				pointer += bytes_sent;
+				size -= static_cast<std::size_t>(bytes_sent);
+			}
+		}
+
+		// Returns false if the peer closed the connection before sending anything
+		bool receive_all(Socket socket, void* data, std::size_t size, std::size_t offset = 0) {
+			auto pointer = static_cast<char*>(data);
+			while (offset < size) {
+				auto bytes_received = ::recv(socket, pointer + offset, static_cast<int>(size - offset), 0);
+				if (bytes_received == 0 && offset == 0)
+					return false;
+				if (bytes_received <= 0)
+					throw Exception("Failed to receive data ({})", get_socket_error());
+				offset += static_cast<std::size_t>(bytes_received);
+			}
+			return true;
+		}
+
+		template<std::size_t N>
+		std::string get_string(const char (&source)[N]) {
+			return std::string(source, strnlen(source, N));
+		}
+
+		template<std::size_t N>
+		void copy_message(char (&destination)[N], const std::string& source) {
+			std::size_t size = std::min(source.size(), N - 1);
+			std::memset(destination, 0, N);
+			std::memcpy(destination, source.data(), size);
+		}
+
+		Archive get_archive_slice(const Archive& archive, Time start, Time end) {
+			Archive slice;
+			slice.symbol = archive.symbol;
+			slice.series = archive.series;
+			slice.extra_columns = archive.extra_columns;
+			for (const auto& record : archive.daily_records) {
+				Time day = get_time(record.date);
+				if (day < end && start < day + std::chrono::hours{24})
+					slice.daily_records.push_back(record);
+			}
+			const auto& timestamps = archive.intraday_timestamps;
+			std::size_t first = std::lower_bound(timestamps.begin(), timestamps.end(), start) - timestamps.begin();
+			std::size_t last = std::lower_bound(timestamps.begin(), timestamps.end(), end) - timestamps.begin();
+			if (first < last) {
+				std::size_t extra_count = archive.extra_columns.size();
+				slice.intraday_timestamps.assign(timestamps.begin() + first, timestamps.begin() + last);
+				slice.intraday_records.assign(archive.intraday_records.begin() + first, archive.intraday_records.begin() + last);
+				slice.extra_values.assign(
+					archive.extra_values.begin() + first * extra_count,
+					archive.extra_values.begin() + last * extra_count
+				);
+			}
+			for (const auto& run : archive.invalid_runs) {
+				Time run_start = std::max(run.start, start);
+				Time run_end = std::min(run.start + std::chrono::hours{run.length}, end);
+				if (run_start >= run_end)
+					continue;
+				InvalidRun clipped_run{
+					.start = run_start,
+					.length = static_cast<uint32_t>((run_end - run_start).count())
+				};
+				slice.invalid_runs.push_back(clipped_run);
+			}
+			return slice;
+		}
+
+		void check_columns(const Archive& archive, const std::set<std::string>& columns) {
+			for (const auto& column : columns) {
+				bool intraday_column = std::ranges::any_of(intraday_columns, [&](const IntradayColumn& intraday_column) {
+					return column == intraday_column.name;
+				});
+				if (!intraday_column && std::ranges::find(archive.extra_columns, column) == archive.extra_columns.end())
+					throw Exception("Unknown column: {}", column);
+			}
+		}
+	}
+
+	// Read-only segment of memory that can be handed to other processes
+	class ArchiveService::SharedMemory {
+	public:
+		SharedMemory(const std::vector<char>& data);
+		SharedMemory(const SharedMemory&) = delete;
+		~SharedMemory();
+
+		SharedMemory& operator=(const SharedMemory&) = delete;
+
+		SharedMemoryHandle get_handle() const;
+		std::size_t get_size() const;
+
+	private:
+		SharedMemoryHandle _handle;
+		std::size_t _size;
+	};
+
+#ifdef _WIN32
+	ArchiveService::SharedMemory::SharedMemory(const std::vector<char>& data)
+		: _handle(nullptr),
+		_size(data.size()) {
+		uint64_t size = data.size();
+		_handle = CreateFileMappingA(
+			INVALID_HANDLE_VALUE,
+			nullptr,
+			PAGE_READWRITE,
+			static_cast<DWORD>(size >> 32),
+			static_cast<DWORD>(size & 0xffffffff),
+			nullptr
+		);
+		if (_handle == nullptr)
+			throw Exception("Failed to create shared memory (error {})", GetLastError());
+		void* view = MapViewOfFile(_handle, FILE_MAP_WRITE, 0, 0, data.size());
+		if (view == nullptr) {
+			DWORD error = GetLastError();
+			CloseHandle(_handle);
+			throw Exception("Failed to map shared memory (error {})", error);
+		}
+		std::memcpy(view, data.data(), data.size());
+		UnmapViewOfFile(view);
+	}
+
+	ArchiveService::SharedMemory::~SharedMemory() {
+		CloseHandle(_handle);
+	}
+#else
+	ArchiveService::SharedMemory::SharedMemory(const std::vector<char>& data)
+		: _handle(-1),
+		_size(data.size()) {
+		_handle = memfd_create("confounding", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+		if (_handle == -1)
+			throw Exception("Failed to create shared memory ({})", std::strerror(errno));
+		std::size_t offset = 0;
+		while (offset < data.size()) {
+			ssize_t bytes_written = ::write(_handle, data.data() + offset, data.size() - offset);
+			if (bytes_written == -1 && errno == EINTR)
+				continue;
+			if (bytes_written <= 0) {
+				int error = errno;
+				::close(_handle);
+				throw Exception("Failed to write to shared memory ({})", std::strerror(error));
+			}
+			offset += static_cast<std::size_t>(bytes_written);
+		}
+		// Clients can rely on the segment never changing underneath their mappings
+		if (fcntl(_handle, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+			int error = errno;
+			::close(_handle);
+			throw Exception("Failed to seal shared memory ({})", std::strerror(error));
+		}
+	}
+
+	ArchiveService::SharedMemory::~SharedMemory() {
+		::close(_handle);
+	}
+#endif
+
+	SharedMemoryHandle ArchiveService::SharedMemory::get_handle() const {
+		return _handle;
+	}
+
+	std::size_t ArchiveService::SharedMemory::get_size() const {
+		return _size;
+	}
+
+	ArchiveService::ArchiveService(const std::string& socket_path)
+		: _socket_path(socket_path),
+		_socket(invalid_socket) {
+		auto address = get_socket_address(socket_path);
+		// Remove the socket of a previous instance that wasn't shut down cleanly
+		std::filesystem::remove(socket_path);
+		_socket = create_socket();
+		if (::bind(_socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+			std::string error = get_socket_error();
+			close_socket(_socket);
+			throw Exception("Failed to bind socket {} ({})", socket_path, error);
+		}
+		if (::listen(_socket, SOMAXCONN) != 0) {
+			std::string error = get_socket_error();
+			close_socket(_socket);
+			throw Exception("Failed to listen on socket {} ({})", socket_path, error);
+		}
+	}
+
+	ArchiveService::~ArchiveService() {
+		close_socket(_socket);
+		std::error_code error;
+		std::filesystem::remove(_socket_path, error);
+	}
+
+	void ArchiveService::run() {
+		while (true) {
+			Socket client = static_cast<Socket>(::accept(_socket, nullptr, nullptr));
+			if (client == invalid_socket) {
+#ifndef _WIN32
+				if (errno == EINTR || errno == ECONNABORTED)
+					continue;
+#endif
+				throw Exception("Failed to accept connection ({})", get_socket_error());
+			}
+			// The threads are detached because the service only stops when the process is terminated
+			std::thread(&ArchiveService::handle_client, this, client).detach();
+		}
+	}
+
+	void ArchiveService::handle_client(std::intptr_t client) {
+		try {
+			ServiceRequest request;
+			while (receive_all(client, &request, sizeof(request))) {
+				ServiceResponse response;
+				std::memset(&response, 0, sizeof(response));
+				response.magic = service_magic;
+				std::shared_ptr<SharedMemory> segment;
+				try {
+					if (request.magic != service_magic)
+						throw Exception("Invalid request");
+					segment = get_segment(request);
+					response.success = 1;
+					response.size = segment->get_size();
+				} catch (const std::exception& exception) {
+					copy_message(response.message, exception.what());
+				}
+#ifdef _WIN32
+				if (segment) {
+					HANDLE process = OpenProcess(PROCESS_DUP_HANDLE, FALSE, request.process_id);
+					HANDLE client_handle = nullptr;
+					bool success =
+						process != nullptr &&
+						DuplicateHandle(GetCurrentProcess(), segment->get_handle(), process, &client_handle, FILE_MAP_READ, FALSE, 0);
+					if (success) {
+						response.handle = reinterpret_cast<uint64_t>(client_handle);
+					} else {
+						response.success = 0;
+						copy_message(response.message, std::format("Failed to duplicate handle (error {})", GetLastError()));
+					}
+					if (process != nullptr)
+						CloseHandle(process);
+				}
+				send_all(client, &response, sizeof(response));
+#else
+				// The memfd is passed as ancillary data of the response
+				iovec vector{
+					.iov_base = &response,
+					.iov_len = sizeof(response),
+				};
+				alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+				std::memset(control, 0, sizeof(control));
+				msghdr message;
+				std::memset(&message, 0, sizeof(message));
+				message.msg_iov = &vector;
+				message.msg_iovlen = 1;
+				if (segment) {
+					message.msg_control = control;
+					message.msg_controllen = sizeof(control);
+					cmsghdr* header = CMSG_FIRSTHDR(&message);
+					header->cmsg_level = SOL_SOCKET;
+					header->cmsg_type = SCM_RIGHTS;
+					header->cmsg_len = CMSG_LEN(sizeof(int));
+					int handle = segment->get_handle();
+					std::memcpy(CMSG_DATA(header), &handle, sizeof(handle));
+				}
+				ssize_t bytes_sent = ::sendmsg(static_cast<int>(client), &message, MSG_NOSIGNAL);
+				if (bytes_sent <= 0)
+					throw Exception("Failed to send response ({})", get_socket_error());
+				if (static_cast<std::size_t>(bytes_sent) < sizeof(response))
+					send_all(client, reinterpret_cast<const char*>(&response) + bytes_sent, sizeof(response) - bytes_sent);
+#endif
+			}
+		} catch (const std::exception&) {
+			// Clients that disconnect in the middle of a request are dropped without affecting the others
+		}
+		close_socket(client);
+	}
+
+	std::shared_ptr<ArchiveService::SharedMemory> ArchiveService::get_segment(const ServiceRequest& request) {
+		std::string symbol = get_string(request.symbol);
+		std::string series = get_string(request.series);
+		if (request.column_count > service_max_columns)
+			throw Exception("Too many columns in request: {}", request.column_count);
+		std::set<std::string> columns;
+		for (uint32_t i = 0; i < request.column_count; i++)
+			columns.insert(get_string(request.columns[i]));
+		Time start{std::chrono::hours{request.start}};
+		Time end{std::chrono::hours{request.end}};
+		bool entire_archive = columns.empty() && start == all_time_start && end == all_time_end;
+		auto& cache = get_symbol_cache(symbol);
+		std::shared_ptr<const Archive> archive;
+		{
+			std::lock_guard<std::mutex> lock(cache.mutex);
+			update_symbol_cache(symbol, cache);
+			archive = get_archive(symbol, series, cache);
+			if (entire_archive) {
+				auto& segment = cache.segments[series];
+				if (!segment) {
+					ArchiveOptions options{
+						.compression_level = default_compression_level,
+					};
+					ArchiveWriter writer(*archive, options);
+					segment = std::make_shared<SharedMemory>(writer.release());
+				}
+				return segment;
+			}
+		}
+		// Partial archives aren't cached and are encoded without holding the lock
+		check_columns(*archive, columns);
+		ArchiveOptions options{
+			.compression_level = default_compression_level,
+			.columns = std::move(columns),
+		};
+		std::vector<char> data;
+		if (start == all_time_start && end == all_time_end) {
+			ArchiveWriter writer(*archive, options);
+			data = writer.release();
+		} else {
+			Archive slice = get_archive_slice(*archive, start, end);
+			ArchiveWriter writer(slice, options);
+			data = writer.release();
+		}
+		return std::make_shared<SharedMemory>(data);
+	}
+
+	ArchiveService::SymbolCache& ArchiveService::get_symbol_cache(const std::string& symbol) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto& cache = _symbols[symbol];
+		if (!cache)
+			cache = std::make_unique<SymbolCache>();
+		return *cache;
+	}
+
+	void ArchiveService::update_symbol_cache(const std::string& symbol, SymbolCache& cache) {
+		std::string daily_path = ArchiveGenerator::get_symbol_path(symbol, "D1");
+		std::string intraday_path = ArchiveGenerator::get_symbol_path(symbol, "H1");
+		// Checked before reading the files so that modifications made while reading them trigger another update
+		auto daily_time = std::filesystem::last_write_time(daily_path);
+		auto intraday_time = std::filesystem::last_write_time(intraday_path);
+		if (cache.loaded && daily_time == cache.daily_time && intraday_time == cache.intraday_time)
+			return;
+		const auto& filter = ContractFilterConfiguration::get().get_filter(symbol);
+		cache.loaded = false;
+		cache.archives.clear();
+		cache.segments.clear();
+		cache.daily_records = ArchiveGenerator::read_daily_records(symbol, filter);
+		cache.intraday_records = ArchiveGenerator::read_intraday_records(symbol, filter);
+		cache.daily_time = daily_time;
+		cache.intraday_time = intraday_time;
+		cache.loaded = true;
+	}
+
+	std::shared_ptr<const Archive> ArchiveService::get_archive(const std::string& symbol, const std::string& series, SymbolCache& cache) {
+		auto iterator = cache.archives.find(series);
+		if (iterator != cache.archives.end())
+			return iterator->second;
+		auto f_number = ArchiveGenerator::get_f_number(series);
+		const auto& contract = ContractConfiguration::get().get_contract(symbol);
+		const auto& filter = ContractFilterConfiguration::get().get_filter(symbol);
+		if (!f_number && !filter.enable_fy_records)
+			throw Exception("FY records are disabled for {}", symbol);
+		ArchiveGenerator generator(
+			f_number,
+			!f_number.has_value(),
+			symbol,
+			cache.daily_records,
+			cache.intraday_records,
+			filter,
+			contract
+		);
+		auto archive = std::make_shared<const Archive>(generator.build_archive());
+		cache.archives[series] = archive;
+		return archive;
+	}
+
+	ArchiveClient::ArchiveClient(const std::string& socket_path)
+		: _socket(invalid_socket) {
+		auto address = get_socket_address(socket_path);
+		_socket = create_socket();
+		if (::connect(_socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+			std::string error = get_socket_error();
+			close_socket(_socket);
+			throw Exception("Failed to connect to archive service {} ({})", socket_path, error);
+		}
+	}
+
+	ArchiveClient::~ArchiveClient() {
+		close_socket(_socket);
+	}
+
+	ArchiveReader ArchiveClient::request(const ServiceQuery& query) {
+		ServiceRequest request;
+		std::memset(&request, 0, sizeof(request));
+		request.magic = service_magic;
+		request.process_id = get_process_id();
+		copy_string(request.symbol, query.symbol);
+		copy_string(request.series, query.series);
+		request.start = query.start.value_or(all_time_start).time_since_epoch().count();
+		request.end = query.end.value_or(all_time_end).time_since_epoch().count();
+		if (query.columns.size() > service_max_columns)
+			throw Exception("Too many columns in query: {}", query.columns.size());
+		request.column_count = static_cast<uint32_t>(query.columns.size());
+		for (std::size_t i = 0; i < query.columns.size(); i++)
+			copy_string(request.columns[i], query.columns[i]);
+		send_all(_socket, &request, sizeof(request));
+		ServiceResponse response;
+#ifdef _WIN32
+		if (!receive_all(_socket, &response, sizeof(response)))
+			throw Exception("Archive service closed the connection");
+		auto handle = reinterpret_cast<SharedMemoryHandle>(response.handle);
+#else
+		iovec vector{
+			.iov_base = &response,
+			.iov_len = sizeof(response),
+		};
+		alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+		msghdr message;
+		std::memset(&message, 0, sizeof(message));
+		message.msg_iov = &vector;
+		message.msg_iovlen = 1;
+		message.msg_control = control;
+		message.msg_controllen = sizeof(control);
+		ssize_t bytes_received = ::recvmsg(static_cast<int>(_socket), &message, MSG_CMSG_CLOEXEC);
+		if (bytes_received <= 0)
+			throw Exception("Archive service closed the connection");
+		int handle = -1;
+		cmsghdr* header = CMSG_FIRSTHDR(&message);
+		if (header != nullptr && header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS)
+			std::memcpy(&handle, CMSG_DATA(header), sizeof(handle));
+		receive_all(_socket, &response, sizeof(response), static_cast<std::size_t>(bytes_received));
+#endif
+		if (response.magic != service_magic)
+			throw Exception("Invalid response from archive service");
+		if (!response.success)
+			throw Exception("Archive service failed to process request: {}", get_string(response.message));
+#ifndef _WIN32
+		if (handle == -1)
+			throw Exception("Archive service didn't send a shared memory segment");
+#endif
+		auto file = MappedFile::from_shared_memory(handle, response.size);
+		return ArchiveReader(std::move(file));
+	}
+}
\ No newline at end of file
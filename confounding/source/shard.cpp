@@ -0,0 +1,134 @@
+#include <array>
+#include <format>
+#include <cstring>
+
+#include "confounding/yaml.h"
+#include "confounding/shard.h"
+#include "confounding/common.h"
+#include "confounding/output.h"
+#include "confounding/mapping.h"
+#include "confounding/format.h"
+#include "confounding/configuration/base.h"
+
+namespace confounding {
+	namespace {
+		constexpr const char* shard_directory = "shards";
+
+		template<typename T>
+		void append_value(std::vector<char>& buffer, const T& value) {
+			const char* data = reinterpret_cast<const char*>(&value);
+			buffer.insert(buffer.end(), data, data + sizeof(T));
+		}
+
+		template<typename T>
+		T read_value(const MappedFile& file, std::size_t& offset) {
+			if (offset + sizeof(T) > file.get_size())
+				throw Exception("Daily returns file is truncated");
+			T value;
+			std::memcpy(&value, file.get_data() + offset, sizeof(T));
+			offset += sizeof(T);
+			return value;
+		}
+	}
+
+	ArchiveManifest ArchiveManifest::load(const std::string& path) {
+		YAML::Node doc = YAML::LoadFile(path);
+		ArchiveManifest manifest{
+			.shard = ShardSpecification{
+				.index = doc["shard_index"].as<unsigned>(),
+				.count = doc["shard_count"].as<unsigned>(),
+			},
+			.bar_resolution = get_bar_resolution(doc["bar_resolution"].as<std::string>()),
+			.reference_date = get_date(doc["reference_date"].as<std::string>()),
+			.symbols = doc["symbols"].as<std::vector<std::string>>(),
+		};
+		for (const auto& entry : doc["archives"]) {
+			ManifestArchive archive{
+				.symbol = entry["symbol"].as<std::string>(),
+				.series = entry["series"].as<std::string>(),
+				.file = entry["file"].as<std::string>(),
+				.size = entry["size"].as<uint64_t>(),
+			};
+			manifest.archives.push_back(archive);
+		}
+		return manifest;
+	}
+
+	void ArchiveManifest::save(const std::string& path) const {
+		YAML::Emitter emitter;
+		emitter << YAML::BeginMap;
+		emitter << YAML::Key << "shard_index" << YAML::Value << shard.index;
+		emitter << YAML::Key << "shard_count" << YAML::Value << shard.count;
+		emitter << YAML::Key << "bar_resolution" << YAML::Value << get_bar_resolution_string(bar_resolution);
+		emitter << YAML::Key << "reference_date" << YAML::Value << get_date_string(reference_date);
+		emitter << YAML::Key << "symbols" << YAML::Value << YAML::Flow << symbols;
+		emitter << YAML::Key << "archives" << YAML::Value << YAML::BeginSeq;
+		for (const auto& archive : archives) {
+			emitter << YAML::BeginMap;
+			emitter << YAML::Key << "symbol" << YAML::Value << archive.symbol;
+			emitter << YAML::Key << "series" << YAML::Value << archive.series;
+			emitter << YAML::Key << "file" << YAML::Value << archive.file;
+			emitter << YAML::Key << "size" << YAML::Value << archive.size;
+			emitter << YAML::EndMap;
+		}
+		emitter << YAML::EndSeq;
+		emitter << YAML::EndMap;
+		if (!emitter.good())
+			throw Exception("Failed to serialize manifest {}: {}", path, emitter.GetLastError());
+		write_file(path, emitter.c_str(), emitter.size());
+	}
+
+	ShardSpecification get_shard_specification(const std::string& string) {
+		auto separator = string.find('/');
+		if (separator == std::string::npos)
+			throw Exception("Invalid shard specification: {}", string);
+		ShardSpecification shard{
+			.index = get_number<unsigned>(string.substr(0, separator)),
+			.count = get_number<unsigned>(string.substr(separator + 1)),
+		};
+		if (shard.count == 0 || shard.index == 0 || shard.index > shard.count)
+			throw Exception("Invalid shard specification: {}", string);
+		return shard;
+	}
+
+	std::string get_shard_directory(ShardSpecification shard) {
+		const auto& configuration = Configuration::get();
+		Path path = Path(configuration.archive_directory) / shard_directory / std::format("{}.{}", shard.index, shard.count);
+		return path.string();
+	}
+
+	void write_daily_returns(const std::string& path, const std::vector<std::string>& symbols, const std::vector<DailyReturns>& daily_returns) {
+		std::vector<char> buffer;
+		append_value(buffer, static_cast<uint32_t>(symbols.size()));
+		for (std::size_t i = 0; i < symbols.size(); i++) {
+			char symbol[archive_symbol_size];
+			copy_string(symbol, symbols[i]);
+			buffer.insert(buffer.end(), symbol, symbol + archive_symbol_size);
+			const auto& symbol_returns = daily_returns[i];
+			append_value(buffer, static_cast<uint64_t>(symbol_returns.size()));
+			for (const auto& [date, _] : symbol_returns)
+				append_value(buffer, static_cast<int32_t>(std::chrono::sys_days{date}.time_since_epoch().count()));
+			for (const auto& [_, returns] : symbol_returns)
+				append_value(buffer, returns);
+		}
+		write_file(path, buffer.data(), buffer.size());
+	}
+
+	std::map<std::string, DailyReturns> read_daily_returns(const std::string& path) {
+		MappedFile file(path);
+		std::size_t offset = 0;
+		std::map<std::string, DailyReturns> daily_returns;
+		auto symbol_count = read_value<uint32_t>(file, offset);
+		for (uint32_t i = 0; i < symbol_count; i++) {
+			auto symbol = read_value<std::array<char, archive_symbol_size>>(file, offset);
+			auto& symbol_returns = daily_returns[std::string(symbol.data(), strnlen(symbol.data(), archive_symbol_size))];
+			auto date_count = read_value<uint64_t>(file, offset);
+			std::vector<Date> dates;
+			for (uint64_t j = 0; j < date_count; j++)
+				dates.push_back(Date{std::chrono::sys_days{std::chrono::days{read_value<int32_t>(file, offset)}}});
+			for (Date date : dates)
+				symbol_returns[date] = read_value<double>(file, offset);
+		}
+		return daily_returns;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,316 @@
+#include <cstring>
+#include <algorithm>
+#include <execution>
+#include <numeric>
+
+#include "confounding/writer.h"
+#include "confounding/exception.h"
+#include "confounding/compression.h"
+#include "confounding/output.h"
+
+namespace confounding {
+	namespace {
+		template<typename T>
+		std::vector<char> get_bytes(const std::vector<T>& values) {
+			const char* pointer = reinterpret_cast<const char*>(values.data());
+			std::vector<char> output(pointer, pointer + values.size() * sizeof(T));
+			return output;
+		}
+	}
+
+	template<BarDuration Bar>
+	ArchiveWriterT<Bar>::ArchiveWriterT(const ArchiveT<Bar>& archive, const ArchiveOptions& options)
+		: _archive(archive),
+		_options(options),
+		_day_index_start(0) {
+		if (_options.block_size && *_options.block_size == 0)
+			throw Exception("Invalid archive block size");
+	}
+
+	template<BarDuration Bar>
+	const std::vector<char>& ArchiveWriterT<Bar>::encode() {
+		if (!_columns.empty()) {
+			if (_buffer.empty())
+				throw Exception("The encoded archive has already been released");
+			return _buffer;
+		}
+		if (_archive.intraday_timestamps.size() != _archive.intraday_records.size()) {
+			throw Exception(
+				"Number of intraday timestamps ({}) doesn't match number of intraday records ({})",
+				_archive.intraday_timestamps.size(),
+				_archive.intraday_records.size()
+			);
+		}
+		if (_archive.extra_values.size() != _archive.intraday_records.size() * _archive.extra_columns.size())
+			throw Exception("Number of extra values doesn't match number of intraday records");
+		encode_daily_records();
+		encode_intraday_records();
+		encode_invalid_runs();
+		encode_day_index();
+		if (_options.block_size)
+			compress_blocks();
+		serialize();
+		return _buffer;
+	}
+
+	template<BarDuration Bar>
+	std::vector<ColumnStatistics> ArchiveWriterT<Bar>::write(const std::string& path) {
+		const auto& buffer = encode();
+		write_file(path, buffer.data(), buffer.size());
+		return get_statistics();
+	}
+
+	template<BarDuration Bar>
+	std::vector<char> ArchiveWriterT<Bar>::release() {
+		encode();
+		return std::move(_buffer);
+	}
+
+	template<BarDuration Bar>
+	std::vector<ColumnStatistics> ArchiveWriterT<Bar>::get_statistics() const {
+		std::vector<ColumnStatistics> statistics;
+		for (const auto& column : _columns) {
+			ColumnStatistics column_statistics{
+				.name = column.name,
+				.encoding = column.encoding,
+				.size = column.size,
+				.max_error = column.max_error,
+			};
+			statistics.push_back(column_statistics);
+		}
+		return statistics;
+	}
+
+	template<BarDuration Bar>
+	void ArchiveWriterT<Bar>::encode_daily_records() {
+		std::vector<int32_t> dates;
+		std::vector<int64_t> closes;
+		dates.reserve(_archive.daily_records.size());
+		closes.reserve(_archive.daily_records.size());
+		for (const auto& record : _archive.daily_records) {
+			auto days = std::chrono::sys_days{record.date}.time_since_epoch().count();
+			dates.push_back(static_cast<int32_t>(days));
+			closes.push_back(record.close.to_int());
+		}
+		std::size_t count = _archive.daily_records.size();
+		add_column(daily_date_column, ColumnType::int32, ColumnEncoding::raw, count, get_bytes(dates), 0.0, 0);
+		add_column(daily_close_column, ColumnType::int64, ColumnEncoding::raw, count, get_bytes(closes), 0.0, 0);
+	}
+
+	template<BarDuration Bar>
+	void ArchiveWriterT<Bar>::encode_intraday_records() {
+		const auto& records = _archive.intraday_records;
+		std::size_t count = records.size();
+		std::vector<int64_t> timestamps;
+		timestamps.reserve(count);
+		for (BarTime<Bar> time : _archive.intraday_timestamps)
+			timestamps.push_back(static_cast<int64_t>(time.time_since_epoch().count()));
+		uint8_t flags = _options.block_size ? column_flag_blocked : 0;
+		add_column(intraday_time_column, ColumnType::int64, ColumnEncoding::raw, count, get_bytes(timestamps), 0.0, flags);
+		std::vector<float> floats;
+		std::vector<int32_t> integers;
+		for (const auto& column : intraday_columns) {
+			if (!_options.include_column(column.name))
+				continue;
+			ColumnEncoding encoding = get_encoding(column.name, column.type);
+			std::vector<char> data;
+			double max_error;
+			if (column.type == ColumnType::float32) {
+				floats.resize(count);
+				for (std::size_t i = 0; i < count; i++)
+					std::memcpy(&floats[i], reinterpret_cast<const char*>(&records[i]) + column.offset, sizeof(float));
+				max_error = encode_floats(floats, encoding, data);
+			} else {
+				integers.resize(count);
+				for (std::size_t i = 0; i < count; i++)
+					std::memcpy(&integers[i], reinterpret_cast<const char*>(&records[i]) + column.offset, sizeof(int32_t));
+				max_error = encode_returns(integers, encoding, data);
+			}
+			add_column(column.name, column.type, encoding, count, std::move(data), max_error, flags);
+		}
+		std::size_t extra_count = _archive.extra_columns.size();
+		for (std::size_t i = 0; i < extra_count; i++) {
+			const auto& name = _archive.extra_columns[i];
+			if (!_options.include_column(name))
+				continue;
+			ColumnEncoding encoding = get_encoding(name, ColumnType::int32);
+			integers.resize(count);
+			for (std::size_t j = 0; j < count; j++)
+				integers[j] = _archive.extra_values[j * extra_count + i];
+			std::vector<char> data;
+			double max_error = encode_returns(integers, encoding, data);
+			add_column(name, ColumnType::int32, encoding, count, std::move(data), max_error, flags | column_flag_extra);
+		}
+	}
+
+	template<BarDuration Bar>
+	void ArchiveWriterT<Bar>::encode_invalid_runs() {
+		std::vector<int64_t> starts;
+		std::vector<int32_t> lengths;
+		starts.reserve(_archive.invalid_runs.size());
+		lengths.reserve(_archive.invalid_runs.size());
+		for (const auto& run : _archive.invalid_runs) {
+			starts.push_back(static_cast<int64_t>(run.start.time_since_epoch().count()));
+			lengths.push_back(static_cast<int32_t>(run.length));
+		}
+		std::size_t count = _archive.invalid_runs.size();
+		add_column(invalid_run_start_column, ColumnType::int64, ColumnEncoding::raw, count, get_bytes(starts), 0.0, 0);
+		add_column(invalid_run_length_column, ColumnType::int32, ColumnEncoding::raw, count, get_bytes(lengths), 0.0, 0);
+	}
+
+	template<BarDuration Bar>
+	void ArchiveWriterT<Bar>::encode_day_index() {
+		const auto& timestamps = _archive.intraday_timestamps;
+		std::vector<int64_t> offsets;
+		if (!timestamps.empty()) {
+			auto first_day = std::chrono::floor<std::chrono::days>(timestamps.front());
+			auto last_day = std::chrono::floor<std::chrono::days>(timestamps.back());
+			_day_index_start = first_day.time_since_epoch().count();
+			auto day_count = (last_day - first_day).count() + 1;
+			offsets.reserve(day_count + 1);
+			std::size_t index = 0;
+			for (int64_t i = 0; i <= day_count; i++) {
+				auto day = first_day + std::chrono::days{i};
+				while (index < timestamps.size() && timestamps[index] < day)
+					index++;
+				offsets.push_back(static_cast<int64_t>(index));
+			}
+		}
+		add_column(day_index_column, ColumnType::int64, ColumnEncoding::raw, offsets.size(), get_bytes(offsets), 0.0, 0);
+	}
+
+	template<BarDuration Bar>
+	void ArchiveWriterT<Bar>::add_column(
+		const std::string& name,
+		ColumnType type,
+		ColumnEncoding encoding,
+		std::size_t count,
+		std::vector<char>&& data,
+		double max_error,
+		uint8_t flags
+	) {
+		ColumnHeader column;
+		std::memset(&column, 0, sizeof(column));
+		copy_string(column.name, name);
+		column.type = type;
+		column.encoding = encoding;
+		column.flags = flags;
+		column.count = count;
+		column.size = data.size();
+		column.max_error = max_error;
+		_columns.push_back(column);
+		_column_data.push_back(std::move(data));
+	}
+
+	template<BarDuration Bar>
+	ColumnEncoding ArchiveWriterT<Bar>::get_encoding(const std::string& name, ColumnType type) const {
+		auto iterator = _options.column_encodings.find(name);
+		if (iterator == _options.column_encodings.end())
+			return ColumnEncoding::raw;
+		ColumnEncoding encoding = iterator->second;
+		if (!is_valid_encoding(type, encoding))
+			throw Exception("Encoding {} can't be used for column {}", get_encoding_string(encoding), name);
+		return encoding;
+	}
+
+	template<BarDuration Bar>
+	void ArchiveWriterT<Bar>::compress_blocks() {
+		const auto& timestamps = _archive.intraday_timestamps;
+		std::size_t block_size = *_options.block_size;
+		for (std::size_t first = 0; first < timestamps.size(); first += block_size) {
+			std::size_t last = std::min(first + block_size, timestamps.size()) - 1;
+			ArchiveBlock block{
+				.first_time = static_cast<int64_t>(timestamps[first].time_since_epoch().count()),
+				.last_time = static_cast<int64_t>(timestamps[last].time_since_epoch().count()),
+				.first_record = first,
+				.record_count = last - first + 1,
+			};
+			_blocks.push_back(block);
+		}
+		std::vector<std::size_t> indexes(_columns.size());
+		std::iota(indexes.begin(), indexes.end(), 0);
+		// zlib is the bottleneck here, compress the columns in parallel
+		std::for_each(
+			std::execution::par,
+			indexes.begin(),
+			indexes.end(),
+			[&](std::size_t i) {
+				auto& column = _columns[i];
+				if ((column.flags & column_flag_blocked) == 0)
+					return;
+				_column_data[i] = compress_column(column, _column_data[i]);
+				column.size = _column_data[i].size();
+			}
+		);
+	}
+
+	template<BarDuration Bar>
+	std::vector<char> ArchiveWriterT<Bar>::compress_column(const ColumnHeader& column, const std::vector<char>& data) const {
+		std::size_t element_size = get_encoded_size(column.type, column.encoding);
+		std::vector<BlockEntry> entries;
+		std::vector<char> blocks;
+		for (const auto& block : _blocks) {
+			const char* block_data = data.data() + block.first_record * element_size;
+			auto compressed_block = compress_block(
+				column.type,
+				column.encoding,
+				block_data,
+				block.record_count,
+				_options.compression_level
+			);
+			BlockEntry entry{
+				.offset = _blocks.size() * sizeof(BlockEntry) + blocks.size(),
+				.compressed_size = static_cast<uint32_t>(compressed_block.size()),
+				.payload_size = static_cast<uint32_t>(block.record_count * element_size),
+			};
+			entries.push_back(entry);
+			blocks.insert(blocks.end(), compressed_block.begin(), compressed_block.end());
+		}
+		std::vector<char> output = get_bytes(entries);
+		output.insert(output.end(), blocks.begin(), blocks.end());
+		return output;
+	}
+
+	template<BarDuration Bar>
+	void ArchiveWriterT<Bar>::serialize() {
+		ArchiveHeader header;
+		std::memset(&header, 0, sizeof(header));
+		header.magic = archive_magic;
+		header.version = archive_version;
+		copy_string(header.symbol, _archive.symbol);
+		copy_string(header.series, _archive.series);
+		header.daily_record_count = _archive.daily_records.size();
+		header.intraday_record_count = _archive.intraday_records.size();
+		header.column_count = static_cast<uint32_t>(_columns.size());
+		header.day_index_start = _day_index_start;
+		header.bar_minutes = bar_minutes<Bar>;
+		std::size_t offset = sizeof(ArchiveHeader) + _columns.size() * sizeof(ColumnHeader);
+		if (_options.block_size) {
+			header.flags |= archive_flag_blocked;
+			header.block_size = *_options.block_size;
+			header.block_count = static_cast<uint32_t>(_blocks.size());
+			header.block_index_offset = offset;
+			offset += _blocks.size() * sizeof(ArchiveBlock);
+		}
+		for (std::size_t i = 0; i < _columns.size(); i++) {
+			offset = get_aligned_offset(offset);
+			_columns[i].offset = offset;
+			offset += _column_data[i].size();
+		}
+		_buffer.assign(offset, 0);
+		std::memcpy(_buffer.data(), &header, sizeof(header));
+		std::memcpy(_buffer.data() + sizeof(header), _columns.data(), _columns.size() * sizeof(ColumnHeader));
+		if (!_blocks.empty())
+			std::memcpy(_buffer.data() + header.block_index_offset, _blocks.data(), _blocks.size() * sizeof(ArchiveBlock));
+		for (std::size_t i = 0; i < _columns.size(); i++)
+			std::ranges::copy(_column_data[i], _buffer.begin() + _columns[i].offset);
+		_column_data.clear();
+	}
+
+	template class ArchiveWriterT<H1>;
+	template class ArchiveWriterT<M30>;
+	template class ArchiveWriterT<M15>;
+	template class ArchiveWriterT<M5>;
+	template class ArchiveWriterT<H4>;
+	template class ArchiveWriterT<Session>;
+}
\ No newline at end of file
@@ -1,8 +1,58 @@
+/*
+Generates the archives, panels and correlations of all contracts.
+Uses the configuration.yaml in the working directory.
+generate [--shard=<index>/<count> | --merge=<count>]
+
+--shard=<index>/<count> only generates the archives of the contracts assigned to one of count shards, e.g. --shard=3/8
+--merge=<count> checks the manifests of all shards once they have finished and assembles them into the final archive set
+The shards may run on different machines as long as they share the archive directory and the Barchart files.
+*/
 #include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
 
+#include <confounding/common.h>
 #include <confounding/parser.h>
+#include <confounding/shard.h>
+
+namespace {
+    constexpr std::string_view shard_argument = "--shard=";
+    constexpr std::string_view merge_argument = "--merge=";
+}
 
-int main() {
-    confounding::ArchiveGenerator::parse_futures();
+int main(int argc, char** argv) {
+    std::optional<confounding::ShardSpecification> shard;
+    std::optional<unsigned> merge_shard_count;
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string_view argument = argv[i];
+            if (argument.starts_with(shard_argument)) {
+                shard = confounding::get_shard_specification(std::string(argument.substr(shard_argument.size())));
+            } else if (argument.starts_with(merge_argument)) {
+                merge_shard_count = confounding::get_number<unsigned>(std::string(argument.substr(merge_argument.size())));
+            } else {
+                shard.reset();
+                merge_shard_count.reset();
+                break;
+            }
+        }
+    } catch (const std::exception& exception) {
+        std::cerr << exception.what() << std::endl;
+        return 1;
+    }
+    if ((argc > 1 && !shard && !merge_shard_count) || (shard && merge_shard_count)) {
+        std::cerr << "Usage: " << argv[0] << " [--shard=<index>/<count> | --merge=<count>]" << std::endl;
+        return 1;
+    }
+    try {
+        if (merge_shard_count)
+            confounding::ArchiveGenerator::merge_shards(*merge_shard_count);
+        else
+            confounding::ArchiveGenerator::parse_futures(shard);
+    } catch (const std::exception& exception) {
+        std::cerr << exception.what() << std::endl;
+        return 1;
+    }
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,246 @@
+/*
+Checks that archives produced by an optimized configuration contain the same records as a reference.
+parity [options] <candidate> [reference]
+
+Both paths may either be archive files or directories, in which case the archives are matched by file name.
+Only archives with H1 bars are checked, the archives of other bar durations within a directory are skipped.
+Without a reference the archives are regenerated in memory with the scalar ArchiveGenerator and no lossy encodings.
+That requires the configuration.yaml of the run that produced the candidates in the working directory, like generate.
+
+Options:
+--tolerance=<value> sets the maximum absolute difference of all float and returns columns, 0 by default
+--tolerance=<column>:<value> overrides it for a single column, e.g. one with a reduced-precision encoding
+
+The exit code is 0 if all archives match and 1 otherwise.
+*/
+#include <algorithm>
+#include <execution>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <confounding/common.h>
+#include <confounding/parser.h>
+#include <confounding/parity.h>
+#include <confounding/reader.h>
+#include <confounding/configuration/contracts.h>
+#include <confounding/configuration/filters.h>
+
+namespace {
+	typedef std::filesystem::path Path;
+
+	constexpr const char* archive_extension = ".archive";
+	constexpr std::string_view tolerance_argument = "--tolerance=";
+
+	struct ParityResult {
+		Path path;
+		std::vector<confounding::ColumnDivergence> divergences;
+		// Set if the archives couldn't be compared, e.g. because one of them is missing
+		std::optional<std::string> error;
+	};
+
+	bool is_h1_archive(const Path& path) {
+		try {
+			confounding::ArchiveReader reader(path.string());
+			return reader.get_header().bar_minutes == confounding::bar_minutes<confounding::H1>;
+		} catch (const std::exception&) {
+			// Keep unreadable archives so that the error is reported with the results
+			return true;
+		}
+	}
+
+	std::vector<Path> get_archive_paths(const Path& path) {
+		std::vector<Path> paths;
+		if (!std::filesystem::is_directory(path)) {
+			paths.push_back(path);
+			return paths;
+		}
+		for (const auto& entry : std::filesystem::directory_iterator(path)) {
+			if (entry.is_regular_file() && entry.path().extension() == archive_extension) {
+				// The M30, H4 and session archives of a run share the directory with the H1 archives
+				if (is_h1_archive(entry.path()))
+					paths.push_back(entry.path());
+				else
+					std::cout << std::format("{}: skipped, not an H1 archive", entry.path().filename().string()) << std::endl;
+			}
+		}
+		std::sort(paths.begin(), paths.end());
+		return paths;
+	}
+
+	confounding::Archive read_archive(const Path& path) {
+		confounding::ArchiveReader reader(path.string());
+		return reader.read_archive();
+	}
+
+	std::vector<ParityResult> compare_files(
+		const std::vector<Path>& candidate_paths,
+		const Path& reference,
+		const confounding::ParityOptions& options
+	) {
+		std::vector<ParityResult> results(candidate_paths.size());
+		std::vector<std::size_t> indexes(candidate_paths.size());
+		std::iota(indexes.begin(), indexes.end(), 0);
+		bool reference_directory = std::filesystem::is_directory(reference);
+		std::for_each(
+			std::execution::par,
+			indexes.begin(),
+			indexes.end(),
+			[&](std::size_t i) {
+				const Path& candidate_path = candidate_paths[i];
+				Path reference_path = reference_directory ? reference / candidate_path.filename() : reference;
+				results[i].path = candidate_path;
+				// Exceptions must not escape the parallel algorithm, they would terminate the process
+				try {
+					auto candidate_archive = read_archive(candidate_path);
+					auto reference_archive = read_archive(reference_path);
+					results[i].divergences = confounding::compare_archives(reference_archive, candidate_archive, options);
+				} catch (const std::exception& exception) {
+					results[i].error = exception.what();
+				}
+			}
+		);
+		return results;
+	}
+
+	std::vector<ParityResult> compare_regenerated(
+		const std::vector<Path>& candidate_paths,
+		const confounding::ParityOptions& options
+	) {
+		// The ingested records are shared by all series of a symbol
+		std::map<std::string, std::vector<std::size_t>> symbol_indexes;
+		std::vector<ParityResult> results(candidate_paths.size());
+		for (std::size_t i = 0; i < candidate_paths.size(); i++) {
+			results[i].path = candidate_paths[i];
+			try {
+				confounding::ArchiveReader reader(candidate_paths[i].string());
+				std::string symbol = reader.get_header().symbol;
+				symbol_indexes[symbol].push_back(i);
+			} catch (const std::exception& exception) {
+				results[i].error = exception.what();
+			}
+		}
+		std::vector<std::string> symbols;
+		for (const auto& [symbol, _] : symbol_indexes)
+			symbols.push_back(symbol);
+		const auto& contract_configuration = confounding::ContractConfiguration::get();
+		const auto& filter_configuration = confounding::ContractFilterConfiguration::get();
+		std::for_each(
+			std::execution::par,
+			symbols.begin(),
+			symbols.end(),
+			[&](const std::string& symbol) {
+				const auto& indexes = symbol_indexes.at(symbol);
+				// Exceptions must not escape the parallel algorithm, they would terminate the process
+				try {
+					const auto& contract = contract_configuration.get_contract(symbol);
+					const auto& filter = filter_configuration.get_filter(symbol);
+					auto daily_records = confounding::ArchiveGenerator::read_daily_records(symbol, filter);
+					auto intraday_records = confounding::ArchiveGenerator::read_intraday_records(symbol, filter);
+					for (std::size_t i : indexes) {
+						try {
+							auto candidate = read_archive(candidate_paths[i]);
+							auto f_number = confounding::ArchiveGenerator::get_f_number(candidate.series);
+							confounding::ArchiveGenerator generator(
+								f_number,
+								!f_number.has_value(),
+								symbol,
+								daily_records,
+								intraday_records,
+								filter,
+								contract
+							);
+							const auto& reference = generator.build_archive();
+							results[i].divergences = confounding::compare_archives(reference, candidate, options);
+						} catch (const std::exception& exception) {
+							results[i].error = exception.what();
+						}
+					}
+				} catch (const std::exception& exception) {
+					for (std::size_t i : indexes)
+						results[i].error = exception.what();
+				}
+			}
+		);
+		return results;
+	}
+
+	void parse_tolerance(std::string_view value, confounding::ParityOptions& options) {
+		auto separator = value.rfind(':');
+		if (separator == std::string_view::npos) {
+			options.tolerance = confounding::get_number<double>(std::string(value));
+			return;
+		}
+		std::string column(value.substr(0, separator));
+		options.column_tolerances[column] = confounding::get_number<double>(std::string(value.substr(separator + 1)));
+	}
+
+	bool print_results(const std::vector<ParityResult>& results) {
+		bool success = true;
+		for (const auto& result : results) {
+			if (result.error) {
+				success = false;
+				std::cout << std::format("{}: {}", result.path.filename().string(), *result.error) << std::endl;
+				continue;
+			}
+			if (result.divergences.empty()) {
+				std::cout << std::format("{}: identical", result.path.filename().string()) << std::endl;
+				continue;
+			}
+			success = false;
+			std::cout << std::format("{}: {} columns differ", result.path.filename().string(), result.divergences.size()) << std::endl;
+			for (const auto& divergence : result.divergences) {
+				std::cout << std::format(
+					"\t{}: {} mismatches, first at {}: reference {}, candidate {}",
+					divergence.column,
+					divergence.mismatches,
+					confounding::get_time_string(divergence.first_time),
+					divergence.reference_value,
+					divergence.candidate_value
+				) << std::endl;
+			}
+		}
+		return success;
+	}
+}
+
+int main(int argc, char** argv) {
+	confounding::ParityOptions options{
+		.tolerance = 0.0,
+	};
+	std::vector<Path> paths;
+	try {
+		for (int i = 1; i < argc; i++) {
+			std::string_view argument = argv[i];
+			if (argument.starts_with(tolerance_argument))
+				parse_tolerance(argument.substr(tolerance_argument.size()), options);
+			else
+				paths.push_back(argument);
+		}
+	} catch (const std::exception& exception) {
+		std::cerr << exception.what() << std::endl;
+		return 1;
+	}
+	if (paths.empty() || paths.size() > 2) {
+		std::cerr << "Usage: " << argv[0] << " [--tolerance=[<column>:]<value>] <candidate> [reference]" << std::endl;
+		return 1;
+	}
+	try {
+		auto candidate_paths = get_archive_paths(paths[0]);
+		std::vector<ParityResult> results;
+		if (paths.size() == 2)
+			results = compare_files(candidate_paths, paths[1], options);
+		else
+			results = compare_regenerated(candidate_paths, options);
+		return print_results(results) ? 0 : 1;
+	} catch (const std::exception& exception) {
+		std::cerr << exception.what() << std::endl;
+		return 1;
+	}
+}
\ No newline at end of file
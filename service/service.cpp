@@ -0,0 +1,22 @@
+/*
+Keeps the archives of all symbols in memory and serves them to other processes via shared memory.
+Uses the configuration.yaml in the working directory, like generate, and listens on service_socket_path.
+Clients connect with confounding::ArchiveClient.
+*/
+#include <iostream>
+
+#include <confounding/service.h>
+#include <confounding/configuration/base.h>
+
+int main() {
+	try {
+		const auto& configuration = confounding::Configuration::get();
+		confounding::ArchiveService service(configuration.service_socket_path);
+		std::cout << "Listening on " << configuration.service_socket_path << std::endl;
+		service.run();
+	} catch (const std::exception& exception) {
+		std::cerr << exception.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
\ No newline at end of file
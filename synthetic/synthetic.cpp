@@ -0,0 +1,359 @@
+/*
+Generates a synthetic Barchart dataset for load testing the full pipeline without access to the licensed data.
+Must be run from a directory containing filters.yaml, one pair of files is generated for each contract filter:
+synthetic <output directory> <first year> <last year> [listed contracts]
+
+The output directory receives:
+- barchart/<symbol>.D1.csv and barchart/<symbol>.H1.csv in the Barchart format expected by ArchiveGenerator
+- configuration.yaml, contracts.yaml and a copy of filters.yaml so that generate can be run from the output directory
+
+The size of the dataset scales linearly with the number of years and the number of listed contracts per day.
+*/
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <execution>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <confounding/common.h>
+#include <confounding/globex.h>
+#include <confounding/filter.h>
+#include <confounding/configuration/filters.h>
+
+namespace {
+	typedef std::filesystem::path Path;
+
+	constexpr unsigned default_listed_contracts = 3;
+	constexpr unsigned hours_per_day = 24;
+	// Day of the month on which contracts expire, a rough approximation of the third Friday
+	constexpr unsigned expiration_day = 15;
+	// Open interest moves from the front contract to the next one during the last days before expiration
+	constexpr int roll_days = 7;
+	constexpr double missing_hour_probability = 0.01;
+	constexpr double hourly_volatility = 0.002;
+	constexpr int64_t base_open_interest = 200000;
+	constexpr std::size_t file_buffer_size = 16 * 1024 * 1024;
+	constexpr std::size_t reference_date_offset_days = 90;
+	const std::string all_months = "FGHJKMNQUVXZ";
+
+	struct TickSize {
+		// Tick size in units of 10^-decimals
+		int64_t mantissa;
+		int decimals;
+		const char* string;
+	};
+
+	constexpr TickSize tick_sizes[] = {
+		{25, 2, "0.25"},
+		{1, 2, "0.01"},
+		{5, 3, "0.005"},
+		{5, 4, "0.0005"},
+		{1, 1, "0.1"},
+	};
+
+	const TickSize& get_tick_size(const std::string& barchart_symbol) {
+		return tick_sizes[std::hash<std::string>{}(barchart_symbol) % std::size(tick_sizes)];
+	}
+
+	struct ListedContract {
+		confounding::GlobexCode globex_code;
+		std::string symbol;
+		confounding::Date expiration;
+		// Constant contango/backwardation of the contract relative to the underlying, in ticks
+		int64_t basis;
+	};
+
+	class SyntheticSymbol {
+	public:
+		SyntheticSymbol(const confounding::ContractFilter& filter, int first_year, int last_year, unsigned listed_contracts)
+			: _filter(filter),
+			_first_year(first_year),
+			_last_year(last_year),
+			_listed_contracts(listed_contracts),
+			_generator(std::hash<std::string>{}(filter.barchart_symbol)),
+			_tick_size(get_tick_size(filter.barchart_symbol)) {
+			if (_filter.include_months)
+				_months = std::string(_filter.include_months->begin(), _filter.include_months->end());
+			else
+				_months = all_months;
+			// Start at a price of roughly 1000 to 5000 units
+			std::uniform_int_distribution<int64_t> price_distribution(1000, 5000);
+			_ticks = price_distribution(_generator) * get_ticks_per_unit();
+		}
+
+		void write(const Path& directory) {
+			std::ofstream daily_file;
+			std::ofstream intraday_file;
+			open_file(daily_file, _daily_buffer, directory, "D1");
+			open_file(intraday_file, _intraday_buffer, directory, "H1");
+			daily_file << "symbol,time,open,high,low,close,volume,open_interest\n";
+			intraday_file << "symbol,time,open,high,low,close,volume\n";
+			confounding::Date date{std::chrono::year{_first_year}, std::chrono::January, std::chrono::day{1}};
+			confounding::Date last_date{std::chrono::year{_last_year}, std::chrono::December, std::chrono::day{31}};
+			std::bernoulli_distribution missing_hour(missing_hour_probability);
+			std::normal_distribution<double> returns(0.0, hourly_volatility);
+			auto session_end = std::chrono::duration_cast<std::chrono::hours>(_filter.session_end.to_duration());
+			// CME style daily maintenance break after the end of the session
+			auto maintenance_hour = (session_end + std::chrono::hours{3}) % std::chrono::hours{hours_per_day};
+			for (; date <= last_date; confounding::add_day(date)) {
+				if (is_holiday(date))
+					continue;
+				update_contracts(date);
+				int64_t open_ticks = _ticks;
+				int64_t high_ticks = _ticks;
+				int64_t low_ticks = _ticks;
+				int64_t session_close_ticks = _ticks;
+				auto day_time = confounding::get_time(date);
+				for (unsigned hour = 0; hour < hours_per_day; hour++) {
+					std::chrono::hours hour_offset{hour};
+					if (hour_offset == maintenance_hour)
+						continue;
+					int64_t previous_ticks = _ticks;
+					int64_t step = std::llround(returns(_generator) * static_cast<double>(_ticks));
+					// Keep the price from collapsing in long random walks
+					_ticks = std::max(_ticks + step, get_ticks_per_unit());
+					high_ticks = std::max(high_ticks, _ticks);
+					low_ticks = std::min(low_ticks, _ticks);
+					if (hour_offset <= session_end)
+						session_close_ticks = _ticks;
+					if (missing_hour(_generator))
+						continue;
+					auto time_string = confounding::get_time_string(day_time + hour_offset);
+					for (const auto& contract : _contracts) {
+						intraday_file << std::format(
+							"{},{},{},{},{},{},{}\n",
+							contract.symbol,
+							time_string,
+							get_price(previous_ticks + contract.basis),
+							get_price(std::max(previous_ticks, _ticks) + contract.basis),
+							get_price(std::min(previous_ticks, _ticks) + contract.basis),
+							get_price(_ticks + contract.basis),
+							get_volume()
+						);
+					}
+				}
+				auto date_string = confounding::get_date_string(date);
+				for (std::size_t i = 0; i < _contracts.size(); i++) {
+					const auto& contract = _contracts[i];
+					daily_file << std::format(
+						"{},{},{},{},{},{},{},{}\n",
+						contract.symbol,
+						date_string,
+						get_price(open_ticks + contract.basis),
+						get_price(high_ticks + contract.basis),
+						get_price(low_ticks + contract.basis),
+						get_price(session_close_ticks + contract.basis),
+						get_volume(),
+						get_open_interest(date, i)
+					);
+				}
+			}
+			if (!daily_file || !intraday_file)
+				throw confounding::Exception("Failed to write synthetic data for {}", _filter.exchange_symbol);
+		}
+
+	private:
+		const confounding::ContractFilter& _filter;
+		int _first_year;
+		int _last_year;
+		unsigned _listed_contracts;
+		std::mt19937_64 _generator;
+		TickSize _tick_size;
+		std::string _months;
+		std::vector<char> _daily_buffer;
+		std::vector<char> _intraday_buffer;
+		int64_t _ticks;
+		// Listed contracts ordered by expiration, the first one being the front month
+		std::vector<ListedContract> _contracts;
+
+		void open_file(std::ofstream& file, std::vector<char>& buffer, const Path& directory, const std::string& suffix) {
+			// The files can get very large, use a bigger buffer than the default one of the stream
+			buffer.resize(file_buffer_size);
+			file.rdbuf()->pubsetbuf(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+			Path path = directory / std::format("{}.{}.csv", _filter.exchange_symbol, suffix);
+			file.open(path, std::ios::binary);
+			if (!file)
+				throw confounding::Exception("Failed to create file {}", path.string());
+		}
+
+		static bool is_holiday(confounding::Date date) {
+			auto weekday = std::chrono::weekday{date};
+			if (weekday == std::chrono::Saturday || weekday == std::chrono::Sunday)
+				return true;
+			auto month_day = date.month() / date.day();
+			return
+				month_day == std::chrono::January / 1 ||
+				month_day == std::chrono::July / 4 ||
+				month_day == std::chrono::December / 25;
+		}
+
+		void update_contracts(confounding::Date date) {
+			while (!_contracts.empty() && _contracts.front().expiration < date)
+				_contracts.erase(_contracts.begin());
+			while (_contracts.size() < _listed_contracts) {
+				auto next_code = get_next_contract();
+				std::chrono::year_month_day expiration{
+					std::chrono::year{static_cast<int>(*next_code.year)},
+					get_month(*next_code.month),
+					std::chrono::day{expiration_day}
+				};
+				std::uniform_int_distribution<int64_t> basis_distribution(-20, 20);
+				int64_t basis = static_cast<int64_t>(_contracts.size()) * basis_distribution(_generator);
+				ListedContract contract{
+					.globex_code = next_code,
+					.symbol = get_globex_string(next_code),
+					.expiration = expiration,
+					.basis = basis,
+				};
+				_contracts.push_back(contract);
+			}
+		}
+
+		confounding::GlobexCode get_next_contract() const {
+			if (_contracts.empty()) {
+				// The first contract of the dataset is the first one to expire in the first year
+				return confounding::GlobexCode(_filter.barchart_symbol, _months.front(), static_cast<unsigned>(_first_year));
+			}
+			const auto& last_code = _contracts.back().globex_code;
+			auto position = _months.find(*last_code.month);
+			unsigned year = *last_code.year;
+			if (position + 1 < _months.size())
+				return confounding::GlobexCode(_filter.barchart_symbol, _months[position + 1], year);
+			return confounding::GlobexCode(_filter.barchart_symbol, _months.front(), year + 1);
+		}
+
+		static std::chrono::month get_month(char month_code) {
+			auto position = all_months.find(month_code);
+			return std::chrono::month{static_cast<unsigned>(position) + 1};
+		}
+
+		static std::string get_globex_string(const confounding::GlobexCode& globex_code) {
+			return std::format("{}{}{:02}", *globex_code.root, *globex_code.month, *globex_code.year % 100);
+		}
+
+		int64_t get_ticks_per_unit() const {
+			int64_t units = 1;
+			for (int i = 0; i < _tick_size.decimals; i++)
+				units *= 10;
+			return units / _tick_size.mantissa;
+		}
+
+		std::string get_price(int64_t ticks) const {
+			int64_t amount = std::max<int64_t>(ticks, 1) * _tick_size.mantissa;
+			int64_t factor = 1;
+			for (int i = 0; i < _tick_size.decimals; i++)
+				factor *= 10;
+			return std::format("{}.{:0{}}", amount / factor, amount % factor, _tick_size.decimals);
+		}
+
+		int64_t get_volume() {
+			std::uniform_int_distribution<int64_t> volume_distribution(100, 10000);
+			return volume_distribution(_generator);
+		}
+
+		int64_t get_open_interest(confounding::Date date, std::size_t index) const {
+			auto days_to_expiration = (std::chrono::sys_days{_contracts.front().expiration} - std::chrono::sys_days{date}).count();
+			double roll = std::clamp(static_cast<double>(days_to_expiration) / roll_days, 0.0, 1.0);
+			double share;
+			if (index == 0)
+				share = roll;
+			else if (index == 1)
+				share = 1.0 - 0.9 * roll;
+			else
+				share = 0.05;
+			return std::max<int64_t>(static_cast<int64_t>(share * base_open_interest), 1);
+		}
+	};
+
+	void write_configuration(const Path& output_directory, const Path& barchart_directory, int first_year) {
+		confounding::Date first_date{std::chrono::year{first_year}, std::chrono::January, std::chrono::day{1}};
+		confounding::Date reference_date = std::chrono::sys_days{first_date} + std::chrono::days{reference_date_offset_days};
+		std::ofstream file(output_directory / "configuration.yaml");
+		file << std::format("barchart_directory: {}\n", std::filesystem::absolute(barchart_directory).generic_string());
+		file << std::format("reference_date: {}\n", confounding::get_date_string(reference_date));
+		file << std::format("archive_directory: {}\n", std::filesystem::absolute(output_directory / "archives").generic_string());
+		if (!file)
+			throw confounding::Exception("Failed to write configuration.yaml");
+	}
+
+	void write_contracts(const Path& output_directory, const std::vector<const confounding::ContractFilter*>& filters) {
+		std::ofstream file(output_directory / "contracts.yaml");
+		for (const auto* filter : filters) {
+			file << std::format("- symbol: {}\n", filter->exchange_symbol);
+			file << std::format("  name: Synthetic {}\n", filter->barchart_symbol);
+			file << "  currency: USD\n";
+			file << std::format("  tick_size: {}\n", get_tick_size(filter->barchart_symbol).string);
+			file << "  tick_value: 12.5\n";
+			file << "  margin: 10000\n";
+			file << "  broker_fee: 1.5\n";
+			file << "  exchange_fee: 1.0\n";
+			file << "  spread: 1\n";
+		}
+		if (!file)
+			throw confounding::Exception("Failed to write contracts.yaml");
+	}
+}
+
+int main(int argc, char** argv) {
+	if (argc < 4 || argc > 5) {
+		std::cerr << "Usage: " << argv[0] << " <output directory> <first year> <last year> [listed contracts]" << std::endl;
+		return 1;
+	}
+	try {
+		Path output_directory = argv[1];
+		int first_year = confounding::get_number<int>(argv[2]);
+		int last_year = confounding::get_number<int>(argv[3]);
+		unsigned listed_contracts = argc == 5 ? confounding::get_number<unsigned>(argv[4]) : default_listed_contracts;
+		if (first_year > last_year || listed_contracts == 0)
+			throw confounding::Exception("Invalid arguments");
+		Path barchart_directory = output_directory / "barchart";
+		std::filesystem::create_directories(barchart_directory);
+		std::filesystem::create_directories(output_directory / "archives");
+		const auto& filter_configuration = confounding::ContractFilterConfiguration::get();
+		std::vector<const confounding::ContractFilter*> filters;
+		for (const auto& filter : filter_configuration)
+			filters.push_back(&filter);
+		std::vector<std::optional<std::string>> errors(filters.size());
+		std::vector<std::size_t> indexes(filters.size());
+		std::iota(indexes.begin(), indexes.end(), 0);
+		std::for_each(
+			std::execution::par,
+			indexes.begin(),
+			indexes.end(),
+			[&](std::size_t i) {
+				// Exceptions must not escape the parallel algorithm, they would terminate the process
+				try {
+					SyntheticSymbol symbol(*filters[i], first_year, last_year, listed_contracts);
+					symbol.write(barchart_directory);
+				} catch (const std::exception& exception) {
+					errors[i] = exception.what();
+				}
+			}
+		);
+		bool success = true;
+		for (std::size_t i = 0; i < filters.size(); i++) {
+			if (errors[i]) {
+				std::cerr << std::format("{}: {}", filters[i]->barchart_symbol, *errors[i]) << std::endl;
+				success = false;
+			}
+		}
+		if (!success)
+			return 1;
+		write_configuration(output_directory, barchart_directory, first_year);
+		write_contracts(output_directory, filters);
+		std::filesystem::copy_file("filters.yaml", output_directory / "filters.yaml", std::filesystem::copy_options::overwrite_existing);
+	} catch (const std::exception& exception) {
+		std::cerr << exception.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
\ No newline at end of file